@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Benchmark.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Benchmark Suite														  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+namespace {
+	/*
+		return: value of "key": in line (number or string), empty if missing.
+	*/
+	std::string jsonField(const char *line, const char *key)
+	{
+		std::string pattern = std::string("\"") + key + "\":";
+		const char *found = strstr(line, pattern.c_str());
+		if (!found)
+			return std::string();
+
+		const char *value = found + pattern.size();
+		while (*value == ' ')
+			value++;
+
+		if (*value == '"') {
+			const char *end = strchr(value + 1, '"');
+			return end ? std::string(value + 1, end) : std::string();
+		}
+
+		const char *end = value;
+		while (*end && *end != ',' && *end != '}' && *end != ' ')
+			end++;
+		return std::string(value, end);
+	}
+}
+
+void BenchmarkSuite::add(const std::string& name, const std::string& unit, uint64_t items,
+	std::function<void()> setup, std::function<void()> run)
+{
+	m_benchmarks.push_back({ name, unit, items, setup, run });
+}
+
+void BenchmarkSuite::setRepetitions(int repetitions)
+{
+	m_repetitions = std::max(repetitions, 1);
+}
+
+void BenchmarkSuite::setFilter(const std::string& filter)
+{
+	m_filter = filter;
+}
+
+void BenchmarkSuite::run()
+{
+	using Clock = std::chrono::steady_clock;
+
+	m_results.clear();
+	printf("%-24s %10s %10s %10s %16s\n", "benchmark", "median ms", "min ms", "stddev", "throughput");
+
+	for (Benchmark& benchmark : m_benchmarks) {
+		if (!m_filter.empty() && benchmark.name.find(m_filter) == std::string::npos)
+			continue;
+
+		if (benchmark.setup)
+			benchmark.setup();
+		benchmark.run();
+
+		std::vector<double> times;
+		for (int i = 0; i < m_repetitions; i++) {
+			Clock::time_point start = Clock::now();
+			benchmark.run();
+			times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+		}
+
+		Result result;
+		result.name = benchmark.name;
+		result.unit = benchmark.unit;
+		result.items = benchmark.items;
+		result.repetitions = m_repetitions;
+
+		std::sort(times.begin(), times.end());
+		size_t half = times.size() / 2;
+		result.median = times.size() % 2 ? times[half] : 0.5 * (times[half - 1] + times[half]);
+		result.min = times.front();
+		for (double time : times)
+			result.mean += time;
+		result.mean /= times.size();
+		for (double time : times)
+			result.stddev += (time - result.mean) * (time - result.mean);
+		result.stddev = std::sqrt(result.stddev / times.size());
+
+		double per_second = result.median > 0.0 ? result.items / (result.median * 1e-3) : 0.0;
+		printf("%-24s %10.3f %10.3f %10.3f %10.2f M%s/s\n", result.name.c_str(),
+			result.median, result.min, result.stddev, per_second * 1e-6, result.unit.c_str());
+
+		m_results.push_back(result);
+	}
+}
+
+const std::vector<BenchmarkSuite::Result>& BenchmarkSuite::getResults() const
+{
+	return m_results;
+}
+
+bool BenchmarkSuite::writeJson(const char *path) const
+{
+	FILE *fout;
+	fopen_s(&fout, path, "wt");
+	if (!fout) {
+		printf("benchmark: can not create %s\n", path);
+		return false;
+	}
+
+	fprintf(fout, "{ \"benchmarks\": [\n");
+	for (size_t i = 0; i < m_results.size(); i++) {
+		const Result& result = m_results[i];
+		fprintf(fout, "{ \"name\": \"%s\", \"unit\": \"%s\", \"items\": %llu, \"repetitions\": %d, "
+			"\"median_ms\": %.6f, \"mean_ms\": %.6f, \"stddev_ms\": %.6f, \"min_ms\": %.6f }%s\n",
+			result.name.c_str(), result.unit.c_str(), (unsigned long long)result.items, result.repetitions,
+			result.median, result.mean, result.stddev, result.min, i + 1 < m_results.size() ? "," : "");
+	}
+	fprintf(fout, "] }\n");
+	fclose(fout);
+
+	return true;
+}
+
+bool BenchmarkSuite::readJson(const char *path, std::vector<Result>& results)
+{
+	FILE *fin;
+	fopen_s(&fin, path, "rt");
+	if (!fin) {
+		printf("benchmark: can not open %s\n", path);
+		return false;
+	}
+
+	results.clear();
+	char line[1024];
+	while (fgets(line, sizeof(line), fin)) {
+		std::string name = jsonField(line, "name");
+		if (name.empty())
+			continue;
+
+		Result result;
+		result.name = name;
+		result.unit = jsonField(line, "unit");
+		result.items = strtoull(jsonField(line, "items").c_str(), nullptr, 10);
+		result.repetitions = atoi(jsonField(line, "repetitions").c_str());
+		result.median = atof(jsonField(line, "median_ms").c_str());
+		result.mean = atof(jsonField(line, "mean_ms").c_str());
+		result.stddev = atof(jsonField(line, "stddev_ms").c_str());
+		result.min = atof(jsonField(line, "min_ms").c_str());
+		results.push_back(result);
+	}
+	fclose(fin);
+
+	return true;
+}
+
+int BenchmarkSuite::compare(const std::vector<Result>& baseline, double threshold) const
+{
+	int regressions = 0;
+	printf("%-24s %10s %10s %8s\n", "benchmark", "base ms", "now ms", "change");
+
+	for (const Result& result : m_results) {
+		auto base = std::find_if(baseline.begin(), baseline.end(),
+			[&](const Result& other) { return other.name == result.name; });
+		if (base == baseline.end() || base->median <= 0.0)
+			continue;
+
+		double change = result.median / base->median - 1.0;
+		bool regressed = change > threshold;
+		if (regressed)
+			regressions++;
+
+		printf("%-24s %10.3f %10.3f %+7.1f%%%s\n", result.name.c_str(), base->median, result.median,
+			100.0 * change, regressed ? "  REGRESSION" : "");
+	}
+
+	return regressions;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/************************************************************/
+/*															*/
+// Benchmark Suite
+/*															*/
+/************************************************************/
+
+/*
+	runs each benchmark once to warm up, then repetitions times,
+	and keeps the median, mean, standard deviation and min of the runs.
+	setup() builds the inputs once (fixed seeds), only run() is timed.
+
+	json (one benchmark per line, readJson() reads the same form):
+	{ "benchmarks": [
+	{ "name": ..., "unit": ..., "items": ..., "repetitions": ..., "median_ms": ..., ... },
+	] }
+*/
+class BenchmarkSuite
+{
+public:
+	struct Result {
+		std::string name;
+		std::string unit;
+		uint64_t items = 0;
+		int repetitions = 0;
+		double median = 0.0;	// ms
+		double mean = 0.0;
+		double stddev = 0.0;
+		double min = 0.0;
+	};
+
+private:
+	struct Benchmark {
+		std::string name;
+		std::string unit;
+		uint64_t items;
+		std::function<void()> setup;
+		std::function<void()> run;
+	};
+
+	std::vector<Benchmark> m_benchmarks;
+	std::vector<Result> m_results;
+	int m_repetitions = 10;
+	std::string m_filter;
+
+public:
+	BenchmarkSuite() = default;
+	~BenchmarkSuite() = default;
+
+	/*
+		items:
+		work of one run in unit (triangles, rays ...), for the throughput.
+		setup: may be empty.
+	*/
+	void add(const std::string& name, const std::string& unit, uint64_t items,
+		std::function<void()> setup, std::function<void()> run);
+	void setRepetitions(int repetitions);
+	/*
+		only benchmarks whose name contains filter are run.
+	*/
+	void setFilter(const std::string& filter);
+
+	void run();
+	const std::vector<Result>& getResults() const;
+
+	bool writeJson(const char *path) const;
+	static bool readJson(const char *path, std::vector<Result>& results);
+	/*
+		a benchmark regresses if its median is above the baseline
+		median * (1 + threshold). benchmarks missing on one side are skipped.
+		return: number of regressions.
+	*/
+	int compare(const std::vector<Result>& baseline, double threshold) const;
+};
@@ -0,0 +1,330 @@
+#include <gl/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "BVH.h"
+#include "GLObject.h"
+#include "MeshLod.h"
+#include "Meshlet.h"
+#include "Registry.h"
+#include "Selection.h"
+#include "Transform.h"
+
+/*
+	cpu hot paths of Test_Color_Picking on synthetic inputs with fixed seeds.
+	obj loading needs a gl context (the vertex buffer upload is part of
+	VAO::load), a hidden window is created for it and the obj benchmarks
+	are skipped if that fails.
+*/
+
+namespace {
+	constexpr unsigned SEED = 20190823u;
+	// sphere of 2 * RINGS * SEGMENTS triangles
+	constexpr int RINGS = 256;
+	constexpr int SEGMENTS = 512;
+	constexpr int INSTANCES = 100000;
+	constexpr int RAYS = 100000;
+
+	// results are stored here so the timed work is not optimized away.
+	volatile uint64_t g_sink = 0;
+
+	/*
+		closed uv sphere with bumps, 3 vertices per triangle (xyz).
+	*/
+	std::vector<float> makeSphere(int rings, int segments)
+	{
+		auto point = [&](int ring, int segment) {
+			if (ring == 0)
+				return glm::vec3(0.f, 1.f, 0.f);
+			if (ring == rings)
+				return glm::vec3(0.f, -1.f, 0.f);
+
+			float theta = 3.14159265f * ring / rings;
+			float phi = 6.2831853f * (segment % segments) / segments;
+			float r = 1.f + 0.05f * std::sin(7.f * theta) * std::cos(5.f * phi);
+			return r * glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+		};
+
+		std::vector<float> positions;
+		positions.reserve(18 * (size_t)rings * segments);
+		auto push = [&](const glm::vec3& p) {
+			positions.push_back(p.x);
+			positions.push_back(p.y);
+			positions.push_back(p.z);
+		};
+
+		for (int ring = 0; ring < rings; ring++) {
+			for (int segment = 0; segment < segments; segment++) {
+				glm::vec3 a = point(ring, segment), b = point(ring + 1, segment);
+				glm::vec3 c = point(ring + 1, segment + 1), d = point(ring, segment + 1);
+				push(a); push(c); push(b);
+				push(a); push(d); push(c);
+			}
+		}
+
+		return positions;
+	}
+
+	/*
+		writes the sphere as an obj with v, vt, vn and triangles f v/t/n.
+	*/
+	bool writeObj(const char *path, int rings, int segments)
+	{
+		FILE *fout;
+		fopen_s(&fout, path, "wt");
+		if (!fout)
+			return false;
+
+		int columns = segments + 1;
+		for (int ring = 0; ring <= rings; ring++) {
+			for (int segment = 0; segment <= segments; segment++) {
+				float theta = 3.14159265f * ring / rings;
+				float phi = 6.2831853f * segment / segments;
+				glm::vec3 p(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+				fprintf(fout, "v %f %f %f\n", p.x, p.y, p.z);
+				fprintf(fout, "vt %f %f\n", (float)segment / segments, (float)ring / rings);
+				fprintf(fout, "vn %f %f %f\n", p.x, p.y, p.z);
+			}
+		}
+
+		fprintf(fout, "o sphere\n");
+		for (int ring = 0; ring < rings; ring++) {
+			for (int segment = 0; segment < segments; segment++) {
+				int a = ring * columns + segment + 1, b = a + columns, c = b + 1, d = a + 1;
+				fprintf(fout, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, b, b, b);
+				fprintf(fout, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, d, d, d, c, c, c);
+			}
+		}
+		fclose(fout);
+
+		return true;
+	}
+
+	glm::vec3 randomUnit(std::mt19937& random)
+	{
+		std::normal_distribution<float> normal;
+		glm::vec3 v(normal(random), normal(random), normal(random));
+		float length = glm::length(v);
+		return length > 0.f ? v / length : glm::vec3(0.f, 1.f, 0.f);
+	}
+
+	bool createContext()
+	{
+		if (!glfwInit())
+			return false;
+
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		GLFWwindow *window = glfwCreateWindow(64, 64, "Benchmarks", nullptr, nullptr);
+		if (!window)
+			return false;
+
+		glfwMakeContextCurrent(window);
+		glewExperimental = GL_TRUE;
+		return glewInit() == GLEW_OK;
+	}
+}
+
+/*
+	Benchmarks [--out file] [--baseline file] [--threshold 0.1] [--repetitions 10] [--filter name]
+	--out: writes the results as json.
+	--baseline: compares with a json of an earlier run, the exit code is 1
+	if a median is more than threshold (ratio) slower.
+*/
+int main(int argc, char **argv)
+{
+	const char *out_file = nullptr;
+	const char *baseline_file = nullptr;
+	double threshold = 0.1;
+	BenchmarkSuite suite;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--out") == 0)
+			out_file = argv[i + 1];
+		else if (strcmp(argv[i], "--baseline") == 0)
+			baseline_file = argv[i + 1];
+		else if (strcmp(argv[i], "--threshold") == 0)
+			threshold = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--repetitions") == 0)
+			suite.setRepetitions(atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--filter") == 0)
+			suite.setFilter(argv[i + 1]);
+	}
+
+	// 입력 (고정 시드)
+	std::mt19937 random(SEED);
+	std::vector<float> sphere = makeSphere(RINGS, SEGMENTS);
+	int vertex_count = (int)sphere.size() / 3;
+	uint64_t triangle_count = (uint64_t)vertex_count / 3;
+
+	std::vector<Ray> rays;
+	for (int i = 0; i < RAYS; i++) {
+		glm::vec3 origin = 3.f * randomUnit(random);
+		glm::vec3 target = 0.5f * randomUnit(random);
+		rays.push_back(Ray(origin, glm::normalize(target - origin)));
+	}
+
+	std::vector<AABB> boxes;
+	std::uniform_real_distribution<float> position(-50.f, 50.f);
+	std::uniform_real_distribution<float> extent(0.1f, 1.f);
+	for (int i = 0; i < INSTANCES; i++) {
+		glm::vec3 center(position(random), position(random), position(random));
+		glm::vec3 half(extent(random), extent(random), extent(random));
+		boxes.push_back(AABB(center - half, center + half));
+	}
+	glm::mat4 view_proj = glm::perspective(0.8f, 1.f, 0.1f, 100.f)
+		* glm::lookAt(glm::vec3(0.f, 0.f, 60.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+
+	std::vector<uint32_t> region_ids;
+	std::uniform_int_distribution<uint32_t> id(1, INSTANCES);
+	for (int i = 0; i < INSTANCES / 2; i++)
+		region_ids.push_back(id(random));
+
+	// obj 읽기 (정점 버퍼 업로드 포함)
+	const char *obj_file = "benchmark_sphere.obj";
+	VAO *vao = nullptr;
+	if (createContext() && writeObj(obj_file, RINGS, SEGMENTS)) {
+		vao = new VAO();
+		suite.add("obj_load", "triangles", triangle_count, nullptr, [&]() {
+			vao->unload();
+			vao->load(obj_file);
+		});
+		suite.add("obj_load_streaming", "triangles", triangle_count, nullptr,
+			[&]() { vao->loadStreaming(obj_file); });
+	}
+	else {
+		puts("no gl context, obj benchmarks skipped");
+	}
+
+	// 정점 합치기 (용접)와 미트렛 분할, LOD 단순화
+	std::vector<int> order;
+	std::vector<Meshlet> meshlets;
+	suite.add("weld_meshlets", "triangles", triangle_count, nullptr,
+		[&]() { buildMeshlets(sphere.data(), vertex_count, { 0 }, order, meshlets); });
+
+	std::vector<float> lod_positions, lod_normals;
+	std::vector<int> lod_parts;
+	suite.add("simplify_quarter", "triangles", triangle_count, nullptr, [&]() {
+		simplifyMesh(sphere.data(), vertex_count, { 0 }, (int)(triangle_count / 4),
+			lod_positions, lod_normals, lod_parts);
+	});
+
+	// 메쉬 BVH
+	MeshBVH mesh_bvh;
+	suite.add("mesh_bvh_build", "triangles", triangle_count, nullptr,
+		[&]() { mesh_bvh.build(sphere.data(), vertex_count); });
+	suite.add("mesh_bvh_raycast", "rays", RAYS, [&]() { mesh_bvh.build(sphere.data(), vertex_count); }, [&]() {
+		int hits = 0;
+		for (const Ray& ray : rays) {
+			MeshBVH::Hit hit;
+			hits += mesh_bvh.intersect(ray, FLT_MAX, hit) ? 1 : 0;
+		}
+		g_sink = hits;
+	});
+
+	// 인스턴스 BVH와 절두체 컬링
+	InstanceBVH scene_bvh;
+	std::vector<int> visible;
+	suite.add("instance_bvh_build", "instances", INSTANCES, nullptr,
+		[&]() { scene_bvh.build(INSTANCES, [&](int instance) { return boxes[instance]; }); });
+	suite.add("frustum_query", "instances", INSTANCES,
+		[&]() { scene_bvh.build(INSTANCES, [&](int instance) { return boxes[instance]; }); },
+		[&]() {
+			visible.clear();
+			scene_bvh.query(Frustum(view_proj), visible);
+			g_sink = visible.size();
+		});
+	// 모든 인스턴스가 움직이는 프레임의 리핏 (경계 갱신 포함)
+	int refit_frame = 0;
+	suite.add("instance_bvh_refit", "instances", INSTANCES,
+		[&]() { scene_bvh.build(INSTANCES, [&](int instance) { return boxes[instance]; }); },
+		[&]() {
+			refit_frame++;
+			for (int i = 0; i < INSTANCES; i++) {
+				glm::vec3 offset(0.f, 0.01f * (float)((refit_frame + i) % 8), 0.f);
+				scene_bvh.update(i, AABB(boxes[i].min + offset, boxes[i].max + offset));
+			}
+			scene_bvh.refit();
+			g_sink = (uint64_t)scene_bvh.getRebuildCount();
+		});
+	suite.add("frustum_linear", "instances", INSTANCES, nullptr, [&]() {
+		Frustum frustum(view_proj);
+		visible.clear();
+		for (int i = 0; i < INSTANCES; i++)
+			if (frustum.test(boxes[i]) != Frustum::OUTSIDE)
+				visible.push_back(i);
+		g_sink = visible.size();
+	});
+
+	// 트랜스폼 (10%가 움직이는 프레임)
+	TransformStore transforms;
+	int frame = 0;
+	suite.add("transform_update", "transforms", INSTANCES / 10, [&]() {
+		transforms.clear();
+		for (int i = 0; i < INSTANCES; i++)
+			transforms.add(boxes[i].center());
+		transforms.update();
+	}, [&]() {
+		frame++;
+		for (int i = frame % 10; i < INSTANCES; i += 10)
+			transforms.setPosition(i, boxes[i].center() + glm::vec3(0.f, 0.01f * frame, 0.f));
+		transforms.update();
+	});
+
+	// id 버퍼 결과 (영역 선택 id 목록) 적용
+	SelectionSet selection;
+	suite.add("selection_apply", "ids", region_ids.size(), [&]() { selection.resize(INSTANCES + 1); }, [&]() {
+		for (uint32_t region_id : region_ids)
+			selection.toggle(region_id);
+		selection.setRange(1, INSTANCES / 4);
+		g_sink = selection.count();
+	});
+
+	// 핸들 레지스트리 (10%를 지운 뒤 모든 핸들 조회)
+	Registry<AABB> registry;
+	std::vector<Handle<AABB>> handles;
+	suite.add("registry_churn", "handles", INSTANCES, nullptr, [&]() {
+		registry.clear();
+		handles.clear();
+		for (int i = 0; i < INSTANCES; i++)
+			handles.push_back(registry.add(AABB(boxes[i])));
+		for (int i = 0; i < INSTANCES; i += 10)
+			registry.remove(handles[i]);
+		registry.collect();
+
+		int found = 0;
+		for (Handle<AABB> handle : handles)
+			found += registry.get(handle) ? 1 : 0;
+		g_sink = found;
+	});
+
+	suite.run();
+	delete vao;
+	remove(obj_file);
+
+	if (out_file && !suite.writeJson(out_file))
+		return -1;
+
+	int regressions = 0;
+	if (baseline_file) {
+		std::vector<BenchmarkSuite::Result> baseline;
+		if (!BenchmarkSuite::readJson(baseline_file, baseline))
+			return -1;
+		regressions = suite.compare(baseline, threshold);
+		printf("%d regressions above %.0f%%\n", regressions, 100.0 * threshold);
+	}
+
+	glfwTerminate();
+
+	return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,1198 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "BVH.h"
+#include "Parallel.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Bounding Volumes														  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+AABB::AABB(const glm::vec3& min, const glm::vec3& max)
+	: min(min), max(max)
+{
+}
+
+bool AABB::isValid() const
+{
+	return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+}
+
+void AABB::expand(const glm::vec3& point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void AABB::expand(const AABB& box)
+{
+	min = glm::min(min, box.min);
+	max = glm::max(max, box.max);
+}
+
+glm::vec3 AABB::center() const
+{
+	return (min + max) * 0.5f;
+}
+
+float AABB::surfaceArea() const
+{
+	if (!isValid())
+		return 0.f;
+
+	glm::vec3 d = max - min;
+	return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+bool AABB::overlaps(const AABB& box) const
+{
+	return min.x <= box.max.x && max.x >= box.min.x
+		&& min.y <= box.max.y && max.y >= box.min.y
+		&& min.z <= box.max.z && max.z >= box.min.z;
+}
+
+bool AABB::contains(const AABB& box) const
+{
+	return min.x <= box.min.x && max.x >= box.max.x
+		&& min.y <= box.min.y && max.y >= box.max.y
+		&& min.z <= box.min.z && max.z >= box.max.z;
+}
+
+AABB AABB::transform(const glm::mat4& matrix) const
+{
+	if (!isValid())
+		return AABB();
+
+	// center and extent form (Arvo)
+	glm::vec3 c = center();
+	glm::vec3 e = (max - min) * 0.5f;
+
+	glm::vec3 new_c = glm::vec3(matrix * glm::vec4(c, 1.f));
+	glm::vec3 new_e;
+	for (int i = 0; i < 3; i++) {
+		new_e[i] = std::fabs(matrix[0][i]) * e.x
+			+ std::fabs(matrix[1][i]) * e.y
+			+ std::fabs(matrix[2][i]) * e.z;
+	}
+
+	return AABB(new_c - new_e, new_c + new_e);
+}
+
+AABB AABB::merge(const AABB& a, const AABB& b)
+{
+	return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+Ray::Ray(const glm::vec3& origin, const glm::vec3& dir)
+	: origin(origin), dir(dir)
+{
+	invDir = glm::vec3(1.f / dir.x, 1.f / dir.y, 1.f / dir.z);
+}
+
+Ray Ray::transform(const glm::mat4& inverse_matrix) const
+{
+	glm::vec3 o = glm::vec3(inverse_matrix * glm::vec4(origin, 1.f));
+	glm::vec3 d = glm::vec3(inverse_matrix * glm::vec4(dir, 0.f));
+
+	return Ray(o, d);
+}
+
+bool Ray::intersect(const AABB& box, float tMax, float *tNear) const
+{
+	float t0 = 0.f;
+	float t1 = tMax;
+
+	for (int i = 0; i < 3; i++) {
+		float ta = (box.min[i] - origin[i]) * invDir[i];
+		float tb = (box.max[i] - origin[i]) * invDir[i];
+		if (ta > tb)
+			std::swap(ta, tb);
+
+		// NaN (0 * inf) keeps the previous value.
+		t0 = ta > t0 ? ta : t0;
+		t1 = tb < t1 ? tb : t1;
+		if (t0 > t1)
+			return false;
+	}
+
+	if (tNear)
+		*tNear = t0;
+
+	return true;
+}
+
+Frustum::Frustum(const glm::mat4& view_proj)
+{
+	// Gribb-Hartmann, row i of a column major matrix
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+
+	planes[0] = row[3] + row[0]; // left
+	planes[1] = row[3] - row[0]; // right
+	planes[2] = row[3] + row[1]; // bottom
+	planes[3] = row[3] - row[1]; // top
+	planes[4] = row[3] + row[2]; // near
+	planes[5] = row[3] - row[2]; // far
+
+	for (auto& plane : planes)
+		plane = plane / glm::length(glm::vec3(plane));
+}
+
+Frustum::Result Frustum::test(const AABB& box) const
+{
+	Result result = INSIDE;
+
+	for (const auto& plane : planes) {
+		glm::vec3 n(plane);
+
+		// farthest and nearest corner along the plane normal
+		glm::vec3 p(n.x >= 0 ? box.max.x : box.min.x, n.y >= 0 ? box.max.y : box.min.y, n.z >= 0 ? box.max.z : box.min.z);
+		glm::vec3 q(n.x >= 0 ? box.min.x : box.max.x, n.y >= 0 ? box.min.y : box.max.y, n.z >= 0 ? box.min.z : box.max.z);
+
+		if (glm::dot(n, p) + plane.w < 0.f)
+			return OUTSIDE;
+		if (glm::dot(n, q) + plane.w < 0.f)
+			result = INTERSECT;
+	}
+
+	return result;
+}
+
+bool Frustum::test(const glm::vec3& center, float radius) const
+{
+	for (const auto& plane : planes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	}
+
+	return true;
+}
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Mesh BVH																  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+namespace {
+	constexpr int BIN_COUNT = 12;
+	constexpr int MAX_LEAF_TRIANGLES = 4;
+
+	/*
+		depth first traversal stack. the sah builds do not bound the height
+		of the tree, so a tree deeper than the local array gets a heap array
+		of its height (a traversal holds at most height + 1 nodes).
+	*/
+	template <typename T>
+	class TraversalStack
+	{
+		static constexpr int LOCAL_SIZE = 128;
+
+		T m_local[LOCAL_SIZE];
+		std::vector<T> m_heap;
+		T *m_data = m_local;
+		int m_top = 0;
+
+	public:
+		explicit TraversalStack(int height) {
+			if (height + 1 > LOCAL_SIZE) {
+				m_heap.resize(height + 1);
+				m_data = m_heap.data();
+			}
+		}
+
+		void push(const T& value) { m_data[m_top++] = value; }
+		T pop() { return m_data[--m_top]; }
+		bool empty() const { return m_top == 0; }
+	};
+}
+
+void MeshBVH::build(const float *positions, int vertex_count)
+{
+	clear();
+
+	int tri_count = vertex_count / 3;
+	if (tri_count == 0)
+		return;
+
+	m_positions.resize(tri_count * 3);
+	for (int i = 0; i < tri_count * 3; i++)
+		m_positions[i] = glm::vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]);
+
+	buildTree();
+}
+
+void MeshBVH::build(const glm::vec3 *positions, const uint32_t *corners, int vertex_count)
+{
+	clear();
+
+	int tri_count = vertex_count / 3;
+	if (tri_count == 0)
+		return;
+
+	m_positions.resize(tri_count * 3);
+	for (int i = 0; i < tri_count * 3; i++)
+		m_positions[i] = positions[corners[i]];
+
+	buildTree();
+}
+
+void MeshBVH::buildTree()
+{
+	int tri_count = (int)m_positions.size() / 3;
+
+	std::vector<glm::vec3> centroids(tri_count);
+	m_triIndex.resize(tri_count);
+	for (int i = 0; i < tri_count; i++) {
+		m_triIndex[i] = i;
+		centroids[i] = (m_positions[3 * i] + m_positions[3 * i + 1] + m_positions[3 * i + 2]) / 3.f;
+	}
+
+	m_nodes.reserve(tri_count * 2);
+	m_nodes.push_back(Node());
+	buildNode(0, 0, tri_count, 0, centroids);
+}
+
+void MeshBVH::clear()
+{
+	m_nodes.clear();
+	m_triIndex.clear();
+	m_positions.clear();
+	m_height = 0;
+}
+
+bool MeshBVH::isBuilt() const
+{
+	return !m_nodes.empty();
+}
+
+void MeshBVH::updatePositions(int first, int count, const float *positions, bool do_refit)
+{
+	if (first < 0 || first + count > (int)m_positions.size())
+		return;
+
+	for (int i = 0; i < count; i++)
+		m_positions[first + i] = glm::vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]);
+
+	if (do_refit)
+		refit();
+}
+
+void MeshBVH::refit()
+{
+	// leaves do not depend on each other.
+	parallelFor(0, (int)m_nodes.size(), [this](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			Node& node = m_nodes[i];
+			if (node.count == 0)
+				continue;
+
+			node.box = AABB();
+			for (int k = 0; k < node.count; k++)
+				node.box.expand(triangleBounds(m_triIndex[node.first + k]));
+		}
+	}, 4096);
+
+	// children are always stored after their parent.
+	for (int i = (int)m_nodes.size() - 1; i >= 0; i--) {
+		Node& node = m_nodes[i];
+
+		if (node.count == 0)
+			node.box = AABB::merge(m_nodes[node.first].box, m_nodes[node.first + 1].box);
+	}
+}
+
+bool MeshBVH::intersect(const Ray& ray, float tMax, Hit& hit) const
+{
+	if (m_nodes.empty())
+		return false;
+
+	bool result = false;
+	TraversalStack<int> stack(m_height);
+	stack.push(0);
+
+	while (!stack.empty()) {
+		const Node& node = m_nodes[stack.pop()];
+
+		float t_near;
+		if (!ray.intersect(node.box, tMax, &t_near))
+			continue;
+
+		if (node.count > 0) {
+			for (int k = 0; k < node.count; k++) {
+				int tri = m_triIndex[node.first + k];
+				const glm::vec3& p0 = m_positions[3 * tri];
+				glm::vec3 e1 = m_positions[3 * tri + 1] - p0;
+				glm::vec3 e2 = m_positions[3 * tri + 2] - p0;
+
+				// Moller-Trumbore, both faces
+				glm::vec3 pv = glm::cross(ray.dir, e2);
+				float det = glm::dot(e1, pv);
+				if (std::fabs(det) < 1e-12f)
+					continue;
+
+				float inv_det = 1.f / det;
+				glm::vec3 tv = ray.origin - p0;
+				float u = glm::dot(tv, pv) * inv_det;
+				if (u < 0.f || u > 1.f)
+					continue;
+
+				glm::vec3 qv = glm::cross(tv, e1);
+				float v = glm::dot(ray.dir, qv) * inv_det;
+				if (v < 0.f || u + v > 1.f)
+					continue;
+
+				float t = glm::dot(e2, qv) * inv_det;
+				if (t > 0.f && t < tMax) {
+					tMax = t;
+					hit.triangle = tri;
+					hit.t = t;
+					hit.u = u;
+					hit.v = v;
+					result = true;
+				}
+			}
+		}
+		else {
+			// nearer child is visited first.
+			int left = node.first;
+			int right = node.first + 1;
+			float t_left = FLT_MAX, t_right = FLT_MAX;
+			bool hit_left = ray.intersect(m_nodes[left].box, tMax, &t_left);
+			bool hit_right = ray.intersect(m_nodes[right].box, tMax, &t_right);
+
+			if (hit_left && hit_right) {
+				if (t_left < t_right)
+					std::swap(left, right);
+				stack.push(left);
+				stack.push(right);
+			}
+			else if (hit_left) {
+				stack.push(left);
+			}
+			else if (hit_right) {
+				stack.push(right);
+			}
+		}
+	}
+
+	return result;
+}
+
+AABB MeshBVH::getBounds() const
+{
+	return m_nodes.empty() ? AABB() : m_nodes[0].box;
+}
+
+int MeshBVH::getTriangleCount() const
+{
+	return (int)m_triIndex.size();
+}
+
+glm::vec3 MeshBVH::getVertex(int vertex) const
+{
+	return m_positions[vertex];
+}
+
+int MeshBVH::getNodeCount() const
+{
+	return (int)m_nodes.size();
+}
+
+AABB MeshBVH::triangleBounds(int triangle) const
+{
+	AABB box;
+	box.expand(m_positions[3 * triangle]);
+	box.expand(m_positions[3 * triangle + 1]);
+	box.expand(m_positions[3 * triangle + 2]);
+
+	return box;
+}
+
+void MeshBVH::buildNode(int node, int first, int count, int depth, std::vector<glm::vec3>& centroids)
+{
+	m_height = std::max(m_height, depth);
+
+	AABB box, centroid_box;
+	for (int k = 0; k < count; k++) {
+		int tri = m_triIndex[first + k];
+		box.expand(triangleBounds(tri));
+		centroid_box.expand(centroids[tri]);
+	}
+
+	m_nodes[node].box = box;
+	m_nodes[node].first = first;
+	m_nodes[node].count = count;
+
+	if (count <= MAX_LEAF_TRIANGLES)
+		return;
+
+	// longest axis of centroids
+	glm::vec3 extent = centroid_box.max - centroid_box.min;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	int *begin = &m_triIndex[first];
+	int *end = begin + count;
+	int *mid = nullptr;
+
+	if (extent[axis] > 0.f) {
+		// binned SAH
+		AABB bin_box[BIN_COUNT];
+		int bin_count[BIN_COUNT] = {};
+		float scale = BIN_COUNT / extent[axis];
+
+		auto binOf = [&](int tri) {
+			int b = (int)((centroids[tri][axis] - centroid_box.min[axis]) * scale);
+			return std::min(b, BIN_COUNT - 1);
+		};
+
+		for (int *it = begin; it != end; ++it) {
+			int b = binOf(*it);
+			bin_count[b]++;
+			bin_box[b].expand(triangleBounds(*it));
+		}
+
+		float right_area[BIN_COUNT];
+		int right_count[BIN_COUNT];
+		AABB acc;
+		int n = 0;
+		for (int b = BIN_COUNT - 1; b > 0; b--) {
+			acc.expand(bin_box[b]);
+			n += bin_count[b];
+			right_area[b] = acc.surfaceArea();
+			right_count[b] = n;
+		}
+
+		float best_cost = FLT_MAX;
+		int best_split = -1;
+		acc = AABB();
+		n = 0;
+		for (int b = 1; b < BIN_COUNT; b++) {
+			acc.expand(bin_box[b - 1]);
+			n += bin_count[b - 1];
+			float cost = acc.surfaceArea() * n + right_area[b] * right_count[b];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_split = b;
+			}
+		}
+
+		if (best_split > 0) {
+			mid = std::partition(begin, end, [&](int tri) { return binOf(tri) < best_split; });
+			if (mid == begin || mid == end)
+				mid = nullptr;
+		}
+	}
+
+	// degenerate split, median of the axis
+	if (!mid) {
+		mid = begin + count / 2;
+		std::nth_element(begin, mid, end, [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+	}
+
+	int left_count = (int)(mid - begin);
+	int left = (int)m_nodes.size();
+	m_nodes.push_back(Node());
+	m_nodes.push_back(Node());
+
+	m_nodes[node].first = left;
+	m_nodes[node].count = 0;
+
+	buildNode(left, first, left_count, depth + 1, centroids);
+	buildNode(left + 1, first + left_count, count - left_count, depth + 1, centroids);
+}
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Instance BVH															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+void InstanceBVH::insert(int instance, const AABB& box)
+{
+	if (instance < 0)
+		return;
+
+	if (instance >= (int)m_leafOf.size()) {
+		m_leafOf.resize(instance + 1, -1);
+		m_dirtyMark.resize(instance + 1, 0);
+	}
+
+	if (m_leafOf[instance] != -1) {
+		update(instance, box);
+		return;
+	}
+
+	int leaf = allocNode();
+	m_nodes[leaf].box = box;
+	m_nodes[leaf].instance = instance;
+	m_nodes[leaf].height = 0;
+	m_leafOf[instance] = leaf;
+	m_leafCount++;
+
+	insertLeaf(leaf);
+	m_levelsValid = false;
+	m_costValid = false;
+}
+
+void InstanceBVH::build(int count, const std::function<AABB(int instance)>& bounds)
+{
+	clear();
+	if (count <= 0)
+		return;
+
+	// leaf i is node i, internal nodes follow.
+	m_nodes.reserve(2 * (size_t)count);
+	m_nodes.resize(count);
+	m_leafOf.resize(count);
+	m_dirtyMark.assign(count, 0);
+
+	parallelFor(0, count, [this, &bounds](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			m_nodes[i].box = bounds(i);
+			m_nodes[i].instance = i;
+			m_leafOf[i] = i;
+		}
+	});
+	m_leafCount = count;
+
+	rebuild();
+}
+
+void InstanceBVH::remove(int instance)
+{
+	if (!contains(instance))
+		return;
+
+	int leaf = m_leafOf[instance];
+	removeLeaf(leaf);
+	freeNode(leaf);
+
+	m_leafOf[instance] = -1;
+	m_leafCount--;
+	m_levelsValid = false;
+	m_costValid = false;
+}
+
+void InstanceBVH::update(int instance, const AABB& box)
+{
+	if (!contains(instance))
+		return;
+
+	m_nodes[m_leafOf[instance]].box = box;
+
+	if (!m_dirtyMark[instance]) {
+		m_dirtyMark[instance] = 1;
+		m_dirtyLeaves.push_back(instance);
+	}
+}
+
+void InstanceBVH::clear()
+{
+	m_nodes.clear();
+	m_freeNodes.clear();
+	m_leafOf.clear();
+	m_dirtyLeaves.clear();
+	m_dirtyMark.clear();
+	m_levelNodes.clear();
+	m_levelOffsets.clear();
+	m_root = -1;
+	m_leafCount = 0;
+	m_levelsValid = false;
+	m_buildCost = 0.f;
+	m_costValid = false;
+}
+
+bool InstanceBVH::contains(int instance) const
+{
+	return instance >= 0 && instance < (int)m_leafOf.size() && m_leafOf[instance] != -1;
+}
+
+int InstanceBVH::size() const
+{
+	return m_leafCount;
+}
+
+void InstanceBVH::refit()
+{
+	if (m_dirtyLeaves.empty())
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// few moved leaves: walk up from each of them.
+	if ((int)m_dirtyLeaves.size() * 16 < m_leafCount) {
+		for (int instance : m_dirtyLeaves) {
+			int node = m_nodes[m_leafOf[instance]].parent;
+			while (node != -1) {
+				Node& n = m_nodes[node];
+				n.box = AABB::merge(m_nodes[n.child[0]].box, m_nodes[n.child[1]].box);
+				node = n.parent;
+			}
+		}
+
+		// quality is checked every 64 partial refits.
+		if (++m_refitCount % 64 == 0 || !m_costValid)
+			checkQuality();
+	}
+	// many moved leaves: refit every level, deepest first, in parallel.
+	else {
+		if (!m_levelsValid)
+			buildLevels();
+
+		for (int level = (int)m_levelOffsets.size() - 2; level >= 0; level--) {
+			parallelFor(m_levelOffsets[level], m_levelOffsets[level + 1], [this](int begin, int end) {
+				for (int i = begin; i < end; i++) {
+					Node& n = m_nodes[m_levelNodes[i]];
+					n.box = AABB::merge(m_nodes[n.child[0]].box, m_nodes[n.child[1]].box);
+				}
+			}, 2048);
+		}
+
+		checkQuality();
+	}
+
+	for (int instance : m_dirtyLeaves)
+		m_dirtyMark[instance] = 0;
+	m_dirtyLeaves.clear();
+
+	auto finish = std::chrono::high_resolution_clock::now();
+	m_lastRefitMs = std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+void InstanceBVH::rebuild()
+{
+	std::vector<int> leaves;
+	leaves.reserve(m_leafCount);
+
+	// internal nodes are released, leaves are kept.
+	m_freeNodes.clear();
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		if (m_nodes[i].instance == -1) {
+			m_nodes[i] = Node();
+			m_freeNodes.push_back(i);
+		}
+		else
+			leaves.push_back(i);
+	}
+
+	m_root = -1;
+	if (!leaves.empty()) {
+		std::vector<glm::vec3> centroids(m_nodes.size());
+		for (int leaf : leaves)
+			centroids[leaf] = m_nodes[leaf].box.center();
+
+		m_root = buildNode(leaves.data(), (int)leaves.size(), centroids);
+		m_nodes[m_root].parent = -1;
+	}
+
+	m_levelsValid = false;
+	m_buildCost = getCost();
+	m_costValid = true;
+	m_refitCount = 0;
+	m_rebuildCount++;
+}
+
+void InstanceBVH::setRebuildRatio(float ratio)
+{
+	m_rebuildRatio = ratio;
+}
+
+InstanceBVH::Hit InstanceBVH::raycast(const Ray& ray, const InstanceRaycast& raycast, float tMax) const
+{
+	Hit hit;
+	if (m_root == -1)
+		return hit;
+
+	struct Entry { int node; float t; };
+	TraversalStack<Entry> stack(m_nodes[m_root].height);
+	stack.push({ m_root, 0.f });
+
+	while (!stack.empty()) {
+		Entry entry = stack.pop();
+
+		if (entry.t >= tMax)
+			continue;
+
+		const Node& node = m_nodes[entry.node];
+		if (node.instance != -1) {
+			float t = raycast(node.instance, ray, tMax);
+			if (t >= 0.f && t < tMax) {
+				tMax = t;
+				hit.instance = node.instance;
+				hit.t = t;
+			}
+			continue;
+		}
+
+		Entry child[2];
+		bool hit_child[2];
+		for (int k = 0; k < 2; k++) {
+			child[k].node = node.child[k];
+			hit_child[k] = ray.intersect(m_nodes[node.child[k]].box, tMax, &child[k].t);
+		}
+
+		// nearer child is on top of the stack.
+		if (hit_child[0] && hit_child[1] && child[0].t < child[1].t)
+			std::swap(child[0], child[1]), std::swap(hit_child[0], hit_child[1]);
+		for (int k = 0; k < 2; k++) {
+			if (hit_child[k])
+				stack.push(child[k]);
+		}
+	}
+
+	return hit;
+}
+
+void InstanceBVH::query(const AABB& box, std::vector<int>& instances) const
+{
+	if (m_root == -1)
+		return;
+
+	TraversalStack<int> stack(m_nodes[m_root].height);
+	stack.push(m_root);
+
+	while (!stack.empty()) {
+		int index = stack.pop();
+
+		const Node& node = m_nodes[index];
+		if (!node.box.overlaps(box))
+			continue;
+
+		if (box.contains(node.box))
+			collectLeaves(index, instances);
+		else if (node.instance != -1)
+			instances.push_back(node.instance);
+		else {
+			stack.push(node.child[0]);
+			stack.push(node.child[1]);
+		}
+	}
+}
+
+void InstanceBVH::query(const Frustum& frustum, std::vector<int>& instances) const
+{
+	if (m_root == -1)
+		return;
+
+	TraversalStack<int> stack(m_nodes[m_root].height);
+	stack.push(m_root);
+
+	while (!stack.empty()) {
+		int index = stack.pop();
+
+		const Node& node = m_nodes[index];
+		Frustum::Result result = frustum.test(node.box);
+
+		if (result == Frustum::OUTSIDE)
+			continue;
+
+		if (result == Frustum::INSIDE)
+			collectLeaves(index, instances);
+		else if (node.instance != -1)
+			instances.push_back(node.instance);
+		else {
+			stack.push(node.child[0]);
+			stack.push(node.child[1]);
+		}
+	}
+}
+
+float InstanceBVH::getCost() const
+{
+	if (m_root == -1)
+		return 0.f;
+
+	float area = 0.f;
+	for (const Node& node : m_nodes) {
+		if (node.instance == -1 && node.child[0] != -1)
+			area += node.box.surfaceArea();
+	}
+
+	float root_area = m_nodes[m_root].box.surfaceArea();
+
+	return root_area > 0.f ? area / root_area : 0.f;
+}
+
+double InstanceBVH::getLastRefitTime() const
+{
+	return m_lastRefitMs;
+}
+
+int InstanceBVH::getRebuildCount() const
+{
+	return m_rebuildCount;
+}
+
+AABB InstanceBVH::getBounds() const
+{
+	return m_root == -1 ? AABB() : m_nodes[m_root].box;
+}
+
+void InstanceBVH::checkQuality()
+{
+	float cost = getCost();
+
+	// first refit after inserts or removes gives the reference cost.
+	if (!m_costValid) {
+		m_buildCost = cost;
+		m_costValid = true;
+	}
+	else if (cost > m_buildCost * m_rebuildRatio) {
+		rebuild();
+	}
+}
+
+int InstanceBVH::allocNode()
+{
+	if (!m_freeNodes.empty()) {
+		int node = m_freeNodes.back();
+		m_freeNodes.pop_back();
+		m_nodes[node] = Node();
+		return node;
+	}
+
+	m_nodes.push_back(Node());
+	return (int)m_nodes.size() - 1;
+}
+
+void InstanceBVH::freeNode(int node)
+{
+	m_nodes[node] = Node();
+	m_freeNodes.push_back(node);
+}
+
+void InstanceBVH::insertLeaf(int leaf)
+{
+	if (m_root == -1) {
+		m_root = leaf;
+		m_nodes[leaf].parent = -1;
+		return;
+	}
+
+	// find the best sibling by the increase of area (Box2D)
+	AABB leaf_box = m_nodes[leaf].box;
+	int index = m_root;
+
+	while (m_nodes[index].instance == -1) {
+		const Node& node = m_nodes[index];
+		float area = node.box.surfaceArea();
+		float combined = AABB::merge(node.box, leaf_box).surfaceArea();
+
+		float cost = 2.f * combined;
+		float inheritance = 2.f * (combined - area);
+
+		float child_cost[2];
+		for (int k = 0; k < 2; k++) {
+			const Node& child = m_nodes[node.child[k]];
+			float merged = AABB::merge(leaf_box, child.box).surfaceArea();
+			child_cost[k] = (child.instance != -1 ? merged : merged - child.box.surfaceArea()) + inheritance;
+		}
+
+		if (cost < child_cost[0] && cost < child_cost[1])
+			break;
+
+		index = child_cost[0] < child_cost[1] ? node.child[0] : node.child[1];
+	}
+
+	int sibling = index;
+	int old_parent = m_nodes[sibling].parent;
+	int new_parent = allocNode();
+
+	m_nodes[new_parent].parent = old_parent;
+	m_nodes[new_parent].box = AABB::merge(leaf_box, m_nodes[sibling].box);
+	m_nodes[new_parent].height = m_nodes[sibling].height + 1;
+	m_nodes[new_parent].child[0] = sibling;
+	m_nodes[new_parent].child[1] = leaf;
+
+	if (old_parent != -1) {
+		Node& p = m_nodes[old_parent];
+		p.child[p.child[0] == sibling ? 0 : 1] = new_parent;
+	}
+	else {
+		m_root = new_parent;
+	}
+
+	m_nodes[sibling].parent = new_parent;
+	m_nodes[leaf].parent = new_parent;
+
+	fixUpwards(new_parent);
+}
+
+void InstanceBVH::removeLeaf(int leaf)
+{
+	if (leaf == m_root) {
+		m_root = -1;
+		return;
+	}
+
+	int parent = m_nodes[leaf].parent;
+	int grand_parent = m_nodes[parent].parent;
+	int sibling = m_nodes[parent].child[0] == leaf ? m_nodes[parent].child[1] : m_nodes[parent].child[0];
+
+	if (grand_parent != -1) {
+		Node& g = m_nodes[grand_parent];
+		g.child[g.child[0] == parent ? 0 : 1] = sibling;
+		m_nodes[sibling].parent = grand_parent;
+		freeNode(parent);
+
+		fixUpwards(grand_parent);
+	}
+	else {
+		m_root = sibling;
+		m_nodes[sibling].parent = -1;
+		freeNode(parent);
+	}
+}
+
+int InstanceBVH::balance(int iA)
+{
+	Node& A = m_nodes[iA];
+	if (A.instance != -1 || A.height < 2)
+		return iA;
+
+	int iB = A.child[0];
+	int iC = A.child[1];
+	Node& B = m_nodes[iB];
+	Node& C = m_nodes[iC];
+
+	int diff = C.height - B.height;
+
+	// rotate C up
+	if (diff > 1) {
+		int iF = C.child[0];
+		int iG = C.child[1];
+		Node& F = m_nodes[iF];
+		Node& G = m_nodes[iG];
+
+		C.child[0] = iA;
+		C.parent = A.parent;
+		A.parent = iC;
+
+		if (C.parent != -1) {
+			Node& p = m_nodes[C.parent];
+			p.child[p.child[0] == iA ? 0 : 1] = iC;
+		}
+		else {
+			m_root = iC;
+		}
+
+		if (F.height > G.height) {
+			C.child[1] = iF;
+			A.child[1] = iG;
+			G.parent = iA;
+			A.box = AABB::merge(B.box, G.box);
+			C.box = AABB::merge(A.box, F.box);
+			A.height = 1 + std::max(B.height, G.height);
+			C.height = 1 + std::max(A.height, F.height);
+		}
+		else {
+			C.child[1] = iG;
+			A.child[1] = iF;
+			F.parent = iA;
+			A.box = AABB::merge(B.box, F.box);
+			C.box = AABB::merge(A.box, G.box);
+			A.height = 1 + std::max(B.height, F.height);
+			C.height = 1 + std::max(A.height, G.height);
+		}
+
+		return iC;
+	}
+
+	// rotate B up
+	if (diff < -1) {
+		int iD = B.child[0];
+		int iE = B.child[1];
+		Node& D = m_nodes[iD];
+		Node& E = m_nodes[iE];
+
+		B.child[0] = iA;
+		B.parent = A.parent;
+		A.parent = iB;
+
+		if (B.parent != -1) {
+			Node& p = m_nodes[B.parent];
+			p.child[p.child[0] == iA ? 0 : 1] = iB;
+		}
+		else {
+			m_root = iB;
+		}
+
+		if (D.height > E.height) {
+			B.child[1] = iD;
+			A.child[0] = iE;
+			E.parent = iA;
+			A.box = AABB::merge(C.box, E.box);
+			B.box = AABB::merge(A.box, D.box);
+			A.height = 1 + std::max(C.height, E.height);
+			B.height = 1 + std::max(A.height, D.height);
+		}
+		else {
+			B.child[1] = iE;
+			A.child[0] = iD;
+			D.parent = iA;
+			A.box = AABB::merge(C.box, D.box);
+			B.box = AABB::merge(A.box, E.box);
+			A.height = 1 + std::max(C.height, D.height);
+			B.height = 1 + std::max(A.height, E.height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+void InstanceBVH::fixUpwards(int node)
+{
+	while (node != -1) {
+		node = balance(node);
+
+		Node& n = m_nodes[node];
+		const Node& c0 = m_nodes[n.child[0]];
+		const Node& c1 = m_nodes[n.child[1]];
+		n.height = 1 + std::max(c0.height, c1.height);
+		n.box = AABB::merge(c0.box, c1.box);
+
+		node = n.parent;
+	}
+}
+
+void InstanceBVH::buildLevels()
+{
+	m_levelNodes.clear();
+	m_levelOffsets.clear();
+
+	if (m_root != -1 && m_nodes[m_root].instance == -1) {
+		// breadth first, internal nodes only
+		m_levelNodes.push_back(m_root);
+		size_t begin = 0;
+
+		while (begin < m_levelNodes.size()) {
+			size_t end = m_levelNodes.size();
+			m_levelOffsets.push_back((int)begin);
+
+			for (size_t i = begin; i < end; i++) {
+				const Node& n = m_nodes[m_levelNodes[i]];
+				for (int child : n.child) {
+					if (m_nodes[child].instance == -1)
+						m_levelNodes.push_back(child);
+				}
+			}
+			begin = end;
+		}
+	}
+	m_levelOffsets.push_back((int)m_levelNodes.size());
+
+	m_levelsValid = true;
+}
+
+int InstanceBVH::buildNode(int *leaves, int count, std::vector<glm::vec3>& centroids)
+{
+	if (count == 1)
+		return leaves[0];
+
+	AABB box, centroid_box;
+	for (int i = 0; i < count; i++) {
+		box.expand(m_nodes[leaves[i]].box);
+		centroid_box.expand(centroids[leaves[i]]);
+	}
+
+	glm::vec3 extent = centroid_box.max - centroid_box.min;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	int *mid = nullptr;
+
+	if (extent[axis] > 0.f) {
+		// binned SAH
+		AABB bin_box[BIN_COUNT];
+		int bin_count[BIN_COUNT] = {};
+		float scale = BIN_COUNT / extent[axis];
+
+		auto binOf = [&](int leaf) {
+			int b = (int)((centroids[leaf][axis] - centroid_box.min[axis]) * scale);
+			return std::min(b, BIN_COUNT - 1);
+		};
+
+		for (int i = 0; i < count; i++) {
+			int b = binOf(leaves[i]);
+			bin_count[b]++;
+			bin_box[b].expand(m_nodes[leaves[i]].box);
+		}
+
+		float right_area[BIN_COUNT];
+		int right_count[BIN_COUNT];
+		AABB acc;
+		int n = 0;
+		for (int b = BIN_COUNT - 1; b > 0; b--) {
+			acc.expand(bin_box[b]);
+			n += bin_count[b];
+			right_area[b] = acc.surfaceArea();
+			right_count[b] = n;
+		}
+
+		float best_cost = FLT_MAX;
+		int best_split = -1;
+		acc = AABB();
+		n = 0;
+		for (int b = 1; b < BIN_COUNT; b++) {
+			acc.expand(bin_box[b - 1]);
+			n += bin_count[b - 1];
+			float cost = acc.surfaceArea() * n + right_area[b] * right_count[b];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_split = b;
+			}
+		}
+
+		if (best_split > 0) {
+			mid = std::partition(leaves, leaves + count, [&](int leaf) { return binOf(leaf) < best_split; });
+			if (mid == leaves || mid == leaves + count)
+				mid = nullptr;
+		}
+	}
+
+	if (!mid) {
+		mid = leaves + count / 2;
+		std::nth_element(leaves, mid, leaves + count, [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+	}
+
+	int left_count = (int)(mid - leaves);
+	int left = buildNode(leaves, left_count, centroids);
+	int right = buildNode(mid, count - left_count, centroids);
+
+	int node = allocNode();
+	Node& n = m_nodes[node];
+	n.box = box;
+	n.child[0] = left;
+	n.child[1] = right;
+	n.height = 1 + std::max(m_nodes[left].height, m_nodes[right].height);
+	m_nodes[left].parent = node;
+	m_nodes[right].parent = node;
+
+	return node;
+}
+
+void InstanceBVH::collectLeaves(int node, std::vector<int>& instances) const
+{
+	TraversalStack<int> stack(m_nodes[node].height);
+	stack.push(node);
+
+	while (!stack.empty()) {
+		const Node& n = m_nodes[stack.pop()];
+
+		if (n.instance != -1)
+			instances.push_back(n.instance);
+		else {
+			stack.push(n.child[0]);
+			stack.push(n.child[1]);
+		}
+	}
+}
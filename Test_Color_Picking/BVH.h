@@ -0,0 +1,255 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cfloat>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/************************************************************/
+/*															*/
+// Bounding Volumes
+/*															*/
+/************************************************************/
+
+struct AABB
+{
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	AABB() = default;
+	AABB(const glm::vec3& min, const glm::vec3& max);
+
+	bool isValid() const;
+	void expand(const glm::vec3& point);
+	void expand(const AABB& box);
+	glm::vec3 center() const;
+	float surfaceArea() const;
+	bool overlaps(const AABB& box) const;
+	bool contains(const AABB& box) const;
+	/*
+		return: bounds of this box transformed by matrix.
+	*/
+	AABB transform(const glm::mat4& matrix) const;
+
+	static AABB merge(const AABB& a, const AABB& b);
+};
+
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 dir;
+	glm::vec3 invDir;
+
+	Ray() = default;
+	Ray(const glm::vec3& origin, const glm::vec3& dir);
+
+	/*
+		return: ray in the space of inverse_matrix. dir is not normalized,
+		so t values stay comparable with the original ray.
+	*/
+	Ray transform(const glm::mat4& inverse_matrix) const;
+	/*
+		tNear:
+		entering t, it is valid only if the function returns true.
+	*/
+	bool intersect(const AABB& box, float tMax, float *tNear = nullptr) const;
+};
+
+struct Frustum
+{
+	// inside: dot(plane.xyz, p) + plane.w >= 0
+	glm::vec4 planes[6];
+
+	Frustum() = default;
+	explicit Frustum(const glm::mat4& view_proj);
+
+	enum Result { OUTSIDE, INTERSECT, INSIDE };
+	Result test(const AABB& box) const;
+	bool test(const glm::vec3& center, float radius) const;
+};
+
+/************************************************************/
+/*															*/
+// Mesh BVH (bottom level)
+/*															*/
+/************************************************************/
+
+/*
+	bvh over the triangles of one mesh, in object space.
+	triangles are not indexed: vertex 3i, 3i+1, 3i+2 is triangle i.
+*/
+class MeshBVH
+{
+	struct Node {
+		AABB box;
+		int first;	// leaf: first index of m_triIndex, internal: left child (right is first + 1)
+		int count;	// leaf: triangle count, internal: 0
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<int> m_triIndex;
+	std::vector<glm::vec3> m_positions;
+	int m_height = 0;		// edges from the root to the deepest leaf
+
+public:
+	struct Hit {
+		int triangle = -1;
+		float t = FLT_MAX;
+		float u = 0.f, v = 0.f;	// barycentric of vertex 1 and 2
+	};
+
+	MeshBVH() = default;
+	~MeshBVH() = default;
+	MeshBVH(const MeshBVH&) = default;
+	MeshBVH& operator=(const MeshBVH&) = default;
+	MeshBVH(MeshBVH&&) = default;
+	MeshBVH& operator=(MeshBVH&&) = default;
+
+	/*
+		positions:
+		x, y, z of vertex_count vertices.
+	*/
+	void build(const float *positions, int vertex_count);
+	/*
+		indexed source: vertex i is positions[corners[i]].
+	*/
+	void build(const glm::vec3 *positions, const uint32_t *corners, int vertex_count);
+	void clear();
+	bool isBuilt() const;
+
+	/*
+		updates vertices [first, first + count) and refits the tree.
+		do_refit:
+		false to refit once after many updates.
+	*/
+	void updatePositions(int first, int count, const float *positions, bool do_refit = true);
+	/*
+		leaves are refitted in parallel, then internal nodes bottom up.
+	*/
+	void refit();
+
+	bool intersect(const Ray& ray, float tMax, Hit& hit) const;
+
+	AABB getBounds() const;
+	int getTriangleCount() const;
+	int getNodeCount() const;
+	/*
+		vertex: triangle * 3 + corner.
+	*/
+	glm::vec3 getVertex(int vertex) const;
+
+private:
+	AABB triangleBounds(int triangle) const;
+	void buildTree();
+	void buildNode(int node, int first, int count, int depth, std::vector<glm::vec3>& centroids);
+};
+
+/************************************************************/
+/*															*/
+// Instance BVH (top level)
+/*															*/
+/************************************************************/
+
+/*
+	dynamic bvh over object instances.
+	insert() and remove() are O(log n) with tree rotations,
+	moved instances are refitted bottom up (in parallel for large updates),
+	and the tree is rebuilt with SAH only when its quality degrades.
+*/
+class InstanceBVH
+{
+	struct Node {
+		AABB box;
+		int parent = -1;
+		int child[2] = { -1, -1 };
+		int instance = -1;	// -1 for internal node
+		int height = 0;
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<int> m_freeNodes;
+	std::vector<int> m_leafOf;		// instance -> leaf node
+	std::vector<int> m_dirtyLeaves;
+	std::vector<char> m_dirtyMark;
+	int m_root = -1;
+	int m_leafCount = 0;
+
+	// internal nodes ordered by depth for parallel refit
+	std::vector<int> m_levelNodes;
+	std::vector<int> m_levelOffsets;
+	bool m_levelsValid = false;
+
+	float m_buildCost = 0.f;
+	bool m_costValid = false;
+	float m_rebuildRatio = 1.5f;
+	int m_refitCount = 0;
+
+	// statistics
+	double m_lastRefitMs = 0.0;
+	int m_rebuildCount = 0;
+
+public:
+	struct Hit {
+		int instance = -1;
+		float t = FLT_MAX;
+	};
+
+	/*
+		return: t of the nearest hit of instance, or a negative value if missed.
+	*/
+	using InstanceRaycast = std::function<float(int instance, const Ray& ray, float tMax)>;
+
+	InstanceBVH() = default;
+	~InstanceBVH() = default;
+
+	void insert(int instance, const AABB& box);
+	/*
+		replaces the tree with instances 0 ~ count - 1, bounds(instance) is
+		called from several threads. much faster than count inserts.
+	*/
+	void build(int count, const std::function<AABB(int instance)>& bounds);
+	void remove(int instance);
+	/*
+		moves the leaf of instance. tree is updated by refit().
+	*/
+	void update(int instance, const AABB& box);
+	void clear();
+	bool contains(int instance) const;
+	int size() const;
+
+	/*
+		refits moved leaves and rebuilds the tree when
+		cost > build cost * rebuild ratio.
+	*/
+	void refit();
+	void rebuild();
+	void setRebuildRatio(float ratio);
+
+	/*
+		raycast:
+		called for each instance whose bounds are hit, nearest first.
+	*/
+	Hit raycast(const Ray& ray, const InstanceRaycast& raycast, float tMax = FLT_MAX) const;
+	void query(const AABB& box, std::vector<int>& instances) const;
+	void query(const Frustum& frustum, std::vector<int>& instances) const;
+
+	/*
+		return: sum of internal node areas / root area (SAH cost without constants).
+	*/
+	float getCost() const;
+	double getLastRefitTime() const;
+	int getRebuildCount() const;
+	AABB getBounds() const;
+
+private:
+	int allocNode();
+	void freeNode(int node);
+	void insertLeaf(int leaf);
+	void removeLeaf(int leaf);
+	int balance(int node);
+	void fixUpwards(int node);
+	void checkQuality();
+	void buildLevels();
+	int buildNode(int *leaves, int count, std::vector<glm::vec3>& centroids);
+	void collectLeaves(int node, std::vector<int>& instances) const;
+};
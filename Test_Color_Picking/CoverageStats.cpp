@@ -0,0 +1,182 @@
+#include "CoverageStats.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Coverage Stats														  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+CoverageStats::~CoverageStats()
+{
+	if (isCreated())
+		destroy();
+}
+
+bool CoverageStats::create(const char *comp_file)
+{
+	if (!m_shader.loadCompute(comp_file))
+		return false;
+
+	m_timer.create();
+
+	return true;
+}
+
+void CoverageStats::destroy()
+{
+	if (m_fence)
+		glDeleteSync(m_fence);
+	m_fence = nullptr;
+
+	m_timer.destroy();
+
+	m_shader.unload();
+	m_counts.destroy();
+	m_bounds.destroy();
+	m_pixelCounts.clear();
+	m_pixelBounds.clear();
+}
+
+bool CoverageStats::isCreated() const
+{
+	return m_shader.isLoaded();
+}
+
+void CoverageStats::setInterval(int frames)
+{
+	m_interval = frames < 1 ? 1 : frames;
+}
+
+int CoverageStats::getInterval() const
+{
+	return m_interval;
+}
+
+bool CoverageStats::update(const FBO& fbo, uint32_t id_count)
+{
+	if (m_frame++ % m_interval != 0 || isPending() || id_count == 0)
+		return false;
+
+	// buffers only grow.
+	if (m_counts.getSize() < sizeof(uint32_t) * id_count) {
+		m_counts.destroy();
+		m_bounds.destroy();
+		m_counts.create(sizeof(uint32_t) * id_count, nullptr, GL_DYNAMIC_READ);
+		m_bounds.create(sizeof(glm::uvec4) * id_count, nullptr, GL_DYNAMIC_READ);
+	}
+
+	// count = 0, bounds = empty (min = max uint, max = 0)
+	const GLuint empty[4] = { 0xffffffffu, 0xffffffffu, 0u, 0u };
+	m_counts.clear();
+	m_bounds.bind(GL_SHADER_STORAGE_BUFFER);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_RGBA32UI, GL_RGBA_INTEGER, GL_UNSIGNED_INT, empty);
+	Buffer::unbind(GL_SHADER_STORAGE_BUFFER);
+
+	m_shader.use();
+	glUniform1ui(SL_id_count, id_count);
+	m_counts.bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+	m_bounds.bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, fbo.getColorTex());
+
+	m_timer.begin();
+	glDispatchCompute(
+		(GLuint)((fbo.getWidth() + SPAN * GROUP_SIZE - 1) / (SPAN * GROUP_SIZE)),
+		(GLuint)((fbo.getHeight() + GROUP_SIZE - 1) / GROUP_SIZE), 1);
+	m_timer.end();
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	Shader::unuse();
+
+	// the readback in poll() sees the storage writes.
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	m_pendingIdCount = id_count;
+	m_width = fbo.getWidth();
+	m_height = fbo.getHeight();
+
+	return true;
+}
+
+bool CoverageStats::poll()
+{
+	if (!m_fence)
+		return false;
+
+	GLenum state = glClientWaitSync(m_fence, 0, 0);
+	if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+		return false;
+
+	glDeleteSync(m_fence);
+	m_fence = nullptr;
+
+	m_pixelCounts.resize(m_pendingIdCount);
+	m_pixelBounds.resize(m_pendingIdCount);
+	m_counts.read(0, sizeof(uint32_t) * m_pendingIdCount, m_pixelCounts.data());
+	m_bounds.read(0, sizeof(glm::uvec4) * m_pendingIdCount, m_pixelBounds.data());
+
+	m_timer.poll();
+	m_updateCount++;
+
+	return true;
+}
+
+bool CoverageStats::isPending() const
+{
+	return m_fence != nullptr;
+}
+
+uint32_t CoverageStats::getPixelCount(uint32_t id) const
+{
+	return id < m_pixelCounts.size() ? m_pixelCounts[id] : 0;
+}
+
+float CoverageStats::getCoverage(uint32_t id) const
+{
+	if (m_width == 0 || m_height == 0)
+		return 0.f;
+
+	return (float)getPixelCount(id) / ((float)m_width * (float)m_height);
+}
+
+glm::uvec4 CoverageStats::getBounds(uint32_t id) const
+{
+	return isVisible(id) ? m_pixelBounds[id] : glm::uvec4(0);
+}
+
+bool CoverageStats::isVisible(uint32_t id) const
+{
+	return getPixelCount(id) != 0;
+}
+
+uint32_t CoverageStats::countVisible() const
+{
+	uint32_t count = 0;
+	for (uint32_t pixels : m_pixelCounts)
+		if (pixels != 0)
+			count++;
+
+	return count;
+}
+
+uint32_t CoverageStats::countBelow(uint32_t pixels) const
+{
+	uint32_t count = 0;
+	for (uint32_t value : m_pixelCounts)
+		if (value != 0 && value < pixels)
+			count++;
+
+	return count;
+}
+
+uint64_t CoverageStats::getUpdateCount() const
+{
+	return m_updateCount;
+}
+
+double CoverageStats::getGpuTime() const
+{
+	return m_timer.getLast();
+}
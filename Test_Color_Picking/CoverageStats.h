@@ -0,0 +1,100 @@
+#pragma once
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "GLObject.h"
+
+/************************************************************/
+/*															*/
+// Coverage Stats
+/*															*/
+/************************************************************/
+
+/*
+	per id pixel count and screen bounding rectangle of the id buffer.
+	a compute pass accumulates them with atomics into storage buffers,
+	and the result is read back after a fence, so update() never stalls.
+
+	bounds:
+	(min x, min y, max x, max y) in pixels of the id buffer, inclusive.
+*/
+class CoverageStats
+{
+	enum ShaderLocation {
+		SL_id_count,
+	};
+
+	static constexpr int GROUP_SIZE = 8;
+	static constexpr int SPAN = 16;
+
+	Shader m_shader;
+	Buffer m_counts;
+	Buffer m_bounds;
+	GpuTimer m_timer;
+	GLsync m_fence = nullptr;
+
+	int m_interval = 1;
+	uint64_t m_frame = 0;
+	uint32_t m_pendingIdCount = 0;
+	int m_width = 0;
+	int m_height = 0;
+
+	// last finished result
+	std::vector<uint32_t> m_pixelCounts;
+	std::vector<glm::uvec4> m_pixelBounds;
+	uint64_t m_updateCount = 0;
+
+public:
+	CoverageStats() = default;
+	~CoverageStats();
+
+	/*
+		comp_file: coverage.comp
+	*/
+	bool create(const char *comp_file);
+	void destroy();
+	bool isCreated() const;
+
+	/*
+		frames:
+		update() starts a pass every frames calls.
+	*/
+	void setInterval(int frames);
+	int getInterval() const;
+
+	/*
+		call once per frame after the id pass.
+		id_count: ids 1 ~ id_count - 1 are counted.
+		return: true if a pass was started.
+	*/
+	bool update(const FBO& fbo, uint32_t id_count);
+	/*
+		return: true if a new result has arrived.
+	*/
+	bool poll();
+	bool isPending() const;
+
+	/*
+		values of the last finished pass. ids out of range are not visible.
+	*/
+	uint32_t getPixelCount(uint32_t id) const;
+	float getCoverage(uint32_t id) const;
+	glm::uvec4 getBounds(uint32_t id) const;
+	bool isVisible(uint32_t id) const;
+
+	/*
+		return: number of visible ids.
+	*/
+	uint32_t countVisible() const;
+	/*
+		return: number of visible ids with fewer than pixels pixels.
+	*/
+	uint32_t countBelow(uint32_t pixels) const;
+
+	uint64_t getUpdateCount() const;
+	/*
+		return: gpu time of the last finished pass in ms.
+	*/
+	double getGpuTime() const;
+};
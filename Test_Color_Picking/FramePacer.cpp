@@ -0,0 +1,157 @@
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+#include "FramePacer.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Frame Pacer															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+FramePacer::FramePacer(double target_fps)
+{
+	setTargetFps(target_fps);
+
+	m_start = Clock::now();
+	m_next = m_start;
+	m_cpuStart = processCpuTime();
+}
+
+void FramePacer::setTargetFps(double target_fps)
+{
+	m_period = target_fps > 0.0 ? 1.0 / target_fps : 0.0;
+}
+
+double FramePacer::getTargetFps() const
+{
+	return m_period > 0.0 ? 1.0 / m_period : 0.0;
+}
+
+double FramePacer::timeUntilNextFrame() const
+{
+	double remain = std::chrono::duration<double>(m_next - Clock::now()).count();
+
+	return remain > 0.0 ? remain : 0.0;
+}
+
+void FramePacer::waitForFrame()
+{
+	if (m_period <= 0.0)
+		return;
+
+	// coarse sleep, then spin for the last part.
+	double remain = timeUntilNextFrame();
+	if (remain > m_spinMargin)
+		std::this_thread::sleep_for(std::chrono::duration<double>(remain - m_spinMargin));
+
+	while (Clock::now() < m_next)
+		std::this_thread::yield();
+}
+
+void FramePacer::endFrame()
+{
+	Clock::time_point now = Clock::now();
+
+	if (m_hasFrame) {
+		double interval = std::chrono::duration<double, std::milli>(now - m_lastFrame).count();
+
+		// idle gaps between bursts of redraws are not pacing errors.
+		if (m_period <= 0.0 || interval < m_period * 1000.0 * 4.0) {
+			m_intervalSum += interval;
+			m_intervalSqSum += interval * interval;
+			if (interval > m_intervalMax)
+				m_intervalMax = interval;
+			m_intervalCount++;
+		}
+	}
+
+	m_lastFrame = now;
+	m_hasFrame = true;
+	m_frameCount++;
+
+	// next slot on the fixed grid. after an idle gap the grid restarts from now.
+	auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_period));
+	m_next += period;
+	if (m_next < now)
+		m_next = now + period;
+}
+
+void FramePacer::countWake()
+{
+	m_wakeCount++;
+}
+
+uint64_t FramePacer::getFrameCount() const
+{
+	return m_frameCount;
+}
+
+uint64_t FramePacer::getWakeCount() const
+{
+	return m_wakeCount;
+}
+
+double FramePacer::getIntervalMean() const
+{
+	return m_intervalCount ? m_intervalSum / m_intervalCount : 0.0;
+}
+
+double FramePacer::getIntervalJitter() const
+{
+	if (m_intervalCount < 2)
+		return 0.0;
+
+	double mean = getIntervalMean();
+	double variance = m_intervalSqSum / m_intervalCount - mean * mean;
+
+	return variance > 0.0 ? std::sqrt(variance) : 0.0;
+}
+
+double FramePacer::getIntervalMax() const
+{
+	return m_intervalMax;
+}
+
+double FramePacer::getCpuUsage() const
+{
+	double wall = std::chrono::duration<double>(Clock::now() - m_start).count();
+
+	return wall > 0.0 ? (processCpuTime() - m_cpuStart) / wall : 0.0;
+}
+
+void FramePacer::printStats() const
+{
+	printf("frames: %llu rendered, %llu wake ups\n",
+		(unsigned long long)m_frameCount, (unsigned long long)m_wakeCount);
+	printf("frame interval: mean %.2f ms, jitter %.2f ms, max %.2f ms (target %.1f fps)\n",
+		getIntervalMean(), getIntervalJitter(), getIntervalMax(), getTargetFps());
+	printf("cpu usage: %.1f%% of one core\n", getCpuUsage() * 100.0);
+}
+
+double FramePacer::processCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return 0.0;
+
+	auto toSeconds = [](const FILETIME& t) {
+		ULARGE_INTEGER value;
+		value.LowPart = t.dwLowDateTime;
+		value.HighPart = t.dwHighDateTime;
+		return (double)value.QuadPart * 1e-7;
+	};
+
+	return toSeconds(kernel) + toSeconds(user);
+#else
+	return (double)std::clock() / CLOCKS_PER_SEC;
+#endif
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+/************************************************************/
+/*															*/
+// Frame Pacer
+/*															*/
+/************************************************************/
+
+/*
+	holds a target frame rate.
+	frame slots are fixed (start + n * period), so a late frame does not
+	shift the following frames. waiting sleeps coarsely and spins only for
+	the last spin_margin seconds, which keeps jitter low without a busy loop.
+*/
+class FramePacer
+{
+	using Clock = std::chrono::steady_clock;
+
+	double m_period;
+	double m_spinMargin = 0.002;
+	Clock::time_point m_next;
+	Clock::time_point m_lastFrame;
+	Clock::time_point m_start;
+	bool m_hasFrame = false;
+
+	// statistics
+	uint64_t m_frameCount = 0;
+	uint64_t m_wakeCount = 0;
+	double m_intervalSum = 0.0;
+	double m_intervalSqSum = 0.0;
+	double m_intervalMax = 0.0;
+	uint64_t m_intervalCount = 0;
+	double m_cpuStart = 0.0;
+
+public:
+	/*
+		target_fps:
+		0 means no limit.
+	*/
+	explicit FramePacer(double target_fps = 60.0);
+	~FramePacer() = default;
+
+	void setTargetFps(double target_fps);
+	double getTargetFps() const;
+
+	/*
+		return: seconds until the next frame slot (0 if it already started).
+	*/
+	double timeUntilNextFrame() const;
+	/*
+		sleeps until the next frame slot.
+	*/
+	void waitForFrame();
+	/*
+		call after the frame was presented.
+	*/
+	void endFrame();
+	/*
+		counts a wake up of the main loop (rendered or not).
+	*/
+	void countWake();
+
+	uint64_t getFrameCount() const;
+	uint64_t getWakeCount() const;
+	/*
+		return: mean, standard deviation and max of frame intervals in ms.
+	*/
+	double getIntervalMean() const;
+	double getIntervalJitter() const;
+	double getIntervalMax() const;
+	/*
+		return: process cpu time / wall time since creation (1.0 = one core).
+	*/
+	double getCpuUsage() const;
+	void printStats() const;
+
+private:
+	static double processCpuTime();
+};
@@ -1,8 +1,14 @@
 #include <gl/glew.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 #include "GLObject.h"
+#include "Memory.h"
+#include "VertexLayout.h"
 
 int printAllErrors(const char * caption /*= nullptr*/)
 {
@@ -37,6 +43,309 @@ const char * getGLErrorStr(GLenum err)
 	}
 }
 
+namespace {
+	// window of the streaming obj import, also the longest allowed line.
+	constexpr size_t OBJ_WINDOW = 1 << 20;
+
+	/*
+		calls fn(line) for each line of fin (without the line break), reading
+		window.size() bytes at a time.
+		return: false if a line does not fit in the window or fn returns false.
+	*/
+	template <typename Window, typename Fn>
+	bool forEachLine(FILE *fin, Window& window, Fn fn)
+	{
+		size_t kept = 0;
+
+		for (;;) {
+			size_t capacity = window.size() - 1 - kept;
+			size_t read = fread(window.data() + kept, 1, capacity, fin);
+			char *begin = window.data();
+			char *end = begin + kept + read;
+
+			for (;;) {
+				char *line_end = (char*)memchr(begin, '\n', end - begin);
+				if (!line_end)
+					break;
+				*line_end = '\0';
+				if (!fn(begin))
+					return false;
+				begin = line_end + 1;
+			}
+
+			kept = end - begin;
+
+			if (read < capacity) {
+				// last line without a line break
+				if (kept > 0) {
+					begin[kept] = '\0';
+					return fn(begin);
+				}
+				return true;
+			}
+			if (kept == window.size() - 1)
+				return false;
+
+			memmove(window.data(), begin, kept);
+		}
+	}
+
+	const char* skipSpace(const char *p)
+	{
+		while (*p == ' ' || *p == '\t' || *p == '\r')
+			p++;
+		return p;
+	}
+
+	/*
+		return: 1 v, 2 vt, 3 vn, 4 f, 5 o, 6 g, 7 usemtl, 0 others.
+		p points after the command.
+	*/
+	int objCommand(const char *& p)
+	{
+		p = skipSpace(p);
+		if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) { p += 1; return 1; }
+		if (p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) { p += 2; return 2; }
+		if (p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) { p += 2; return 3; }
+		if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) { p += 1; return 4; }
+		if (p[0] == 'o' && (p[1] == ' ' || p[1] == '\t')) { p += 1; return 5; }
+		if (p[0] == 'g' && (p[1] == ' ' || p[1] == '\t')) { p += 1; return 6; }
+		if (strncmp(p, "usemtl", 6) == 0 && (p[6] == ' ' || p[6] == '\t')) { p += 6; return 7; }
+		return 0;
+	}
+
+	/*
+		one face corner "v", "v/t", "v//n" or "v/t/n".
+		indices are resolved to 0 based, -1 if missing.
+		return: false at the end of the line.
+	*/
+	bool parseCorner(const char *& p, int v_count, int t_count, int n_count, int corner[3])
+	{
+		p = skipSpace(p);
+		if (*p == '\0')
+			return false;
+
+		const int counts[3] = { v_count, t_count, n_count };
+		for (int k = 0; k < 3; k++) {
+			corner[k] = -1;
+
+			if (k > 0) {
+				if (*p != '/')
+					continue;
+				p++;
+			}
+
+			char *end;
+			long index = strtol(p, &end, 10);
+			if (end != p)
+				corner[k] = index > 0 ? (int)index - 1 : counts[k] + (int)index;
+			p = end;
+		}
+
+		while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r')
+			p++;
+
+		return true;
+	}
+
+	// components of v, vn and vt in the file
+	constexpr int OBJ_SOURCE_SIZE[VS_COUNT] = { 3, 3, 2 };
+
+	/*
+		return: elements of a face line (after "f"), VS_TEXCOORD and VS_NORMAL bits.
+		the first corner decides, the corners of a face have the same form.
+	*/
+	int objFaceElements(const char *p)
+	{
+		int elements = 0;
+
+		p = skipSpace(p);
+		p += strcspn(p, "/ \t\r");
+		if (*p == '/') {
+			p++;
+			if (*p != '/' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\0')
+				elements |= 1 << VS_TEXCOORD;
+			p += strcspn(p, "/ \t\r");
+			if (*p == '/')
+				elements |= 1 << VS_NORMAL;
+		}
+
+		return elements;
+	}
+
+	/*
+		one corner "v", "v/t", "v//n" or "v/t/n", read into the sources of Layout.
+		index: 0 based index of each source, -1 if the corner does not have it
+		or the layout does not use it.
+		return: false if the corner is malformed.
+	*/
+	template <typename Layout>
+	bool parseLayoutCorner(const char *& p, int index[VS_COUNT])
+	{
+		char *end;
+
+		p = skipSpace(p);
+		index[VS_POSITION] = (int)strtol(p, &end, 10) - 1;
+		index[VS_TEXCOORD] = -1;
+		index[VS_NORMAL] = -1;
+		if (end == p)
+			return false;
+		p = end;
+
+		const VertexSource optional[2] = { VS_TEXCOORD, VS_NORMAL };
+		for (VertexSource source : optional) {
+			if (*p != '/')
+				break;
+			p++;
+
+			int value = (int)strtol(p, &end, 10) - 1;
+			if (end != p && Layout::has(source))
+				index[source] = value;
+			p = end;
+		}
+
+		return *p == ' ' || *p == '\t' || *p == '\r' || *p == '\0';
+	}
+
+	/*
+		reads the obj with Layout: the v, vn, vt of the layout into sources and
+		the triangles into vertices (vertex_count vertices, a section per attribute).
+		a corner without a texcoord of the layout gets (0, 0), a corner without
+		a normal gets the face normal. begin_part(name, first) is called at o, g and usemtl.
+		return: false on a malformed face or an invalid index.
+	*/
+	template <typename Layout, typename Window, typename BeginPart>
+	bool readObjVertices(FILE *fin, Window& window, ScratchVector<float> (&sources)[VS_COUNT],
+		char *vertices, size_t vertex_count, BeginPart begin_part)
+	{
+		char *sections[VS_COUNT] = {};
+		Layout::forEach([&](auto attribute) {
+			using A = decltype(attribute);
+			static_assert(A::SIZE <= OBJ_SOURCE_SIZE[A::SOURCE], "more components than the obj element");
+			sections[A::SOURCE] = vertices + Layout::getSectionOffset(A::SOURCE, vertex_count);
+		});
+
+		size_t vertex = 0;
+		std::string object, material;
+
+		bool ok = forEachLine(fin, window, [&](const char *line) {
+			const char *p = line;
+			char *end;
+			int cmd = objCommand(p);
+
+			switch (cmd) {
+			case 1:
+			case 2:
+			case 3: {
+				VertexSource source = cmd == 1 ? VS_POSITION : (cmd == 3 ? VS_NORMAL : VS_TEXCOORD);
+				if (!Layout::has(source))
+					break;
+				for (int k = 0; k < OBJ_SOURCE_SIZE[source]; k++) {
+					sources[source].push_back(strtof(p, &end));
+					p = end;
+				}
+				break;
+			}
+			case 5:
+			case 6:
+			case 7: {
+				p = skipSpace(p);
+				size_t length = strlen(p);
+				while (length > 0 && (p[length - 1] == ' ' || p[length - 1] == '\t' || p[length - 1] == '\r'))
+					length--;
+				(cmd == 7 ? material : object).assign(p, length);
+				begin_part(material.empty() ? object : object + "/" + material, (int)vertex);
+				break;
+			}
+			case 4: {
+				// triangles only, like the fscanf loader this replaces
+				int index[VS_COUNT];
+				bool no_normal[3] = {};
+				for (int corner = 0; corner < 3; corner++, vertex++) {
+					if (vertex >= vertex_count || !parseLayoutCorner<Layout>(p, index))
+						return false;
+
+					bool valid = true;
+					Layout::forEach([&](auto attribute) {
+						using A = decltype(attribute);
+						using Component = typename A::Component;
+						typename Component::type *out = (typename Component::type*)sections[A::SOURCE] + (size_t)A::SIZE * vertex;
+
+						if (index[A::SOURCE] < 0 && A::SOURCE != VS_POSITION) {
+							for (int k = 0; k < A::SIZE; k++)
+								out[k] = Component::convert(0.f);
+							if (A::SOURCE == VS_NORMAL)
+								no_normal[corner] = true;
+							return;
+						}
+
+						size_t first = (size_t)index[A::SOURCE] * OBJ_SOURCE_SIZE[A::SOURCE];
+						if (index[A::SOURCE] < 0 || first >= sources[A::SOURCE].size()) {
+							valid = false;
+							return;
+						}
+
+						const float *in = sources[A::SOURCE].data() + first;
+						for (int k = 0; k < A::SIZE; k++)
+							out[k] = Component::convert(in[k]);
+					});
+					if (!valid)
+						return false;
+				}
+
+				if (no_normal[0] || no_normal[1] || no_normal[2]) {
+					const float *v = (const float*)sections[VS_POSITION] + 3 * (vertex - 3);
+					glm::vec3 p0(v[0], v[1], v[2]), p1(v[3], v[4], v[5]), p2(v[6], v[7], v[8]);
+					glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+					float length = glm::length(n);
+					n = length > 0.f ? n / length : glm::vec3(0.f, 0.f, 1.f);
+
+					Layout::forEach([&](auto attribute) {
+						using A = decltype(attribute);
+						using Component = typename A::Component;
+						if (A::SOURCE != VS_NORMAL)
+							return;
+
+						for (int corner = 0; corner < 3; corner++) {
+							typename Component::type *out = (typename Component::type*)sections[A::SOURCE] + (size_t)A::SIZE * (vertex - 3 + corner);
+							for (int k = 0; no_normal[corner] && k < A::SIZE; k++)
+								out[k] = Component::convert(n[k]);
+						}
+					});
+				}
+				break;
+			}
+			}
+			return true;
+		});
+
+		return ok && vertex == vertex_count;
+	}
+
+	/*
+		attribute formats of Layout for a buffer of vertex_count vertices.
+		binding point i is used by location i. the vao must be bound.
+		offsets, strides: section of each source, stride 0 if Layout has none.
+	*/
+	template <typename Layout>
+	void setupVertexAttributes(GLuint vbo, size_t vertex_count, size_t (&offsets)[VS_COUNT], size_t (&strides)[VS_COUNT])
+	{
+		for (int i = 0; i < VS_COUNT; i++)
+			offsets[i] = strides[i] = 0;
+
+		Layout::forEach([&](auto attribute) {
+			using A = decltype(attribute);
+			offsets[A::SOURCE] = Layout::getSectionOffset(A::SOURCE, vertex_count);
+			strides[A::SOURCE] = A::STRIDE;
+
+			glEnableVertexAttribArray(A::LOCATION);
+			glVertexAttribFormat(A::LOCATION, A::SIZE, A::TYPE, A::NORMALIZED, 0);
+			glVertexAttribBinding(A::LOCATION, A::LOCATION);
+			glBindVertexBuffer(A::LOCATION, vbo, (GLintptr)Layout::getSectionOffset(A::SOURCE, vertex_count), (GLsizei)A::STRIDE);
+		});
+	}
+}
+
 /*////////////////////////////////////////////////////////////////////////*/
 /*																		  */
 /* VAO																	  */
@@ -49,12 +358,44 @@ VAO::~VAO()
 		unload();
 }
 
-bool VAO::load(const char *obj_file)
+VAO::VAO(VAO&& other) noexcept
 {
-	std::vector<float> vbuf, nbuf, tbuf; //: Ⱑ ߿մϴ.  ӽ
-	std::vector<GLuint> f;
+	*this = std::move(other);
+}
 
-#pragma region ____Read Obj File and Make Buffers
+VAO& VAO::operator=(VAO&& other) noexcept
+{
+	if (this == &other)
+		return *this;
+
+	if (isLoaded())
+		unload();
+
+	m_vao = std::exchange(other.m_vao, 0);
+	m_vbo = std::exchange(other.m_vbo, 0);
+	m_faceCount = std::exchange(other.m_faceCount, 0);
+	for (int i = 0; i < VS_COUNT; i++) {
+		m_sectionOffset[i] = std::exchange(other.m_sectionOffset[i], 0);
+		m_sectionStride[i] = std::exchange(other.m_sectionStride[i], 0);
+	}
+	m_bvh = std::move(other.m_bvh);
+	m_bounds = std::exchange(other.m_bounds, AABB());
+	m_shadow = std::move(other.m_shadow);
+	m_dirtyPositions = std::move(other.m_dirtyPositions);
+	m_dirtyNormals = std::move(other.m_dirtyNormals);
+	m_stream = std::move(other.m_stream);
+	m_parts = std::move(other.m_parts);
+	m_partVisible = std::move(other.m_partVisible);
+	m_commands = std::move(other.m_commands);
+	m_indirect = std::exchange(other.m_indirect, 0);
+	m_indirectInstances = std::exchange(other.m_indirectInstances, -1);
+	m_indirectBase = std::exchange(other.m_indirectBase, -1);
+
+	return *this;
+}
+
+bool VAO::load(const char *obj_file)
+{
 	FILE* fin;
 	fopen_s(&fin, obj_file, "rt");
 	if (!fin) {
@@ -62,178 +403,360 @@ bool VAO::load(const char *obj_file)
 		return 0;
 	}
 
-	struct f3 { float x, y, z; };
-	struct f2 { float s, t; };
+#pragma region ____Read Obj File and Make Buffers
+	// pre-pass: element counts, so the scratch buffers of the load are sized once
+	// and come from one arena block instead of growing.
+	Arena arena;
+	ScratchVector<char> window(OBJ_WINDOW, '\0', ArenaAllocator<char>(arena));
+	size_t v_total = 0, t_total = 0, n_total = 0, f_total = 0;
+	int face_elements = 0;
+	forEachLine(fin, window, [&](const char *line) {
+		switch (objCommand(line)) {
+		case 1: v_total++; break;
+		case 2: t_total++; break;
+		case 3: n_total++; break;
+		case 4: f_total++; face_elements |= objFaceElements(line); break;
+		}
+		return true;
+	});
+	rewind(fin);
+
+	size_t vertex_total = 3 * f_total;
+	if (vertex_total == 0 || vertex_total > (size_t)INT32_MAX) {
+		puts("there is no vertex");
+		fclose(fin);
+		return false;
+	}
 
-	char cmd[16]; //  б
-	std::vector<f3> v, n;
-	std::vector<f2> t;
-	f3 xyz;
-	f2 uv;
-	GLuint iFace = 0; //0.. f ϴ.
-	bool hasTexCoord = false;
-	bool hasNormal = false;
+	// the layout is picked once per file, the read and pack loops are compiled for it.
+	auto read = [&](auto layout) {
+		using Layout = decltype(layout);
+		size_t buffer_size = Layout::getVertexBytes() * vertex_total;
+		arena.reserve(sizeof(float) * (3 * v_total + 3 * n_total + 2 * t_total) + buffer_size
+			+ 8 * alignof(std::max_align_t));
+
+		ArenaAllocator<float> scratch(arena);
+		ScratchVector<float> sources[VS_COUNT] = {
+			ScratchVector<float>(scratch), ScratchVector<float>(scratch), ScratchVector<float>(scratch) };
+		sources[VS_POSITION].reserve(3 * v_total);
+		sources[VS_NORMAL].reserve(Layout::has(VS_NORMAL) ? 3 * n_total : 0);
+		sources[VS_TEXCOORD].reserve(Layout::has(VS_TEXCOORD) ? 2 * t_total : 0);
+		char *vertices = (char*)arena.allocate(buffer_size);
+
+		m_parts.clear();
+		beginPart("", 0);
+		if (!readObjVertices<Layout>(fin, window, sources, vertices, vertex_total,
+			[this](const std::string& name, int first) { beginPart(name, first); })) {
+			m_parts.clear();
+			return false;
+		}
 
-	//͸ ϴ.
-	while (!feof(fin))
-	{
-		fscanf_s(fin, "%s", cmd, sizeof(cmd));
+		glGenVertexArrays(1, &m_vao);
+		glBindVertexArray(m_vao);
 
-		//v..
-		if (strcmp(cmd, "v") == 0) {
-			fscanf_s(fin, "%f %f %f", &xyz.x, &xyz.y, &xyz.z);
-			v.push_back(xyz);
-		}
-		//vt..
-		else if (strcmp(cmd, "vt") == 0) {
-			fscanf_s(fin, "%f %f", &uv.s, &uv.t);
-			t.push_back(uv);
+		glGenBuffers(1, &m_vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBufferData(GL_ARRAY_BUFFER, buffer_size, vertices, GL_STATIC_DRAW);
+		setupVertexAttributes<Layout>(m_vbo, vertex_total, m_sectionOffset, m_sectionStride);
 
-			hasTexCoord = true;
-		}
-		//vn..
-		else if (strcmp(cmd, "vn") == 0) {
-			fscanf_s(fin, "%f %f %f", &xyz.x, &xyz.y, &xyz.z);
-			n.push_back(xyz);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
 
-			hasNormal = true;
-		}
-		//f..
-		else if (strcmp(cmd, "f") == 0) {
-			int vi[3], ti[3], ni[3]; //'s id
-
-			if (hasTexCoord && hasNormal) {
-				int map = fscanf_s(fin, "%d/%d/%d %d/%d/%d %d/%d/%d", &vi[0], &ti[0], &ni[0], &vi[1], &ti[1], &ni[1], &vi[2], &ti[2], &ni[2]);
-				if (map != 9) {
-					puts("there is no vertex + texture coord + normal set.");
-					fclose(fin);
-					return false;
-				}
+		m_faceCount = (int)vertex_total;
+		const float *positions = (const float*)(vertices + Layout::getSectionOffset(VS_POSITION, vertex_total));
+		m_bvh.build(positions, m_faceCount);
 
-				for (int i = 0; i < 3; i++) { //3  ؼ
-					f.push_back(iFace++); //εԴϴ.
+		endParts(m_faceCount);
+		for (Part& part : m_parts)
+			for (int i = part.first; i < part.first + part.count; i++)
+				part.bounds.expand(glm::vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]));
 
-					vbuf.push_back(v[vi[i] - 1].x); //x
-					vbuf.push_back(v[vi[i] - 1].y); //y
-					vbuf.push_back(v[vi[i] - 1].z); //z
+		return true;
+	};
 
-					tbuf.push_back(t[ti[i] - 1].s); //u
-					tbuf.push_back(t[ti[i] - 1].t); //v
+	// by the faces, vt or vn lines that no face uses do not add an attribute.
+	bool has_t = t_total && (face_elements & (1 << VS_TEXCOORD));
+	bool has_n = n_total && (face_elements & (1 << VS_NORMAL));
+	bool ok;
+	if (has_t && has_n)
+		ok = read(LayoutPNT());
+	else if (has_n)
+		ok = read(LayoutPN());
+	else if (has_t)
+		ok = read(LayoutPT());
+	else
+		ok = read(LayoutP());
+	fclose(fin);
+#pragma endregion
 
-					nbuf.push_back(n[ni[i] - 1].x); //nx
-					nbuf.push_back(n[ni[i] - 1].y); //ny
-					nbuf.push_back(n[ni[i] - 1].z); //nz
-				}
-			}
-			else if (hasNormal) {
-				int map = fscanf_s(fin, "%d//%d %d//%d %d//%d", &vi[0], &ni[0], &vi[1], &ni[1], &vi[2], &ni[2]);
-				if (map != 6) {
-					puts("there is no vertex + normal set.");
-					fclose(fin);
-					return false;
-				}
+	if (!ok)
+		puts("a face is malformed or has an invalid index.");
 
-				for (int i = 0; i < 3; i++) { //3  ؼ
-					f.push_back(iFace++); //εԴϴ.
+	return ok;
+}
 
-					vbuf.push_back(v[vi[i] - 1].x); //x
-					vbuf.push_back(v[vi[i] - 1].y); //y
-					vbuf.push_back(v[vi[i] - 1].z); //z
+bool VAO::loadStreaming(const char *obj_file, bool build_bvh)
+{
+	if (isLoaded())
+		unload();
 
-					nbuf.push_back(n[ni[i] - 1].x); //nx
-					nbuf.push_back(n[ni[i] - 1].y); //ny
-					nbuf.push_back(n[ni[i] - 1].z); //nz
-				}
-			}
-			else if (hasTexCoord) {
-				int map = fscanf_s(fin, "%d/%d %d/%d %d/%d", &vi[0], &ti[0], &vi[1], &ti[1], &vi[2], &ti[2]);
-				if (map != 6) {
-					puts("there is no vertex + normal set.");
-					fclose(fin);
-					return false;
-				}
+	FILE* fin;
+	fopen_s(&fin, obj_file, "rb");
+	if (!fin) {
+		puts("file !");
+		return false;
+	}
 
-				for (int i = 0; i < 3; i++) { //3  ؼ
-					f.push_back(iFace++); //εԴϴ.
+	// scratch of the load: the read window and the unique attributes
+	Arena arena;
+	ScratchVector<char> window(OBJ_WINDOW, '\0', ArenaAllocator<char>(arena));
+
+	// pre-pass: element counts
+	size_t v_total = 0, t_total = 0, n_total = 0, tri_total = 0;
+	bool ok = forEachLine(fin, window, [&](const char *line) {
+		const char *p = line;
+		switch (objCommand(p)) {
+		case 1: v_total++; break;
+		case 2: t_total++; break;
+		case 3: n_total++; break;
+		case 4: {
+			int corner[3], count = 0;
+			while (parseCorner(p, 0, 0, 0, corner))
+				count++;
+			if (count >= 3)
+				tri_total += count - 2;
+			break;
+		}
+		}
+		return true;
+	});
 
-					vbuf.push_back(v[vi[i] - 1].x); //x
-					vbuf.push_back(v[vi[i] - 1].y); //y
-					vbuf.push_back(v[vi[i] - 1].z); //z
+	size_t vertex_total = tri_total * 3;
+	if (!ok || vertex_total == 0 || vertex_total > (size_t)INT32_MAX) {
+		puts("there is no vertex");
+		fclose(fin);
+		return false;
+	}
 
-					tbuf.push_back(t[ti[i] - 1].s); //u
-					tbuf.push_back(t[ti[i] - 1].t); //v
-				}
-			}
-			else {
-				int map = fscanf_s(fin, "%d %d %d", &vi[0], &vi[1], &vi[2]);
-				if (map != 3) {
-					puts("there is no vertex");
-					fclose(fin);
-					return false;
-				}
+	// buffer layout: positions, normals (if any), texture coords (if any)
+	size_t vbuf_size = sizeof(float) * 3 * vertex_total;
+	size_t nbuf_size = n_total ? sizeof(float) * 3 * vertex_total : 0;
+	size_t tbuf_size = t_total ? sizeof(float) * 2 * vertex_total : 0;
+	size_t n_offset = vbuf_size;
+	size_t t_offset = n_offset + nbuf_size;
 
-				for (int i = 0; i < 3; i++) { //3  ؼ
-					f.push_back(iFace++); //εԴϴ.
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
 
-					vbuf.push_back(v[vi[i] - 1].x); //x
-					vbuf.push_back(v[vi[i] - 1].y); //y
-					vbuf.push_back(v[vi[i] - 1].z); //z
-				}
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, vbuf_size + nbuf_size + tbuf_size, nullptr, GL_STATIC_DRAW);
+	char *mapped = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, vbuf_size + nbuf_size + tbuf_size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (!mapped) {
+		fclose(fin);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+		unload();
+		return false;
+	}
+	float *vbuf = (float*)mapped;
+	float *nbuf = (float*)(mapped + n_offset);
+	float *tbuf = (float*)(mapped + t_offset);
+
+	// unique attributes, the only data that grows with the file
+	arena.reserve(sizeof(glm::vec3) * (v_total + n_total) + sizeof(glm::vec2) * t_total
+		+ (build_bvh ? sizeof(uint32_t) * vertex_total : 0) + 4 * alignof(std::max_align_t));
+	ScratchVector<glm::vec3> v{ ArenaAllocator<glm::vec3>(arena) }, n{ ArenaAllocator<glm::vec3>(arena) };
+	ScratchVector<glm::vec2> t{ ArenaAllocator<glm::vec2>(arena) };
+	ScratchVector<uint32_t> corners{ ArenaAllocator<uint32_t>(arena) };
+	v.reserve(v_total);
+	n.reserve(n_total);
+	t.reserve(t_total);
+	if (build_bvh)
+		corners.reserve(vertex_total);
+
+	m_bounds = AABB();
+	size_t vertex = 0;
+
+	auto emit = [&](const int c[3]) {
+		if (c[0] < 0 || c[0] >= (int)v.size() || c[1] >= (int)t.size() || c[2] >= (int)n.size())
+			return false;
+
+		const glm::vec3& position = v[c[0]];
+		memcpy(vbuf + 3 * vertex, &position[0], sizeof(float) * 3);
+		if (nbuf_size) {
+			glm::vec3 normal = c[2] >= 0 ? n[c[2]] : glm::vec3(0.f);
+			memcpy(nbuf + 3 * vertex, &normal[0], sizeof(float) * 3);
+		}
+		if (tbuf_size) {
+			glm::vec2 uv = c[1] >= 0 ? t[c[1]] : glm::vec2(0.f);
+			memcpy(tbuf + 2 * vertex, &uv[0], sizeof(float) * 2);
+		}
+
+		m_bounds.expand(position);
+		m_parts.back().bounds.expand(position);
+		if (build_bvh)
+			corners.push_back((uint32_t)c[0]);
+		vertex++;
+		return true;
+	};
+
+	std::string object, material;
+	m_parts.clear();
+	beginPart("", 0);
+
+	rewind(fin);
+	ok = forEachLine(fin, window, [&](const char *line) {
+		const char *p = line;
+		char *end;
+		float x[3] = {};
+
+		int cmd = objCommand(p);
+
+		switch (cmd) {
+		case 1:
+		case 3:
+			for (int k = 0; k < 3; k++) {
+				x[k] = strtof(p, &end);
+				p = end;
+			}
+			(cmd == 1 ? v : n).push_back(glm::vec3(x[0], x[1], x[2]));
+			break;
+		case 2:
+			for (int k = 0; k < 2; k++) {
+				x[k] = strtof(p, &end);
+				p = end;
+			}
+			t.push_back(glm::vec2(x[0], x[1]));
+			break;
+		case 5:
+		case 6:
+		case 7: {
+			p = skipSpace(p);
+			size_t length = strlen(p);
+			while (length > 0 && (p[length - 1] == ' ' || p[length - 1] == '\t' || p[length - 1] == '\r'))
+				length--;
+			(cmd == 7 ? material : object).assign(p, length);
+			beginPart(material.empty() ? object : object + "/" + material, (int)vertex);
+			break;
+		}
+		case 4: {
+			// triangle fan: (0, k - 1, k)
+			int first[3], prev[3], corner[3];
+			int count = 0;
+			while (parseCorner(p, (int)v.size(), (int)t.size(), (int)n.size(), corner)) {
+				if (count >= 2 && (vertex + 3 > vertex_total || !emit(first) || !emit(prev) || !emit(corner)))
+					return false;
+				if (count == 0)
+					memcpy(first, corner, sizeof(corner));
+				memcpy(prev, corner, sizeof(corner));
+				count++;
 			}
+			break;
 		}
+		}
+		return true;
+	});
+	fclose(fin);
 
-		cmd[0] = '\0';
+	GLboolean unmapped = glUnmapBuffer(GL_ARRAY_BUFFER);
+	if (!unmapped || !ok || vertex != vertex_total) {
+		puts(unmapped ? "invalid face index." : "vertex buffer was lost while mapped.");
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+		unload();
+		return false;
 	}
-	fclose(fin);
-#pragma endregion
 
-	size_t buffer_size = sizeof(float) * (vbuf.size() + nbuf.size() + tbuf.size());
-	size_t vbuf_size = sizeof(float) * vbuf.size();
-	size_t nbuf_size = sizeof(float) * nbuf.size();
-	size_t tbuf_size = sizeof(float) * tbuf.size();
+	if (nbuf_size && tbuf_size)
+		setupVertexAttributes<LayoutPNT>(m_vbo, vertex_total, m_sectionOffset, m_sectionStride);
+	else if (nbuf_size)
+		setupVertexAttributes<LayoutPN>(m_vbo, vertex_total, m_sectionOffset, m_sectionStride);
+	else if (tbuf_size)
+		setupVertexAttributes<LayoutPT>(m_vbo, vertex_total, m_sectionOffset, m_sectionStride);
+	else
+		setupVertexAttributes<LayoutP>(m_vbo, vertex_total, m_sectionOffset, m_sectionStride);
 
-	glGenVertexArrays(1, &m_vao);
-	glBindVertexArray(m_vao); //1
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
 
-	glGenBuffers(1, &m_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo); //2
-	glBufferData(GL_ARRAY_BUFFER, buffer_size, nullptr, GL_STATIC_DRAW);
-
-	// Vertex
-	size_t v_offset = 0;
-	glBufferSubData(GL_ARRAY_BUFFER, v_offset, vbuf_size, vbuf.data());
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)v_offset);
-
-	// Normal
-	size_t n_offset = v_offset + vbuf_size;
-	glBufferSubData(GL_ARRAY_BUFFER, n_offset, nbuf_size, nbuf.data());
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)n_offset);
-
-	// Texture
-	size_t t_offset = n_offset + nbuf_size;
-	glBufferSubData(GL_ARRAY_BUFFER, t_offset, tbuf_size, tbuf.data());
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)t_offset);
+	m_faceCount = (int)vertex_total;
+	endParts(m_faceCount);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0); //-2
-	glBindVertexArray(0); //-1
+	if (build_bvh)
+		m_bvh.build(v.data(), corners.data(), m_faceCount);
 
-	m_faceCount = f.size();
+	return true;
+}
 
-	if (m_faceCount == 0)
-	{
+bool VAO::create(const float *positions, const float *normals, int vertex_count,
+	const std::vector<Part>& parts, const float *texcoords)
+{
+	if (isLoaded())
 		unload();
+
+	if (vertex_count < 3)
 		return false;
+
+	size_t vbuf_size = sizeof(float) * 3 * vertex_count;
+	size_t tbuf_size = texcoords ? sizeof(float) * 2 * vertex_count : 0;
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+
+	glGenBuffers(1, &m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, 2 * vbuf_size + tbuf_size, nullptr, GL_STATIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, vbuf_size, positions);
+	glBufferSubData(GL_ARRAY_BUFFER, vbuf_size, vbuf_size, normals);
+
+	if (texcoords) {
+		glBufferSubData(GL_ARRAY_BUFFER, 2 * vbuf_size, tbuf_size, texcoords);
+		setupVertexAttributes<LayoutPNT>(m_vbo, vertex_count, m_sectionOffset, m_sectionStride);
+	}
+	else {
+		setupVertexAttributes<LayoutPN>(m_vbo, vertex_count, m_sectionOffset, m_sectionStride);
 	}
 
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	m_faceCount = vertex_count;
+
+	m_bounds = AABB();
+	for (int i = 0; i < vertex_count; i++)
+		m_bounds.expand(glm::vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]));
+
+	m_parts.clear();
+	for (const Part& part : parts)
+		beginPart(part.name, part.first);
+	endParts(m_faceCount);
+	for (Part& part : m_parts)
+		for (int i = part.first; i < part.first + part.count; i++)
+			part.bounds.expand(glm::vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]));
+
 	return true;
 }
 
 void VAO::unload()
 {
 	m_faceCount = 0;
+	for (int i = 0; i < VS_COUNT; i++)
+		m_sectionOffset[i] = m_sectionStride[i] = 0;
+	m_bvh.clear();
+	m_bounds = AABB();
+	m_shadow.clear();
+	m_dirtyPositions.clear();
+	m_dirtyNormals.clear();
+	m_stream.destroy();
+	m_parts.clear();
+	m_partVisible.clear();
+	m_commands.clear();
+
+	glDeleteBuffers(1, &m_indirect);
+	m_indirect = 0;
+	m_indirectInstances = -1;
 
 	glDeleteBuffers(1, &m_vbo);
 	m_vbo = 0;
@@ -265,100 +788,398 @@ void VAO::bind_render()
 	glDrawArrays(GL_TRIANGLES, 0, m_faceCount);
 }
 
-void VAO::bind()
+void VAO::renderInstanced(int instance_count, int base_instance)
 {
-	glBindVertexArray(m_vao);
+	glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, m_faceCount, instance_count, base_instance);
 }
 
-void VAO::unbind()
+void VAO::renderParts(int instance_count, int base_instance)
 {
-	glBindVertexArray(0);
+	if (!m_indirect)
+		glGenBuffers(1, &m_indirect);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirect);
+
+	// commands change only with the instance range or the part visibility.
+	if (instance_count != m_indirectInstances || base_instance != m_indirectBase) {
+		for (size_t i = 0; i < m_parts.size(); i++) {
+			m_commands[i].count = m_partVisible[i] ? (GLuint)m_parts[i].count : 0;
+			m_commands[i].instanceCount = (GLuint)instance_count;
+			m_commands[i].first = (GLuint)m_parts[i].first;
+			m_commands[i].baseInstance = (GLuint)base_instance;
+		}
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand) * m_commands.size(), m_commands.data(), GL_DYNAMIC_DRAW);
+
+		m_indirectInstances = instance_count;
+		m_indirectBase = base_instance;
+	}
+
+	glMultiDrawArraysIndirect(GL_TRIANGLES, nullptr, (GLsizei)m_parts.size(), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 }
 
-GLuint VAO::getVAO() const
+void VAO::bind()
 {
-	return m_vao;
+	flushUpdates();
+
+	glBindVertexArray(m_vao);
 }
 
-GLuint VAO::getVBO() const
+bool VAO::updateVertices(int first, int count, const float *positions, const float *normals)
 {
-	return m_vbo;
-}
+	if (first < 0 || count <= 0 || first + count > m_faceCount)
+		return false;
 
-/*////////////////////////////////////////////////////////////////////////*/
-/*																		  */
-/* Shader																  */
-/*																		  */
-/*////////////////////////////////////////////////////////////////////////*/
+	bool has_normals = m_sectionStride[VS_NORMAL] == 3 * sizeof(float);
+	if (normals && !has_normals)
+		return false;
 
-Shader::~Shader()
-{
-	if (isLoaded())
-		unload();
+	// cpu copy of the position and normal sections, read back once.
+	if (m_shadow.empty()) {
+		size_t section = 3 * (size_t)m_faceCount;
+		m_shadow.resize(has_normals ? 2 * section : section);
+		glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)m_sectionOffset[VS_POSITION],
+			sizeof(float) * section, m_shadow.data());
+		if (has_normals)
+			glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)m_sectionOffset[VS_NORMAL],
+				sizeof(float) * section, &m_shadow[section]);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+
+	memcpy(&m_shadow[3 * (size_t)first], positions, sizeof(float) * 3 * count);
+	m_dirtyPositions.push_back(std::make_pair(first, first + count));
+
+	if (normals) {
+		memcpy(&m_shadow[3 * ((size_t)m_faceCount + first)], normals, sizeof(float) * 3 * count);
+		m_dirtyNormals.push_back(std::make_pair(first, first + count));
+	}
+
+	return true;
 }
 
-bool Shader::load(const std::string & file)
+void VAO::flushUpdates()
 {
-	return load(
-		(file + ".vert").c_str(), 
-		(file + ".frag").c_str()
-	);
+	if (m_dirtyPositions.empty() && m_dirtyNormals.empty())
+		return;
+
+	// three frames of positions and normals in flight.
+	if (!m_stream.isCreated())
+		m_stream.create(3 * sizeof(float) * m_shadow.size());
+
+	auto merge = [](std::vector<std::pair<int, int>>& ranges) {
+		std::sort(ranges.begin(), ranges.end());
+		size_t count = 0;
+		for (auto& range : ranges) {
+			if (count > 0 && range.first <= ranges[count - 1].second)
+				ranges[count - 1].second = std::max(ranges[count - 1].second, range.second);
+			else
+				ranges[count++] = range;
+		}
+		ranges.resize(count);
+	};
+
+	// base: first float of the section in m_shadow, section: its byte offset in m_vbo
+	auto upload = [this](const std::vector<std::pair<int, int>>& ranges, size_t base, size_t section) {
+		glBindBuffer(GL_COPY_READ_BUFFER, m_stream.getBuffer());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_vbo);
+		for (auto& range : ranges) {
+			size_t offset = section + sizeof(float) * 3 * (size_t)range.first;
+			size_t size = sizeof(float) * 3 * (size_t)(range.second - range.first);
+			const float *data = &m_shadow[base + 3 * (size_t)range.first];
+
+			size_t stream_offset = m_stream.write(data, size);
+			if (stream_offset == StreamBuffer::INVALID_OFFSET) {
+				glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+			}
+			else {
+				// write() may have rebound GL_COPY_WRITE_BUFFER.
+				glBindBuffer(GL_COPY_READ_BUFFER, m_stream.getBuffer());
+				glBindBuffer(GL_COPY_WRITE_BUFFER, m_vbo);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, stream_offset, offset, size);
+			}
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	};
+
+	merge(m_dirtyPositions);
+	merge(m_dirtyNormals);
+	upload(m_dirtyPositions, 0, m_sectionOffset[VS_POSITION]);
+	upload(m_dirtyNormals, 3 * (size_t)m_faceCount, m_sectionOffset[VS_NORMAL]);
+	m_stream.fence();
+
+	// bvh: copy moved positions, refit once.
+	for (auto& range : m_dirtyPositions)
+		m_bvh.updatePositions(range.first, range.second - range.first, &m_shadow[3 * (size_t)range.first], false);
+	if (!m_dirtyPositions.empty())
+		m_bvh.refit();
+
+	m_dirtyPositions.clear();
+	m_dirtyNormals.clear();
 }
 
-bool Shader::load(const char *vert_file, const char *frag_File)
+int VAO::getVertexCount() const
 {
-	//̴ .
-	GLuint vertID = genShader(GL_VERTEX_SHADER, vert_file);
-	GLuint fragID = genShader(GL_FRAGMENT_SHADER, frag_File);
+	return m_faceCount;
+}
 
-	//α׷  ũմϴ.
-	GLuint id = glCreateProgram();
-	glAttachShader(id, vertID);
-	glAttachShader(id, fragID);
-	glLinkProgram(id);
+void VAO::readPositions(std::vector<float>& positions) const
+{
+	positions.resize(3 * (size_t)m_faceCount);
+	if (positions.empty())
+		return;
 
-	//̵ մϴ.
-	glDetachShader(id, vertID);
-	glDeleteShader(vertID);
-	glDetachShader(id, fragID);
-	glDeleteShader(fragID);
+	glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)m_sectionOffset[VS_POSITION],
+		sizeof(float) * positions.size(), positions.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
 
-	//ũи α׷ մϴ.
-	GLint link_checker;
-	glGetProgramiv(id, GL_LINK_STATUS, &link_checker);
-	if (link_checker == GL_FALSE || vertID == 0 || fragID == 0) {
-#ifdef _DEBUG
-		GLchar infoLog[512];
-		glGetProgramInfoLog(id, 512, NULL, infoLog);
-		printf_s("Link Fail: ");
-		puts(infoLog);
-#endif
-		glDeleteProgram(id);
+bool VAO::readTexCoords(std::vector<float>& texcoords) const
+{
+	texcoords.clear();
+	if (m_faceCount == 0 || m_sectionStride[VS_TEXCOORD] != 2 * sizeof(float))
 		return false;
-	}
 
-	m_program = id;
+	texcoords.resize(2 * (size_t)m_faceCount);
+	glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, (GLintptr)m_sectionOffset[VS_TEXCOORD],
+		sizeof(float) * texcoords.size(), texcoords.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
 
 	return true;
 }
 
-bool Shader::loadFromSource(const char *vert, const char *frag)
+void VAO::reorderTriangles(const std::vector<int>& order)
 {
-	//̴ .
-	GLuint vertID = genShaderFromSource(GL_VERTEX_SHADER, vert);
-	GLuint fragID = genShaderFromSource(GL_FRAGMENT_SHADER, frag);
+	if ((int)order.size() * 3 != m_faceCount || m_faceCount == 0)
+		return;
 
-	//α׷  ũմϴ.
-	GLuint id = glCreateProgram();
-	glAttachShader(id, vertID);
-	glAttachShader(id, fragID);
-	glLinkProgram(id);
+	flushUpdates();
 
-	//̵ մϴ.
-	glDetachShader(id, vertID);
-	glDeleteShader(vertID);
-	glDetachShader(id, fragID);
-	glDeleteShader(fragID);
+	// every section of the layout, each one is permuted on its own.
+	size_t size = 0;
+	for (int i = 0; i < VS_COUNT; i++)
+		size += m_sectionStride[i] * m_faceCount;
+
+	std::vector<char> source(size), target(size);
+	glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, size, source.data());
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	for (int s = 0; s < VS_COUNT; s++) {
+		size_t offset = m_sectionOffset[s];
+		size_t triangle = 3 * m_sectionStride[s];
+		for (size_t i = 0; triangle > 0 && i < order.size(); i++)
+			memcpy(&target[offset + i * triangle], &source[offset + (size_t)order[i] * triangle], triangle);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_vbo);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, target.data());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	m_shadow.clear();
+	if (m_bvh.isBuilt())
+		m_bvh.build((const float*)(target.data() + m_sectionOffset[VS_POSITION]), m_faceCount);
+}
+
+const StreamBuffer& VAO::getStream() const
+{
+	return m_stream;
+}
+
+void VAO::unbind()
+{
+	glBindVertexArray(0);
+}
+
+void VAO::setInstanceBuffer(GLuint instance_buffer)
+{
+	glBindVertexArray(m_vao); //1
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer); //2
+
+	// Instance
+	glEnableVertexAttribArray(3);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, 0, (void*)0);
+	glVertexAttribDivisor(3, 1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0); //-2
+	glBindVertexArray(0); //-1
+}
+
+GLuint VAO::getVAO() const
+{
+	return m_vao;
+}
+
+GLuint VAO::getVBO() const
+{
+	return m_vbo;
+}
+
+const MeshBVH & VAO::getBVH() const
+{
+	return m_bvh;
+}
+
+AABB VAO::getBounds() const
+{
+	return m_bvh.isBuilt() ? m_bvh.getBounds() : m_bounds;
+}
+
+int VAO::getPartCount() const
+{
+	return (int)m_parts.size();
+}
+
+const VAO::Part& VAO::getPart(int part) const
+{
+	return m_parts[part];
+}
+
+int VAO::findPart(int triangle) const
+{
+	if (triangle < 0 || triangle * 3 >= m_faceCount)
+		return -1;
+
+	auto it = std::upper_bound(m_parts.begin(), m_parts.end(), triangle * 3,
+		[](int vertex, const Part& part) { return vertex < part.first; });
+
+	return (int)(it - m_parts.begin()) - 1;
+}
+
+void VAO::setPartVisible(int part, bool visible)
+{
+	m_partVisible[part] = visible ? 1 : 0;
+	m_indirectInstances = -1;
+}
+
+bool VAO::isPartVisible(int part) const
+{
+	return m_partVisible[part] != 0;
+}
+
+void VAO::beginPart(const std::string& name, int first)
+{
+	// a part without vertices is only renamed.
+	if (!m_parts.empty() && m_parts.back().first == first) {
+		m_parts.back().name = name;
+		return;
+	}
+
+	if (!m_parts.empty())
+		m_parts.back().count = first - m_parts.back().first;
+
+	Part part;
+	part.name = name;
+	part.first = first;
+	m_parts.push_back(part);
+}
+
+void VAO::endParts(int vertex_count)
+{
+	if (m_parts.empty())
+		beginPart("", 0);
+	m_parts.back().count = vertex_count - m_parts.back().first;
+
+	m_parts.erase(std::remove_if(m_parts.begin(), m_parts.end(),
+		[](const Part& part) { return part.count <= 0; }), m_parts.end());
+
+	m_partVisible.assign(m_parts.size(), 1);
+	m_commands.resize(m_parts.size());
+	m_indirectInstances = -1;
+}
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Shader																  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+Shader::~Shader()
+{
+	if (isLoaded())
+		unload();
+}
+
+Shader::Shader(Shader&& other) noexcept
+	: m_program(std::exchange(other.m_program, 0))
+{
+}
+
+Shader& Shader::operator=(Shader&& other) noexcept
+{
+	if (this != &other) {
+		if (isLoaded())
+			unload();
+		m_program = std::exchange(other.m_program, 0);
+	}
+
+	return *this;
+}
+
+bool Shader::load(const std::string & file)
+{
+	return load(
+		(file + ".vert").c_str(), 
+		(file + ".frag").c_str()
+	);
+}
+
+bool Shader::load(const char *vert_file, const char *frag_File)
+{
+	//̴ .
+	GLuint vertID = genShader(GL_VERTEX_SHADER, vert_file);
+	GLuint fragID = genShader(GL_FRAGMENT_SHADER, frag_File);
+
+	//α׷  ũմϴ.
+	GLuint id = glCreateProgram();
+	glAttachShader(id, vertID);
+	glAttachShader(id, fragID);
+	glLinkProgram(id);
+
+	//̵ մϴ.
+	glDetachShader(id, vertID);
+	glDeleteShader(vertID);
+	glDetachShader(id, fragID);
+	glDeleteShader(fragID);
+
+	//ũи α׷ մϴ.
+	GLint link_checker;
+	glGetProgramiv(id, GL_LINK_STATUS, &link_checker);
+	if (link_checker == GL_FALSE || vertID == 0 || fragID == 0) {
+#ifdef _DEBUG
+		GLchar infoLog[512];
+		glGetProgramInfoLog(id, 512, NULL, infoLog);
+		printf_s("Link Fail: ");
+		puts(infoLog);
+#endif
+		glDeleteProgram(id);
+		return false;
+	}
+
+	m_program = id;
+
+	return true;
+}
+
+bool Shader::loadFromSource(const char *vert, const char *frag)
+{
+	//̴ .
+	GLuint vertID = genShaderFromSource(GL_VERTEX_SHADER, vert);
+	GLuint fragID = genShaderFromSource(GL_FRAGMENT_SHADER, frag);
+
+	//α׷  ũմϴ.
+	GLuint id = glCreateProgram();
+	glAttachShader(id, vertID);
+	glAttachShader(id, fragID);
+	glLinkProgram(id);
+
+	//̵ մϴ.
+	glDetachShader(id, vertID);
+	glDeleteShader(vertID);
+	glDetachShader(id, fragID);
+	glDeleteShader(fragID);
 
 	//ũи α׷ մϴ.
 	GLint link_checker;
@@ -379,6 +1200,72 @@ bool Shader::loadFromSource(const char *vert, const char *frag)
 	return true;
 }
 
+bool Shader::load(const char *vert_file, const char *geom_file, const char *frag_file)
+{
+	GLuint vertID = genShader(GL_VERTEX_SHADER, vert_file);
+	GLuint geomID = genShader(GL_GEOMETRY_SHADER, geom_file);
+	GLuint fragID = genShader(GL_FRAGMENT_SHADER, frag_file);
+
+	GLuint id = glCreateProgram();
+	glAttachShader(id, vertID);
+	glAttachShader(id, geomID);
+	glAttachShader(id, fragID);
+	glLinkProgram(id);
+
+	glDetachShader(id, vertID);
+	glDeleteShader(vertID);
+	glDetachShader(id, geomID);
+	glDeleteShader(geomID);
+	glDetachShader(id, fragID);
+	glDeleteShader(fragID);
+
+	GLint link_checker;
+	glGetProgramiv(id, GL_LINK_STATUS, &link_checker);
+	if (link_checker == GL_FALSE || vertID == 0 || geomID == 0 || fragID == 0) {
+#ifdef _DEBUG
+		GLchar infoLog[512];
+		glGetProgramInfoLog(id, 512, NULL, infoLog);
+		printf_s("Link Fail: ");
+		puts(infoLog);
+#endif
+		glDeleteProgram(id);
+		return false;
+	}
+
+	m_program = id;
+
+	return true;
+}
+
+bool Shader::loadCompute(const char *comp_file)
+{
+	GLuint compID = genShader(GL_COMPUTE_SHADER, comp_file);
+
+	GLuint id = glCreateProgram();
+	glAttachShader(id, compID);
+	glLinkProgram(id);
+
+	glDetachShader(id, compID);
+	glDeleteShader(compID);
+
+	GLint link_checker;
+	glGetProgramiv(id, GL_LINK_STATUS, &link_checker);
+	if (link_checker == GL_FALSE || compID == 0) {
+#ifdef _DEBUG
+		GLchar infoLog[512];
+		glGetProgramInfoLog(id, 512, NULL, infoLog);
+		printf_s("Link Fail: ");
+		puts(infoLog);
+#endif
+		glDeleteProgram(id);
+		return false;
+	}
+
+	m_program = id;
+
+	return true;
+}
+
 void Shader::unload()
 {
 	glDeleteProgram(m_program);
@@ -480,240 +1367,804 @@ FBO::~FBO()
 		destroy();
 }
 
+FBO::FBO(FBO&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+FBO& FBO::operator=(FBO&& other) noexcept
+{
+	if (this == &other)
+		return *this;
+
+	if (isCreated())
+		destroy();
+
+	m_fbo = std::exchange(other.m_fbo, 0);
+	m_depthTex = std::exchange(other.m_depthTex, 0);
+	m_ownsDepth = std::exchange(other.m_ownsDepth, true);
+	for (int i = 0; i < MAX_COLOR_TEXTURE; i++)
+		m_colorTex[i] = std::exchange(other.m_colorTex[i], 0);
+	m_colorTexCount = std::exchange(other.m_colorTexCount, 0);
+	m_width = std::exchange(other.m_width, 0);
+	m_height = std::exchange(other.m_height, 0);
+	m_layerCount = std::exchange(other.m_layerCount, 0);
+	m_readFbo = std::exchange(other.m_readFbo, 0);
+	m_layerViews = std::move(other.m_layerViews);
+	other.m_layerViews.clear();
+
+	return *this;
+}
+
 bool FBO::create(int width, int height, int colorTextureCount /*= 1*/, 
 	bool hasDepthTexture /*= true*/, GLenum colorFormat /*= GL_RGBA32F*/)
 {
-	if (colorTextureCount > MAX_COLOR_TEXTURE) {
+	return create(width, height, std::vector<GLenum>(colorTextureCount, colorFormat), hasDepthTexture);
+}
+
+bool FBO::create(int width, int height, const std::vector<GLenum>& colorFormats,
+	bool hasDepthTexture /*= true*/)
+{
+	return build(width, height, 0, colorFormats, hasDepthTexture);
+}
+
+bool FBO::createLayered(int width, int height, int layerCount, const std::vector<GLenum>& colorFormats,
+	bool hasDepthTexture /*= true*/)
+{
+	if (layerCount < 1) {
+		puts("Layer count must be positive.");
+		return false;
+	}
+
+	return build(width, height, layerCount, colorFormats, hasDepthTexture);
+}
+
+bool FBO::build(int width, int height, int layerCount, const std::vector<GLenum>& colorFormats,
+	bool hasDepthTexture)
+{
+	if ((int)colorFormats.size() > MAX_COLOR_TEXTURE) {
 		puts("Many Color Texture is requested.");
 		return false;
 	}
 
 	m_width = width;
 	m_height = height;
-	m_colorTexCount = colorTextureCount;
+	m_colorTexCount = (int)colorFormats.size();
+	m_layerCount = layerCount;
+
+	GLenum target = m_layerCount ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+	auto makeTexture = [&](GLuint texture, GLenum format) {
+		glBindTexture(target, texture);
+		if (m_layerCount)
+			glTexStorage3D(target, 1, format, m_width, m_height, m_layerCount);
+		else
+			glTexStorage2D(target, 1, format, m_width, m_height);
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(target, 0);
+	};
+
+	//  
+	glGenFramebuffers(1, &m_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+
+	//  Texture
+	glGenTextures(m_colorTexCount, m_colorTex);
+	for (int i = 0; i < m_colorTexCount; i++) {
+		makeTexture(m_colorTex[i], colorFormats[i]);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, m_colorTex[i], 0);
+	}
+
+	//  Texture
+	if (hasDepthTexture) {
+		glGenTextures(1, &m_depthTex);
+		makeTexture(m_depthTex, GL_DEPTH_COMPONENT24);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTex, 0);
+	}
+
+	//  б FBO 2D ؽó 
+	if (m_layerCount) {
+		glGenFramebuffers(1, &m_readFbo);
+
+		m_layerViews.resize(m_colorTexCount * m_layerCount);
+		glGenTextures((GLsizei)m_layerViews.size(), m_layerViews.data());
+		for (int i = 0; i < m_colorTexCount; i++) {
+			for (int layer = 0; layer < m_layerCount; layer++) {
+				GLuint view = m_layerViews[i * m_layerCount + layer];
+				glTextureView(view, GL_TEXTURE_2D, m_colorTex[i], colorFormats[i], 0, 1, layer, 1);
+				glBindTexture(GL_TEXTURE_2D, view);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			}
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	// ˻մϴ.
+	bool result;
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printAllErrors("FraneBuffer Fail!");
+		destroy();
+
+		result = false;
+	}
+	else {
+		setAllDrawbuffers();
+
+		result = true;
+	}
+
+	// ϰ մϴ.
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return result;
+}
+
+void FBO::destroy()
+{
+	glDeleteFramebuffers(1, &m_fbo);
+	m_fbo = 0;
+
+	glDeleteTextures(m_colorTexCount, m_colorTex);
+	for (int i = 0; i < MAX_COLOR_TEXTURE; i++)
+		m_colorTex[i] = 0;
+	m_colorTexCount = 0;
+
+	if (m_ownsDepth)
+		glDeleteTextures(1, &m_depthTex);
+	m_depthTex = 0;
+	m_ownsDepth = true;
+
+	glDeleteFramebuffers(1, &m_readFbo);
+	m_readFbo = 0;
+	glDeleteTextures((GLsizei)m_layerViews.size(), m_layerViews.data());
+	m_layerViews.clear();
+	m_layerCount = 0;
+
+	m_width = 0;
+	m_height = 0;
+}
+
+bool FBO::isCreated()
+{
+	return (m_fbo != 0);
+}
+
+bool FBO::shareDepth(const FBO& other)
+{
+	if (!isCreated() || other.getDepthTex() == 0 || m_layerCount != other.getLayerCount()
+		|| m_width != other.getWidth() || m_height != other.getHeight())
+		return false;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, other.getDepthTex(), 0);
+	bool result = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!result) {
+		printAllErrors("FraneBuffer Fail!");
+		return false;
+	}
+
+	if (m_ownsDepth)
+		glDeleteTextures(1, &m_depthTex);
+	m_depthTex = other.getDepthTex();
+	m_ownsDepth = false;
+
+	return true;
+}
+
+void FBO::bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glViewport(0, 0, m_width, m_height);
+}
+
+void FBO::unbind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void FBO::setDrawbuffers(const std::initializer_list<GLenum>& buffer_list)
+{
+	GLenum buffers[MAX_COLOR_TEXTURE];
+	GLsizei count = 0;
+
+	for (GLenum value : buffer_list) {
+		if (count < MAX_COLOR_TEXTURE)
+			buffers[count++] = value + GL_COLOR_ATTACHMENT0;
+	}
+
+	glDrawBuffers(count, buffers);
+}
+
+void FBO::setAllDrawbuffers()
+{
+	GLenum buffers[MAX_COLOR_TEXTURE];
+
+	for (int i = 0; i < m_colorTexCount; i++) {
+		buffers[i] = i + GL_COLOR_ATTACHMENT0;
+	}
+
+	glDrawBuffers(m_colorTexCount, buffers);
+}
+
+void FBO::readPixel(int x, int y, float * rgba, int texture_index)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT0 + texture_index);
+	glReadPixels(x, y, 1, 1, GL_RGBA, GL_FLOAT, rgba);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void FBO::bindColorTexture(int texture_index, int unit)
+{
+	glActiveTexture(unit + GL_TEXTURE0);
+	glBindTexture(m_layerCount ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, getColorTex(texture_index));
+}
+
+void FBO::bindDepthTexture(int unit)
+{
+	glActiveTexture(unit + GL_TEXTURE0);
+	glBindTexture(m_layerCount ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, getDepthTex());
+}
+
+void FBO::unbindTexture()
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GLuint FBO::getFBO() const
+{
+	return m_fbo;
+}
+
+GLuint FBO::getReadFBO(int layer) const
+{
+	if (!m_layerCount)
+		return m_fbo;
+
+	// attaches the layer of every texture.
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_readFbo);
+	for (int i = 0; i < m_colorTexCount; i++)
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, m_colorTex[i], 0, layer);
+	if (m_depthTex)
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTex, 0, layer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	return m_readFbo;
+}
+
+GLuint FBO::getDepthTex() const
+{
+	return m_depthTex;
+}
+
+GLuint FBO::getColorTex(int texture_index) const
+{
+	if (texture_index < 0 || texture_index > m_colorTexCount)
+		return 0;
+
+	return m_colorTex[texture_index];
+}
+
+int FBO::getWidth() const
+{
+	return m_width;
+}
+
+int FBO::getHeight() const
+{
+	return m_height;
+}
+
+int FBO::getColorTexCount() const
+{
+	return m_colorTexCount;
+}
+
+GLuint FBO::getLayerTex(int texture_index, int layer) const
+{
+	if (!m_layerCount)
+		return layer == 0 ? getColorTex(texture_index) : 0;
+	if (texture_index < 0 || texture_index >= m_colorTexCount || layer < 0 || layer >= m_layerCount)
+		return 0;
+
+	return m_layerViews[texture_index * m_layerCount + layer];
+}
+
+int FBO::getLayerCount() const
+{
+	return m_layerCount;
+}
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* TEXTURE																  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+Texture::~Texture()
+{
+	if (isLoaded())
+		unload();
+}
+
+Texture::Texture(Texture&& other) noexcept
+	: m_texture(std::exchange(other.m_texture, 0)),
+	m_width(std::exchange(other.m_width, 0)),
+	m_height(std::exchange(other.m_height, 0))
+{
+}
+
+Texture& Texture::operator=(Texture&& other) noexcept
+{
+	if (this != &other) {
+		if (isLoaded())
+			unload();
+		m_texture = std::exchange(other.m_texture, 0);
+		m_width = std::exchange(other.m_width, 0);
+		m_height = std::exchange(other.m_height, 0);
+	}
+
+	return *this;
+}
+
+bool Texture::load(const char *image_file)
+{
+	stbi_set_flip_vertically_on_load(true);
+
+	int channel;
+	auto data = stbi_load(image_file, &m_width, &m_height, &channel, 0);
+
+	if (!data) {
+		puts("input image file!");
+		return false;
+	}
+
+	GLenum format = (channel == 3) ? GL_RGB : GL_RGBA;
+
+	glGenTextures(1, &m_texture);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, format, m_width, m_height, 0, format, GL_UNSIGNED_BYTE, data);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	stbi_image_free(data);
+
+	return true;
+}
+
+void Texture::unload()
+{
+	glDeleteTextures(1, &m_texture);
+	m_texture = 0;
+}
+
+bool Texture::isLoaded() const
+{
+	return (m_texture != 0);
+}
+
+GLuint Texture::getTexture() const
+{
+	return m_texture;
+}
+
+void Texture::bind(int bind)
+{
+	glActiveTexture(bind + GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+}
+
+void Texture::unbind()
+{
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Gpu Timer															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+GpuTimer::~GpuTimer()
+{
+	if (isCreated())
+		destroy();
+}
 
-	//  
-	glGenFramebuffers(1, &m_fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+GpuTimer::GpuTimer(GpuTimer&& other) noexcept
+{
+	*this = std::move(other);
+}
 
-	//  Texture
-	glGenTextures(m_colorTexCount, m_colorTex);
-	for (int i = 0; i < m_colorTexCount; i++) {
-		glBindTexture(GL_TEXTURE_2D, m_colorTex[i]);
-		glTexStorage2D(GL_TEXTURE_2D, 1, colorFormat, m_width, m_height);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i,
-			GL_TEXTURE_2D, m_colorTex[i], 0);
+GpuTimer& GpuTimer::operator=(GpuTimer&& other) noexcept
+{
+	if (this != &other) {
+		if (isCreated())
+			destroy();
+		for (int i = 0; i < QUERY_COUNT; i++)
+			m_queries[i] = std::exchange(other.m_queries[i], 0);
+		m_head = std::exchange(other.m_head, 0);
+		m_pendingCount = std::exchange(other.m_pendingCount, 0);
+		m_running = std::exchange(other.m_running, false);
+		m_sum = std::exchange(other.m_sum, 0.0);
+		m_last = std::exchange(other.m_last, 0.0);
+		m_count = std::exchange(other.m_count, 0);
 	}
 
-	//  Texture
-	if (hasDepthTexture) {
-		glGenTextures(1, &m_depthTex);
-		glBindTexture(GL_TEXTURE_2D, m_depthTex);
-		glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, m_width, m_height);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-			GL_TEXTURE_2D, m_depthTex, 0);
-	}
+	return *this;
+}
 
-	// ˻մϴ.
-	bool result;
+void GpuTimer::create()
+{
+	glGenQueries(QUERY_COUNT, m_queries);
+}
 
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		printAllErrors("FraneBuffer Fail!");
-		destroy();
+void GpuTimer::destroy()
+{
+	glDeleteQueries(QUERY_COUNT, m_queries);
+	for (auto& query : m_queries)
+		query = 0;
 
-		result = false;
-	}
-	else {
-		setAllDrawbuffers();
+	m_head = 0;
+	m_pendingCount = 0;
+	m_running = false;
+}
 
-		result = true;
-	}
+bool GpuTimer::isCreated() const
+{
+	return (m_queries[0] != 0);
+}
 
-	// ϰ մϴ.
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+bool GpuTimer::begin()
+{
+	if (m_pendingCount == QUERY_COUNT)
+		return false;
 
-	return result;
+	glBeginQuery(GL_TIME_ELAPSED, m_queries[m_head]);
+	m_running = true;
+
+	return true;
 }
 
-void FBO::destroy()
+void GpuTimer::end()
 {
-	glDeleteFramebuffers(1, &m_fbo);
-	m_fbo = 0;
+	if (!m_running)
+		return;
 
-	glDeleteTextures(m_colorTexCount, m_colorTex);
-	for (int i = 0; i < MAX_COLOR_TEXTURE; i++)
-		m_colorTex[i] = 0;
-	m_colorTexCount = 0;
+	glEndQuery(GL_TIME_ELAPSED);
+	m_running = false;
 
-	glDeleteTextures(1, &m_depthTex);
-	m_depthTex = 0;
+	m_head = (m_head + 1) % QUERY_COUNT;
+	m_pendingCount++;
+}
 
-	m_width = 0;
-	m_height = 0;
+void GpuTimer::poll()
+{
+	while (m_pendingCount > 0) {
+		GLuint query = m_queries[(m_head - m_pendingCount + QUERY_COUNT) % QUERY_COUNT];
+
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		m_last = (double)elapsed * 1e-6;
+		m_sum += m_last;
+		m_count++;
+		m_pendingCount--;
+	}
 }
 
-bool FBO::isCreated()
+double GpuTimer::getMean() const
 {
-	return (m_fbo != 0);
+	return m_count ? m_sum / m_count : 0.0;
 }
 
-void FBO::bind()
+double GpuTimer::getLast() const
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
-	glViewport(0, 0, m_width, m_height);
+	return m_last;
 }
 
-void FBO::unbind()
+uint64_t GpuTimer::getCount() const
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return m_count;
 }
 
-void FBO::setDrawbuffers(const std::initializer_list<GLenum>& buffer_list)
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Buffer																  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+Buffer::~Buffer()
+{
+	if (isCreated())
+		destroy();
+}
+
+Buffer::Buffer(Buffer&& other) noexcept
+	: m_buffer(std::exchange(other.m_buffer, 0)),
+	m_size(std::exchange(other.m_size, 0))
 {
-	std::vector<GLenum> buffers(buffer_list.begin(), buffer_list.end());
+}
 
-	for (auto& value : buffers) {
-		value += GL_COLOR_ATTACHMENT0;
+Buffer& Buffer::operator=(Buffer&& other) noexcept
+{
+	if (this != &other) {
+		if (isCreated())
+			destroy();
+		m_buffer = std::exchange(other.m_buffer, 0);
+		m_size = std::exchange(other.m_size, 0);
 	}
 
-	glDrawBuffers(buffers.size(), buffers.data());
+	return *this;
 }
 
-void FBO::setAllDrawbuffers()
+bool Buffer::create(size_t size, const void *data /*= nullptr*/, GLenum usage /*= GL_DYNAMIC_DRAW*/)
 {
-	std::vector<GLenum> buffers(m_colorTexCount);
+	if (size == 0)
+		return false;
 
-	for (int i = 0; i < m_colorTexCount; i++) {
-		buffers[i] = i + GL_COLOR_ATTACHMENT0;
-	}
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 
-	glDrawBuffers(buffers.size(), buffers.data());
+	m_size = size;
+
+	return true;
 }
 
-void FBO::bindColorTexture(int texture_index, int unit)
+void Buffer::destroy()
 {
-	glActiveTexture(unit + GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, getColorTex(texture_index));
+	glDeleteBuffers(1, &m_buffer);
+	m_buffer = 0;
+	m_size = 0;
 }
 
-void FBO::bindDepthTexture(int unit)
+bool Buffer::isCreated() const
 {
-	glActiveTexture(unit + GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, getDepthTex());
+	return (m_buffer != 0);
 }
 
-void FBO::unbindTexture()
+void Buffer::bindBase(GLenum target, int index)
 {
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBufferBase(target, index, m_buffer);
 }
 
-GLuint FBO::getFBO() const
+void Buffer::bind(GLenum target)
 {
-	return m_fbo;
+	glBindBuffer(target, m_buffer);
 }
 
-GLuint FBO::getDepthTex() const
+void Buffer::unbind(GLenum target)
 {
-	return m_depthTex;
+	glBindBuffer(target, 0);
 }
 
-GLuint FBO::getColorTex(int texture_index) const
+void Buffer::update(size_t offset, size_t size, const void *data)
 {
-	if (texture_index < 0 || texture_index > m_colorTexCount)
-		return 0;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
 
-	return m_colorTex[texture_index];
+void Buffer::clear()
+{
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R8, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 }
 
-int FBO::getWidth() const
+void Buffer::read(size_t offset, size_t size, void *data)
 {
-	return m_width;
+	glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, offset, size, data);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
 }
 
-int FBO::getHeight() const
+GLuint Buffer::getBuffer() const
 {
-	return m_height;
+	return m_buffer;
 }
 
-int FBO::getColorTexCount() const
+size_t Buffer::getSize() const
 {
-	return m_colorTexCount;
+	return m_size;
 }
 
 /*////////////////////////////////////////////////////////////////////////*/
 /*																		  */
-/* TEXTURE																  */
+/* Stream Buffer														  */
 /*																		  */
 /*////////////////////////////////////////////////////////////////////////*/
 
-Texture::~Texture()
+StreamBuffer::~StreamBuffer()
 {
-	if (isLoaded())
-		unload();
+	if (isCreated())
+		destroy();
 }
 
-bool Texture::load(const char *image_file)
+StreamBuffer::StreamBuffer(StreamBuffer&& other) noexcept
 {
-	stbi_set_flip_vertically_on_load(true);
+	*this = std::move(other);
+}
 
-	int channel;
-	auto data = stbi_load(image_file, &m_width, &m_height, &channel, 0);
+StreamBuffer& StreamBuffer::operator=(StreamBuffer&& other) noexcept
+{
+	if (this == &other)
+		return *this;
 
-	if (!data) {
-		puts("input image file!");
+	if (isCreated())
+		destroy();
+
+	// fences and the persistent mapping belong to the buffer name, they move with it.
+	m_buffer = std::exchange(other.m_buffer, 0);
+	m_size = std::exchange(other.m_size, 0);
+	m_mapped = std::exchange(other.m_mapped, nullptr);
+	m_head = std::exchange(other.m_head, 0);
+	m_segmentBegin = std::exchange(other.m_segmentBegin, 0);
+	m_segments = std::move(other.m_segments);
+	other.m_segments.clear();
+	m_writtenBytes = std::exchange(other.m_writtenBytes, 0);
+	m_stallCount = std::exchange(other.m_stallCount, 0);
+
+	return *this;
+}
+
+bool StreamBuffer::create(size_t size)
+{
+	if (size == 0)
 		return false;
-	}
 
-	GLenum format = (channel == 3) ? GL_RGB : GL_RGBA;
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
 
-	glGenTextures(1, &m_texture);
-	glBindTexture(GL_TEXTURE_2D, m_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+		m_mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+	}
+	else {
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, format, m_width, m_height, 0, format, GL_UNSIGNED_BYTE, data);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 
-	stbi_image_free(data);
+	m_size = size;
+	m_head = 0;
+	m_segmentBegin = 0;
 
 	return true;
 }
 
-void Texture::unload()
+void StreamBuffer::destroy()
 {
-	glDeleteTextures(1, &m_texture);
-	m_texture = 0;
+	for (auto& segment : m_segments)
+		glDeleteSync(segment.fence);
+	m_segments.clear();
+
+	if (m_mapped) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		m_mapped = nullptr;
+	}
+
+	glDeleteBuffers(1, &m_buffer);
+	m_buffer = 0;
+	m_size = 0;
 }
 
-bool Texture::isLoaded() const
+bool StreamBuffer::isCreated() const
 {
-	return (m_texture != 0);
+	return (m_buffer != 0);
 }
 
-GLuint Texture::getTexture() const
+bool StreamBuffer::isPersistent() const
 {
-	return m_texture;
+	return (m_mapped != nullptr);
 }
 
-void Texture::bind(int bind)
+size_t StreamBuffer::write(const void *data, size_t size)
 {
-	glActiveTexture(bind + GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_texture);
+	if (size > m_size)
+		return INVALID_OFFSET;
+
+	// keep offsets 16 byte aligned
+	size_t aligned = (size + 15) & ~(size_t)15;
+
+	if (m_head + aligned > m_size) {
+		if (m_mapped) {
+			fence();
+			m_head = 0;
+			m_segmentBegin = 0;
+		}
+		else {
+			// orphaning: the driver gives new storage, old data stays for the gpu.
+			glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, m_size, nullptr, GL_STREAM_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			m_head = 0;
+		}
+	}
+
+	size_t offset = m_head;
+
+	if (m_mapped) {
+		waitFor(offset, offset + size);
+		memcpy(m_mapped + offset, data, size);
+	}
+	else {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	m_head += aligned;
+	m_writtenBytes += size;
+
+	return offset;
 }
 
-void Texture::unbind()
+void StreamBuffer::fence()
 {
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	if (!m_mapped || m_head == m_segmentBegin)
+		return;
+
+	m_segments.push_back({ m_segmentBegin, m_head, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+	m_segmentBegin = m_head;
+}
+
+void StreamBuffer::waitFor(size_t begin, size_t end)
+{
+	// the oldest segments are right after the head.
+	while (!m_segments.empty()) {
+		Segment& segment = m_segments.front();
+		if (segment.end <= begin || segment.begin >= end)
+			break;
+
+		GLenum state = glClientWaitSync(segment.fence, 0, 0);
+		if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) {
+			m_stallCount++;
+			glClientWaitSync(segment.fence, GL_SYNC_FLUSH_COMMANDS_BIT, ~(GLuint64)0);
+		}
+
+		glDeleteSync(segment.fence);
+		m_segments.pop_front();
+	}
+}
+
+GLuint StreamBuffer::getBuffer() const
+{
+	return m_buffer;
+}
+
+size_t StreamBuffer::getSize() const
+{
+	return m_size;
+}
+
+uint64_t StreamBuffer::getWrittenBytes() const
+{
+	return m_writtenBytes;
+}
+
+uint64_t StreamBuffer::getStallCount() const
+{
+	return m_stallCount;
 }
 
 /*////////////////////////////////////////////////////////////////////////*/
@@ -741,9 +2192,7 @@ QuadRenderer::~QuadRenderer()
 void QuadRenderer::use()
 {
 	m_quadShader.use();
-
-	setBorder(0.01f);
-	setBorderColor(0.5f, 0.5f, 0.5f);
+	glBindVertexArray(m_vao);
 }
 
 void QuadRenderer::create(int row, int col)
@@ -756,14 +2205,29 @@ void QuadRenderer::create(int row, int col)
 	offset_x = 1.f / col - 1.f;
 	offset_y = 1.f - 1.f / row;
 
-	if (m_quadShader.isLoaded())
-		m_quadShader.unload();
+	if (isCreated())
+		destroy();
+
+	m_bindless = (GLEW_ARB_bindless_texture == GL_TRUE);
+
+	// core profile needs a vertex array object even without attributes.
+	glGenVertexArrays(1, &m_vao);
 
 	loadShader();
 }
 
 void QuadRenderer::destroy()
 {
+	for (auto& handle : m_handles)
+		glMakeTextureHandleNonResidentARB(handle.second);
+	m_handles.clear();
+
+	m_tiles.clear();
+	m_tileBuffer.destroy();
+
+	glDeleteVertexArrays(1, &m_vao);
+	m_vao = 0;
+
 	m_quadShader.unload();
 }
 
@@ -774,76 +2238,178 @@ bool QuadRenderer::isCreated() const
 
 void QuadRenderer::unuse()
 {
+	flush();
+
+	glBindVertexArray(0);
 	Shader::unuse();
 	Texture::unbind();
 }
 
 void QuadRenderer::setBorder(float coef)
 {
-	glUniform2f(SL_border_coef, coef, 1.f - coef);
+	m_borderCoef = coef;
 }
 
 void QuadRenderer::setBorderColor(float r, float g, float b)
 {
-	glUniform3f(SL_border_color, r, g, b);
+	m_borderColor[0] = r;
+	m_borderColor[1] = g;
+	m_borderColor[2] = b;
 }
 
 void QuadRenderer::render(int row, int col, GLuint texture)
 {
-	float pos_x = offset_x + 2.f * w * col;
-	float pos_y = offset_y - 2.f * h * row;
+	Tile tile;
+
+	tile.data.rect[0] = offset_x + 2.f * w * col;
+	tile.data.rect[1] = offset_y - 2.f * h * row;
+	tile.data.rect[2] = w;
+	tile.data.rect[3] = h;
+	tile.data.border_coef[0] = m_borderCoef;
+	tile.data.border_coef[1] = 1.f - m_borderCoef;
+	tile.data.handle[0] = 0;
+	tile.data.handle[1] = 0;
+	tile.data.border_color[0] = m_borderColor[0];
+	tile.data.border_color[1] = m_borderColor[1];
+	tile.data.border_color[2] = m_borderColor[2];
+	tile.data.border_color[3] = 1.f;
+	tile.texture = texture;
+
+	m_tiles.push_back(tile);
+}
 
-	float tmat[] = {
-		1, 0, 0, 0,
-		0, 1, 0, 0,
-		0, 0, 1, 0,
-		pos_x, pos_y, 0.f, 1.f
-	};
+void QuadRenderer::flush()
+{
+	if (m_tiles.empty())
+		return;
 
-	float smat[] = {
-		w, 0, 0, 0,
-		0, h, 0, 0,
-		0, 0, 1, 0,
-		0, 0, 0, 1
-	};
+	// without bindless handles, tiles are grouped by texture.
+	if (!m_bindless) {
+		std::stable_sort(m_tiles.begin(), m_tiles.end(),
+			[](const Tile& a, const Tile& b) { return a.texture < b.texture; });
+	}
 
-	glUniformMatrix4fv(SL_tmat, 1, GL_FALSE, tmat);
-	glUniformMatrix4fv(SL_smat, 1, GL_FALSE, smat);
+	m_tileData.resize(m_tiles.size());
+	for (size_t i = 0; i < m_tiles.size(); i++) {
+		m_tileData[i] = m_tiles[i].data;
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture);
+		if (m_bindless) {
+			GLuint64 handle = getHandle(m_tiles[i].texture);
+			m_tileData[i].handle[0] = (GLuint)(handle & 0xFFFFFFFFu);
+			m_tileData[i].handle[1] = (GLuint)(handle >> 32);
+		}
+	}
+
+	size_t size = sizeof(TileData) * m_tileData.size();
+	if (m_tileBuffer.getSize() < size) {
+		if (m_tileBuffer.isCreated())
+			m_tileBuffer.destroy();
+		m_tileBuffer.create(size, nullptr, GL_STREAM_DRAW);
+	}
+	m_tileBuffer.update(0, size, m_tileData.data());
+	m_tileBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (m_bindless) {
+		glUniform1i(SL_base_instance, 0);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)m_tiles.size());
+	}
+	else {
+		glActiveTexture(GL_TEXTURE0);
+
+		size_t first = 0;
+		for (size_t i = 1; i <= m_tiles.size(); i++) {
+			if (i == m_tiles.size() || m_tiles[i].texture != m_tiles[first].texture) {
+				glBindTexture(GL_TEXTURE_2D, m_tiles[first].texture);
+				glUniform1i(SL_base_instance, (GLint)first);
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)(i - first));
+				first = i;
+			}
+		}
+	}
+
+	m_tiles.clear();
+}
+
+bool QuadRenderer::hitTile(float x, float y, int& row, int& col, float& s, float& t) const
+{
+	if (x < 0.f || y < 0.f || x >= 1.f || y >= 1.f)
+		return false;
+
+	col = (int)(x * m_col);
+	row = (int)(y * m_row);
+	s = x * m_col - col;
+	t = 1.f - (y * m_row - row);
+
+	return true;
+}
+
+GLuint64 QuadRenderer::getHandle(GLuint texture)
+{
+	for (auto& handle : m_handles) {
+		if (handle.first == texture)
+			return handle.second;
+	}
+
+	GLuint64 handle = glGetTextureHandleARB(texture);
+	glMakeTextureHandleResidentARB(handle);
+	m_handles.push_back({ texture, handle });
+
+	return handle;
+}
 
-	glDrawArrays(GL_QUADS, 0, 4);
+void QuadRenderer::forget(GLuint texture)
+{
+	for (size_t i = 0; i < m_handles.size(); i++) {
+		if (m_handles[i].first == texture) {
+			glMakeTextureHandleNonResidentARB(m_handles[i].second);
+			m_handles[i] = m_handles.back();
+			m_handles.pop_back();
+			return;
+		}
+	}
 }
 
 void QuadRenderer::loadShader()
 {
 	const char* vertexSource = R"(
 // Vertex Shader
-#version 430 core
 
 const vec2 aPosition[4] = {
 	vec2(-1, -1),
 	vec2(1, -1),
-	vec2(1, 1),
 	vec2(-1, 1),
+	vec2(1, 1),
 };
 
 const vec2 aTexCoord[4] = {
 	vec2(0, 0),
 	vec2(1, 0),
-	vec2(1, 1),
 	vec2(0, 1),
+	vec2(1, 1),
 };
 
-out vec2 texCoord;
+struct Tile {
+	vec4 rect;
+	vec2 border_coef;
+	uvec2 handle;
+	vec4 border_color;
+};
+
+layout(std430, binding = 0) readonly buffer Tiles {
+	Tile tiles[];
+};
+
+layout(location = 0) uniform int base_instance;
 
-layout(location = 0) uniform mat4 tmat;
-layout(location = 1) uniform mat4 smat;
+out vec2 texCoord;
+flat out int tile;
 
 void main()
 {
-	gl_Position = tmat * smat * vec4(aPosition[gl_VertexID], 0, 1);
+	tile = base_instance + gl_InstanceID;
+	vec4 rect = tiles[tile].rect;
+
+	gl_Position = vec4(rect.xy + rect.zw * aPosition[gl_VertexID], 0, 1);
 
 	texCoord = aTexCoord[gl_VertexID];
 }
@@ -852,34 +2418,54 @@ void main()
 
 	const char* fragSource = R"(
 // Fragment Shader
-#version 430 core
 
-layout(binding = 0) uniform sampler2D map;
+struct Tile {
+	vec4 rect;
+	/*
+		st:
+		s: value for comparing left and up.
+		t: value for comparing right and down.
+	*/
+	vec2 border_coef;
+	uvec2 handle;
+	vec4 border_color;
+};
 
-/*
-	st:
-	s: value for comparing left and up.
-	t: value for comparing right and down.
-*/
-layout(location = 2) uniform vec2 border_coef;
-layout(location = 3) uniform vec3 border_color;
+layout(std430, binding = 0) readonly buffer Tiles {
+	Tile tiles[];
+};
+
+#ifndef USE_BINDLESS
+layout(binding = 0) uniform sampler2D map;
+#endif
 
 in vec2 texCoord;
+flat in int tile;
 
 layout(location = 0) out vec4 frag_color;
 
 void main()
 {
+	vec2 border_coef = tiles[tile].border_coef;
+
 	if( texCoord.x <= border_coef.s || texCoord.x >= border_coef.t ||
 		texCoord.y <= border_coef.s || texCoord.y >= border_coef.t) 
 	{
-		frag_color = vec4(border_color, 1);
+		frag_color = tiles[tile].border_color;
 		return;
 	}
+#ifdef USE_BINDLESS
+	frag_color = texture(sampler2D(tiles[tile].handle), texCoord);
+#else
 	frag_color = texture(map, texCoord);
+#endif
 }
 
 )";
 
-	m_quadShader.loadFromSource(vertexSource, fragSource);
-}
+	std::string header = m_bindless ?
+		"#version 430 core\n#extension GL_ARB_bindless_texture : require\n#define USE_BINDLESS\n" :
+		"#version 430 core\n";
+
+	m_quadShader.loadFromSource((header + vertexSource).c_str(), (header + fragSource).c_str());
+}
\ No newline at end of file
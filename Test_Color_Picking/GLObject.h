@@ -1,7 +1,13 @@
 #pragma once
 #include <gl/GL.h>
+#include <cstdint>
+#include <deque>
 #include <initializer_list>
 #include <string>
+#include <utility>
+#include <vector>
+#include "BVH.h"
+#include "VertexLayout.h"
 
 /*
 	return:
@@ -17,18 +23,155 @@ const char * getGLErrorStr(GLenum err);
 /*															*/
 /************************************************************/
 
+/*
+	gl objects own their names: they are move-only, and a moved-from
+	object is empty (as after unload() / destroy()).
+*/
+
+/*
+	ring buffer for streaming uploads.
+	with GL_ARB_buffer_storage it is persistently mapped, and each flushed
+	segment is guarded by a fence, so write() waits only if the gpu is still
+	reading the oldest data. otherwise the buffer is orphaned when it wraps.
+
+	usage:
+	offset = write(data, size)	-> copy from getBuffer() at offset
+	fence()						-> after the commands reading this frame's data
+*/
+class StreamBuffer
+{
+	struct Segment {
+		size_t begin;
+		size_t end;
+		GLsync fence;
+	};
+
+	GLuint m_buffer = 0;
+	size_t m_size = 0;
+	char *m_mapped = nullptr;
+	size_t m_head = 0;
+	size_t m_segmentBegin = 0;
+	std::deque<Segment> m_segments;
+
+	// statistics
+	uint64_t m_writtenBytes = 0;
+	uint64_t m_stallCount = 0;
+
+public:
+	static constexpr size_t INVALID_OFFSET = ~(size_t)0;
+
+	StreamBuffer() = default;
+	~StreamBuffer();
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+	StreamBuffer(StreamBuffer&& other) noexcept;
+	StreamBuffer& operator=(StreamBuffer&& other) noexcept;
+
+	bool create(size_t size);
+	void destroy();
+	bool isCreated() const;
+	bool isPersistent() const;
+
+	/*
+		return: offset of the data in the buffer.
+		INVALID_OFFSET if size is larger than the buffer.
+	*/
+	size_t write(const void *data, size_t size);
+	/*
+		fences the data written since the last fence().
+	*/
+	void fence();
+
+	GLuint getBuffer() const;
+	size_t getSize() const;
+	uint64_t getWrittenBytes() const;
+	/*
+		return: number of fences that were not signaled when write() needed
+		their space (the cpu waited for the gpu).
+	*/
+	uint64_t getStallCount() const;
+
+private:
+	void waitFor(size_t begin, size_t end);
+};
+
 //Vertex Array Object
 class VAO
 {
+public:
+	/*
+		sub mesh started by o, g or usemtl in the obj file.
+		vertices [first, first + count), triangles are first / 3 ~.
+	*/
+	struct Part {
+		std::string name;
+		int first = 0;
+		int count = 0;
+		AABB bounds;
+	};
+
+private:
+	// glMultiDrawArraysIndirect command
+	struct DrawCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+
 	GLuint m_vao = 0;
 	GLuint m_vbo = 0;
 	int m_faceCount = 0;
+	// layout of m_vbo: byte offset and per vertex stride of each section, stride 0 if absent
+	size_t m_sectionOffset[VS_COUNT] = {};
+	size_t m_sectionStride[VS_COUNT] = {};
+	MeshBVH m_bvh;
+	AABB m_bounds;
+
+	// streaming updates: cpu copy (positions, then normals if the layout has them)
+	// and dirty vertex ranges [first, last)
+	std::vector<float> m_shadow;
+	std::vector<std::pair<int, int>> m_dirtyPositions;
+	std::vector<std::pair<int, int>> m_dirtyNormals;
+	StreamBuffer m_stream;
+
+	// sub meshes, drawn with one multi draw (renderParts)
+	std::vector<Part> m_parts;
+	std::vector<uint8_t> m_partVisible;
+	std::vector<DrawCommand> m_commands;		// one per part, sized by endParts()
+	GLuint m_indirect = 0;
+	int m_indirectInstances = -1;
+	int m_indirectBase = -1;
 
 public:
 	VAO() = default;
 	~VAO();
+	VAO(const VAO&) = delete;
+	VAO& operator=(const VAO&) = delete;
+	VAO(VAO&& other) noexcept;
+	VAO& operator=(VAO&& other) noexcept;
 
 	bool load(const char *obj_file);
+	/*
+		streaming import for large files, same buffer layout as load().
+		the file is read twice in fixed size windows: a pre-pass counts the
+		elements, then faces are expanded straight into the mapped vertex buffer.
+		host memory holds only the unique v, vt, vn and one window.
+		polygons are split into fans, negative (relative) indices are allowed.
+
+		build_bvh:
+		the bvh keeps its own copy of the expanded positions. without it
+		getBounds() still works but getBVH() is empty (no cpu raycast).
+	*/
+	bool loadStreaming(const char *obj_file, bool build_bvh = true);
+	/*
+		triangle list from memory (positions and normals, xyz per vertex).
+		no bvh is built, getBounds() is computed from the positions.
+		parts: empty for one part.
+		texcoords: u, v per vertex, nullptr for none.
+	*/
+	bool create(const float *positions, const float *normals, int vertex_count,
+		const std::vector<Part>& parts = {}, const float *texcoords = nullptr);
 	void unload();
 	bool isLoaded() const;
 
@@ -45,12 +188,85 @@ public:
 		render()
 	*/
 	void bind_render();
+	/*
+		pending vertex updates are uploaded first (flushUpdates).
+	*/
 	void bind();
 	void render();
+	/*
+		instance_count instances starting from base_instance.
+		instance index is read at attribute location 3 (see setInstanceBuffer).
+	*/
+	void renderInstanced(int instance_count, int base_instance = 0);
+	/*
+		same as renderInstanced, but draws the visible parts with one
+		glMultiDrawArraysIndirect call.
+	*/
+	void renderParts(int instance_count, int base_instance = 0);
 	static void unbind();
 
+	/*
+		instance_buffer:
+		one GLuint per instance, bound to attribute location 3 with divisor 1.
+	*/
+	void setInstanceBuffer(GLuint instance_buffer);
+
+	/*
+		updates vertices [first, first + count). normals may be nullptr.
+		ranges are merged and only changed bytes are uploaded by flushUpdates(),
+		copied on the gpu from a stream buffer, so the cpu does not wait for
+		draws that still use the old data. the bvh is refitted once per flush.
+		return: false if the range is invalid, or normals are given and the
+		layout has none.
+	*/
+	bool updateVertices(int first, int count, const float *positions, const float *normals = nullptr);
+	void flushUpdates();
+	int getVertexCount() const;
+	/*
+		reads the positions back from the vertex buffer (xyz per vertex).
+	*/
+	void readPositions(std::vector<float>& positions) const;
+	/*
+		reads the texcoords back (u, v per vertex).
+		return: false if the buffer has none.
+	*/
+	bool readTexCoords(std::vector<float>& texcoords) const;
+	/*
+		triangle i becomes triangle order[i] of the current buffer (all attributes).
+		order must keep each triangle inside its part, the bvh is rebuilt.
+	*/
+	void reorderTriangles(const std::vector<int>& order);
+	const StreamBuffer& getStream() const;
+
 	GLuint getVAO() const;
 	GLuint getVBO() const;
+	/*
+		bvh and bounds of the triangles in object space, built by load().
+	*/
+	const MeshBVH& getBVH() const;
+	AABB getBounds() const;
+
+	/*
+		a file without o, g or usemtl has one part.
+	*/
+	int getPartCount() const;
+	const Part& getPart(int part) const;
+	/*
+		return: part of the triangle (see PickResult::triangle), -1 if none.
+	*/
+	int findPart(int triangle) const;
+	void setPartVisible(int part, bool visible);
+	bool isPartVisible(int part) const;
+
+private:
+	/*
+		closes the current part at vertex first and starts a new one.
+	*/
+	void beginPart(const std::string& name, int first);
+	/*
+		closes the last part and drops empty parts.
+	*/
+	void endParts(int vertex_count);
 };
 
 class Shader
@@ -60,6 +276,10 @@ class Shader
 public:
 	Shader() = default;
 	~Shader();
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+	Shader(Shader&& other) noexcept;
+	Shader& operator=(Shader&& other) noexcept;
 
 	/*
 		file:
@@ -72,7 +292,19 @@ public:
 		*.frag
 	*/
 	bool load(const char *vert_file, const char *frag_File);
+	/*
+		vert_file,geom_file,frag_file:
+		*.vert
+		*.geom
+		*.frag
+	*/
+	bool load(const char *vert_file, const char *geom_file, const char *frag_file);
 	bool loadFromSource(const char *vert, const char *frag);
+	/*
+		comp_file:
+		*.comp
+	*/
+	bool loadCompute(const char *comp_file);
 	void unload();
 	bool isLoaded() const;
 
@@ -93,14 +325,24 @@ class FBO
 
 	GLuint m_fbo = 0;
 	GLuint m_depthTex = 0;
-	GLuint m_colorTex[MAX_COLOR_TEXTURE];
+	bool m_ownsDepth = true;
+	GLuint m_colorTex[MAX_COLOR_TEXTURE] = {};
 	int m_colorTexCount = 0;
-	int m_width;
-	int m_height;
+	int m_width = 0;
+	int m_height = 0;
+
+	// layered (GL_TEXTURE_2D_ARRAY), 0 if not layered
+	int m_layerCount = 0;
+	GLuint m_readFbo = 0;
+	std::vector<GLuint> m_layerViews;
 
 public:
 	FBO() = default;
 	~FBO();
+	FBO(const FBO&) = delete;
+	FBO& operator=(const FBO&) = delete;
+	FBO(FBO&& other) noexcept;
+	FBO& operator=(FBO&& other) noexcept;
 
 	/*
 		colorFormat:
@@ -109,9 +351,28 @@ public:
 	*/
 	bool create(int width, int height, int colorTextureCount = 1, 
 		bool hasDepthTexture = true, GLenum colorFormat = GL_RGBA32F);
+	/*
+		colorFormats:
+		format of each color texture, ex) { GL_RGBA32F, GL_RG32UI }
+	*/
+	bool create(int width, int height, const std::vector<GLenum>& colorFormats,
+		bool hasDepthTexture = true);
+	/*
+		every texture is a GL_TEXTURE_2D_ARRAY of layerCount layers,
+		and all layers are attached (select the layer with gl_Layer).
+	*/
+	bool createLayered(int width, int height, int layerCount, const std::vector<GLenum>& colorFormats,
+		bool hasDepthTexture = true);
 	void destroy();
 	bool isCreated();
 
+	/*
+		uses the depth texture of other as the depth attachment (same size).
+		the own depth texture is deleted, and other must outlive this FBO.
+		ex) an equal depth pass after a depth pre pass.
+	*/
+	bool shareDepth(const FBO& other);
+
 	/*
 		ο viewport ȣմϴ.
 	*/
@@ -133,24 +394,51 @@ public:
 		create()  ؼ   ⺻ ȣ˴ϴ.
 	*/
 	void setAllDrawbuffers();
+
+	/*
+		reads one pixel of the color texture as GL_RGBA, GL_FLOAT into rgba[4].
+		it waits until rendering is finished.
+	*/
+	void readPixel(int x, int y, float *rgba, int texture_index = 0);
 	
 	GLuint getFBO() const;
+	/*
+		framebuffer to read one layer with glReadPixels.
+		it is getFBO() if not layered.
+	*/
+	GLuint getReadFBO(int layer = 0) const;
 	GLuint getDepthTex() const;
 	GLuint getColorTex(int texture_index = 0) const;
+	/*
+		GL_TEXTURE_2D view of one layer, for QuadRenderer and samplers.
+	*/
+	GLuint getLayerTex(int texture_index, int layer) const;
 	int getWidth() const;
 	int getHeight() const;
 	int getColorTexCount() const;
+	/*
+		return: layer count, 0 if not layered.
+	*/
+	int getLayerCount() const;
+
+private:
+	bool build(int width, int height, int layerCount, const std::vector<GLenum>& colorFormats,
+		bool hasDepthTexture);
 };
 
 class Texture
 {
-	GLuint m_texture;
-	int m_width;
-	int m_height;
+	GLuint m_texture = 0;
+	int m_width = 0;
+	int m_height = 0;
 
 public:
 	Texture() = default;
 	~Texture();
+	Texture(const Texture&) = delete;
+	Texture& operator=(const Texture&) = delete;
+	Texture(Texture&& other) noexcept;
+	Texture& operator=(Texture&& other) noexcept;
 
 	bool load(const char *image_file);
 	void unload();
@@ -162,6 +450,99 @@ public:
 	GLuint getTexture() const;
 };
 
+/*
+	GL_TIME_ELAPSED timer that never waits.
+	results are collected from queries issued some frames ago.
+*/
+class GpuTimer
+{
+	static constexpr int QUERY_COUNT = 4;
+
+	GLuint m_queries[QUERY_COUNT] = {};
+	int m_head = 0;
+	int m_pendingCount = 0;
+	bool m_running = false;
+	double m_sum = 0.0;
+	double m_last = 0.0;
+	uint64_t m_count = 0;
+
+public:
+	GpuTimer() = default;
+	~GpuTimer();
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+	GpuTimer(GpuTimer&& other) noexcept;
+	GpuTimer& operator=(GpuTimer&& other) noexcept;
+
+	void create();
+	void destroy();
+	bool isCreated() const;
+
+	/*
+		begin() is skipped (returns false) if all queries are in flight.
+	*/
+	bool begin();
+	void end();
+	/*
+		collects finished queries.
+	*/
+	void poll();
+
+	/*
+		return: mean elapsed time in ms.
+	*/
+	double getMean() const;
+	/*
+		return: elapsed time of the last collected query in ms.
+	*/
+	double getLast() const;
+	uint64_t getCount() const;
+};
+
+//Buffer Object
+class Buffer
+{
+	GLuint m_buffer = 0;
+	size_t m_size = 0;
+
+public:
+	Buffer() = default;
+	~Buffer();
+	Buffer(const Buffer&) = delete;
+	Buffer& operator=(const Buffer&) = delete;
+	Buffer(Buffer&& other) noexcept;
+	Buffer& operator=(Buffer&& other) noexcept;
+
+	/*
+		usage:
+		GL_STATIC_DRAW, GL_DYNAMIC_DRAW (default), GL_STREAM_DRAW ...
+	*/
+	bool create(size_t size, const void *data = nullptr, GLenum usage = GL_DYNAMIC_DRAW);
+	void destroy();
+	bool isCreated() const;
+
+	/*
+		target:
+		GL_SHADER_STORAGE_BUFFER, GL_UNIFORM_BUFFER ...
+	*/
+	void bindBase(GLenum target, int index);
+	void bind(GLenum target);
+	static void unbind(GLenum target);
+	void update(size_t offset, size_t size, const void *data);
+	/*
+		fills the whole buffer with zero.
+	*/
+	void clear();
+	/*
+		copies buffer contents to data.
+		it waits until the gpu has written the buffer.
+	*/
+	void read(size_t offset, size_t size, void *data);
+
+	GLuint getBuffer() const;
+	size_t getSize() const;
+};
+
 
 /************************************************************/
 /*															*/
@@ -169,20 +550,44 @@ public:
 /*															*/
 /************************************************************/
 
+/*
+	all tiles queued by render() are drawn by one instanced draw in flush().
+	textures are accessed by bindless handles (GL_ARB_bindless_texture).
+	without the extension, one instanced draw is issued per distinct texture.
+*/
 class QuadRenderer
 {
 	enum ShaderLocation {
-		SL_tmat,
-		SL_smat,
-		SL_border_coef,
-		SL_border_color,
+		SL_base_instance,
+	};
+
+	// per instance data (std430)
+	struct TileData {
+		float rect[4];			// center x, y, half width, half height
+		float border_coef[2];
+		GLuint handle[2];		// bindless handle
+		float border_color[4];
+	};
+
+	struct Tile {
+		TileData data;
+		GLuint texture;
 	};
 
 	Shader m_quadShader;
+	GLuint m_vao = 0;
+	Buffer m_tileBuffer;
+	std::vector<Tile> m_tiles;
+	std::vector<TileData> m_tileData;
+	std::vector<std::pair<GLuint, GLuint64>> m_handles;
+	bool m_bindless = false;
+
 	int m_row;
 	int m_col;
 
 	float w, h, offset_x, offset_y;
+	float m_borderCoef = 0.01f;
+	float m_borderColor[3] = { 0.5f, 0.5f, 0.5f };
 
 public:
 	QuadRenderer();
@@ -194,6 +599,9 @@ public:
 	bool isCreated() const;
 
 	void use();
+	/*
+		flush() is called.
+	*/
 	void unuse();
 	
 	/*
@@ -202,14 +610,33 @@ public:
 		if coef is 0.5, then half of row and column(from outside to inside) is used by border.
 		if coef is 1.0, then all row and column is used by border.
 		default border is 0.01
+		it is applied to tiles rendered after this call.
 	*/
 	void setBorder(float coef);
 	/*
 		default color is gray(0.5, 0.5, 0.5).
+		it is applied to tiles rendered after this call.
 	*/
 	void setBorderColor(float r, float g, float b);
+	/*
+		queues a tile. it is drawn in flush().
+	*/
 	void render(int row, int col, GLuint texture);
+	void flush();
+
+	/*
+		x, y: window position in [0, 1], (0, 0) is top left.
+		s, t: texture coordinate in the tile.
+		return: false if the position is outside of the grid.
+	*/
+	bool hitTile(float x, float y, int& row, int& col, float& s, float& t) const;
+	/*
+		drops the cached bindless handle of texture. call it before the texture
+		is deleted, gl reuses texture names and the handle would be stale.
+	*/
+	void forget(GLuint texture);
 
 private:
 	void loadShader();
+	GLuint64 getHandle(GLuint texture);
 };
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include <cstring>
+#include "InputCapture.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Input Capture														  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+namespace {
+	const char MAGIC[4] = { 'T', 'C', 'P', 'I' };
+}
+
+InputCapture::~InputCapture()
+{
+	if (isRecording())
+		endRecord();
+}
+
+bool InputCapture::beginRecord(const char *path, int width, int height, uint64_t frame_limit)
+{
+	if (isRecording())
+		endRecord();
+
+	fopen_s(&m_file, path, "wb");
+	if (!m_file) {
+		printf("capture: can not create %s\n", path);
+		return false;
+	}
+
+	m_header = {};
+	memcpy(m_header.magic, MAGIC, sizeof(MAGIC));
+	m_header.version = VERSION;
+	m_header.width = width;
+	m_header.height = height;
+	m_frameLimit = frame_limit;
+
+	// counts are written again by endRecord().
+	if (fwrite(&m_header, sizeof(m_header), 1, m_file) != 1) {
+		fclose(m_file);
+		m_file = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+void InputCapture::endRecord()
+{
+	if (!m_file)
+		return;
+
+	fseek(m_file, 0, SEEK_SET);
+	fwrite(&m_header, sizeof(m_header), 1, m_file);
+	fclose(m_file);
+	m_file = nullptr;
+
+	printf("capture: %llu frames, %llu events\n",
+		(unsigned long long)m_header.frameCount, (unsigned long long)m_header.eventCount);
+}
+
+bool InputCapture::isRecording() const
+{
+	return m_file != nullptr;
+}
+
+void InputCapture::recordCursor(double x, double y)
+{
+	write(ET_CURSOR, 0, 0, 0, x, y);
+}
+
+void InputCapture::recordButton(int button, int action, int mods)
+{
+	write(ET_BUTTON, button, action, mods);
+}
+
+void InputCapture::recordKey(int key, int action, int mods)
+{
+	write(ET_KEY, key, action, mods);
+}
+
+void InputCapture::recordSize(int width, int height)
+{
+	write(ET_SIZE, width, height, 0);
+}
+
+void InputCapture::recordFrame(double time)
+{
+	if (!isRecording())
+		return;
+
+	write(ET_FRAME, 0, 0, 0, time);
+	m_header.frameCount++;
+
+	if (m_frameLimit != 0 && m_header.frameCount >= m_frameLimit)
+		endRecord();
+}
+
+bool InputCapture::load(const char *path)
+{
+	FILE *fin;
+	fopen_s(&fin, path, "rb");
+	if (!fin) {
+		printf("capture: can not open %s\n", path);
+		return false;
+	}
+
+	Header header;
+	bool ok = fread(&header, sizeof(header), 1, fin) == 1
+		&& memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION;
+	if (ok) {
+		m_events.resize((size_t)header.eventCount);
+		ok = fread(m_events.data(), sizeof(Event), m_events.size(), fin) == m_events.size();
+	}
+	fclose(fin);
+
+	if (!ok) {
+		printf("capture: %s is not a capture (version %u)\n", path, VERSION);
+		m_events.clear();
+		return false;
+	}
+
+	m_header = header;
+	m_next = 0;
+
+	return true;
+}
+
+int InputCapture::getWidth() const
+{
+	return m_header.width;
+}
+
+int InputCapture::getHeight() const
+{
+	return m_header.height;
+}
+
+uint64_t InputCapture::getFrameCount() const
+{
+	return m_header.frameCount;
+}
+
+void InputCapture::rewind()
+{
+	m_next = 0;
+}
+
+void InputCapture::write(uint32_t type, int a, int b, int c, double x, double y)
+{
+	if (!isRecording())
+		return;
+
+	Event event = { type, a, b, c, x, y };
+	if (fwrite(&event, sizeof(event), 1, m_file) == 1)
+		m_header.eventCount++;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/************************************************************/
+/*															*/
+// Input Capture
+/*															*/
+/************************************************************/
+
+/*
+	records the window input of the main loop frame by frame, and plays
+	it back so the same frames can be rendered again (benchmark, bisect).
+
+	a frame is the input events since the previous frame followed by one
+	ET_FRAME event with the frame time (the animation clock), so a replay
+	renders the same camera, cursor, selection and deformation sequence.
+	results read back asynchronously (picks, region selects) may still
+	arrive a frame earlier or later on another driver.
+
+	file, little endian:
+	Header, Event x eventCount.
+*/
+class InputCapture
+{
+public:
+	static constexpr uint32_t VERSION = 1;
+
+	enum EventType : uint32_t {
+		ET_FRAME,		// x: time in seconds
+		ET_CURSOR,		// x, y: cursor position
+		ET_BUTTON,		// a: button, b: action, c: mods
+		ET_KEY,			// a: key, b: action, c: mods
+		ET_SIZE,		// a, b: framebuffer width, height
+	};
+
+	struct Header {
+		char magic[4];			// "TCPI"
+		uint32_t version;
+		int32_t width;			// framebuffer size at the start
+		int32_t height;
+		uint64_t frameCount;
+		uint64_t eventCount;
+	};
+
+	struct Event {
+		uint32_t type;
+		int32_t a, b, c;
+		double x, y;
+	};
+
+private:
+	// recording
+	FILE *m_file = nullptr;
+	Header m_header = {};
+	uint64_t m_frameLimit = 0;
+
+	// replay
+	std::vector<Event> m_events;
+	size_t m_next = 0;
+
+public:
+	InputCapture() = default;
+	~InputCapture();
+	InputCapture(const InputCapture&) = delete;
+	InputCapture& operator=(const InputCapture&) = delete;
+
+	/*
+		frame_limit:
+		recording stops after this many frames, 0 records until endRecord().
+	*/
+	bool beginRecord(const char *path, int width, int height, uint64_t frame_limit = 0);
+	/*
+		writes the frame and event counts and closes the file.
+	*/
+	void endRecord();
+	bool isRecording() const;
+
+	void recordCursor(double x, double y);
+	void recordButton(int button, int action, int mods);
+	void recordKey(int key, int action, int mods);
+	void recordSize(int width, int height);
+	/*
+		closes the frame, call once per rendered frame before rendering.
+	*/
+	void recordFrame(double time);
+
+	/*
+		reads a whole capture for replay.
+	*/
+	bool load(const char *path);
+	int getWidth() const;
+	int getHeight() const;
+	uint64_t getFrameCount() const;
+
+	/*
+		calls fn(event) for each input event of the next frame.
+		time: recorded frame time.
+		return: false if no frame is left.
+	*/
+	template <typename Fn>
+	bool replayFrame(double& time, Fn fn) {
+		while (m_next < m_events.size()) {
+			const Event& event = m_events[m_next++];
+			if (event.type == ET_FRAME) {
+				time = event.x;
+				return true;
+			}
+			fn(event);
+		}
+
+		return false;
+	}
+	void rewind();
+
+private:
+	void write(uint32_t type, int a, int b, int c, double x = 0.0, double y = 0.0);
+};
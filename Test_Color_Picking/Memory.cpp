@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include "Memory.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Arena																  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+Arena::Arena(size_t block_size)
+	: m_blockSize(block_size)
+{
+}
+
+Arena::~Arena()
+{
+	while (m_blocks) {
+		Block *next = m_blocks->next;
+		free(m_blocks);
+		m_blocks = next;
+	}
+}
+
+void* Arena::allocate(size_t size, size_t alignment)
+{
+	uintptr_t cursor = ((uintptr_t)m_cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	if (!m_cursor || cursor + size > (uintptr_t)m_end) {
+		addBlock(std::max(m_blockSize, size + alignment));
+		cursor = ((uintptr_t)m_cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	}
+
+	m_used += cursor + size - (uintptr_t)m_cursor;
+	m_peak = std::max(m_peak, m_used);
+	m_cursor = (char*)(cursor + size);
+
+	return (void*)cursor;
+}
+
+void Arena::reserve(size_t size)
+{
+	if (!m_cursor || (size_t)(m_end - m_cursor) < size)
+		addBlock(size + alignof(std::max_align_t));
+}
+
+void Arena::reset()
+{
+	// the largest block stays.
+	Block *largest = m_blocks;
+	for (Block *block = m_blocks; block; block = block->next)
+		if (block->size > largest->size)
+			largest = block;
+
+	while (m_blocks) {
+		Block *next = m_blocks->next;
+		if (m_blocks != largest)
+			free(m_blocks);
+		m_blocks = next;
+	}
+
+	m_blocks = largest;
+	m_used = 0;
+	if (largest) {
+		largest->next = nullptr;
+		m_cursor = (char*)(largest + 1);
+		m_end = m_cursor + largest->size;
+	}
+	else {
+		m_cursor = m_end = nullptr;
+	}
+}
+
+size_t Arena::getUsed() const
+{
+	return m_used;
+}
+
+size_t Arena::getPeak() const
+{
+	return m_peak;
+}
+
+size_t Arena::getCapacity() const
+{
+	size_t capacity = 0;
+	for (Block *block = m_blocks; block; block = block->next)
+		capacity += block->size;
+
+	return capacity;
+}
+
+void Arena::addBlock(size_t size)
+{
+	// blocks bypass operator new, the arena is scratch and not charged per use.
+	Block *block = (Block*)malloc(sizeof(Block) + size);
+	if (!block)
+		throw std::bad_alloc();
+
+	block->next = m_blocks;
+	block->size = size;
+	m_blocks = block;
+	m_cursor = (char*)(block + 1);
+	m_end = m_cursor + size;
+}
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Memory Tracker														  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+namespace {
+	// constant initialized, usable by allocations before main.
+	struct Counter {
+		std::atomic<uint64_t> allocations;
+		std::atomic<uint64_t> bytes;
+		std::atomic<uint64_t> current;
+		std::atomic<uint64_t> peak;
+	};
+
+	Counter g_counters[MS_COUNT];
+	thread_local MemorySubsystem g_current = MS_OTHER;
+
+	// size and subsystem in front of each block, keeps malloc alignment.
+	struct alignas(16) Header {
+		uint64_t size;
+		uint64_t subsystem;
+	};
+
+	void* trackedAlloc(size_t size)
+	{
+		Header *header = (Header*)malloc(sizeof(Header) + size);
+		if (!header)
+			return nullptr;
+
+		Counter& counter = g_counters[g_current];
+		header->size = size;
+		header->subsystem = g_current;
+
+		counter.allocations.fetch_add(1, std::memory_order_relaxed);
+		counter.bytes.fetch_add(size, std::memory_order_relaxed);
+		uint64_t current = counter.current.fetch_add(size, std::memory_order_relaxed) + size;
+		uint64_t peak = counter.peak.load(std::memory_order_relaxed);
+		while (current > peak && !counter.peak.compare_exchange_weak(peak, current, std::memory_order_relaxed));
+
+		return header + 1;
+	}
+
+	void trackedFree(void *p)
+	{
+		if (!p)
+			return;
+
+		Header *header = (Header*)p - 1;
+		g_counters[header->subsystem].current.fetch_sub(header->size, std::memory_order_relaxed);
+		free(header);
+	}
+}
+
+void* operator new(size_t size)
+{
+	void *p = trackedAlloc(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	void *p = trackedAlloc(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return trackedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return trackedAlloc(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{
+	trackedFree(p);
+}
+
+MemoryTracker::Stats MemoryTracker::getStats(MemorySubsystem subsystem)
+{
+	const Counter& counter = g_counters[subsystem];
+	return { counter.allocations.load(), counter.bytes.load(), counter.current.load(), counter.peak.load() };
+}
+
+const char* MemoryTracker::getName(MemorySubsystem subsystem)
+{
+	static const char *names[MS_COUNT] = { "other", "load", "frame" };
+	return names[subsystem];
+}
+
+MemorySubsystem MemoryTracker::getCurrent()
+{
+	return g_current;
+}
+
+void MemoryTracker::printStats()
+{
+	for (int i = 0; i < MS_COUNT; i++) {
+		Stats stats = getStats((MemorySubsystem)i);
+		printf("heap %s: %llu allocations, %.1f MB, peak %.1f MB, %.1f MB live\n", getName((MemorySubsystem)i),
+			(unsigned long long)stats.allocations, (double)stats.bytes / (1024.0 * 1024.0),
+			(double)stats.peak / (1024.0 * 1024.0), (double)stats.current / (1024.0 * 1024.0));
+	}
+}
+
+void MemoryTracker::setCurrent(MemorySubsystem subsystem)
+{
+	g_current = subsystem;
+}
+
+MemoryScope::MemoryScope(MemorySubsystem subsystem)
+	: m_previous(MemoryTracker::getCurrent())
+{
+	MemoryTracker::setCurrent(subsystem);
+}
+
+MemoryScope::~MemoryScope()
+{
+	MemoryTracker::setCurrent(m_previous);
+}
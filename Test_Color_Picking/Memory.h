@@ -0,0 +1,150 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+/************************************************************/
+/*															*/
+// Arena
+/*															*/
+/************************************************************/
+
+/*
+	linear allocator for scratch memory with one owner and one lifetime
+	(a load, a frame). allocate() bumps a pointer, nothing is freed one by one,
+	reset() makes the whole arena reusable and keeps the largest block.
+
+	block_size:
+	size of a new block, bigger requests get a block of their own size.
+*/
+class Arena
+{
+	struct Block {
+		Block *next;
+		size_t size;
+	};
+
+	Block *m_blocks = nullptr;		// newest first
+	char *m_cursor = nullptr;
+	char *m_end = nullptr;
+	size_t m_blockSize;
+	size_t m_used = 0;
+	size_t m_peak = 0;
+
+public:
+	explicit Arena(size_t block_size = 1 << 20);
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+	/*
+		uninitialized array of count T, for trivial types.
+	*/
+	template <typename T>
+	T* allocateArray(size_t count) {
+		return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+	}
+	/*
+		makes room for size bytes in one block, so the next allocations
+		up to size bytes do not allocate.
+	*/
+	void reserve(size_t size);
+	/*
+		frees every block but the largest, which is reused.
+	*/
+	void reset();
+
+	size_t getUsed() const;
+	size_t getPeak() const;
+	size_t getCapacity() const;
+
+private:
+	void addBlock(size_t size);
+};
+
+/*
+	std allocator on an arena, deallocate() does nothing.
+	ex) ScratchVector<float> values{ ArenaAllocator<float>(arena) };
+*/
+template <typename T>
+class ArenaAllocator
+{
+	template <typename U> friend class ArenaAllocator;
+
+	Arena *m_arena;
+
+public:
+	using value_type = T;
+
+	explicit ArenaAllocator(Arena& arena) : m_arena(&arena) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+	T* allocate(size_t count) {
+		return static_cast<T*>(m_arena->allocate(sizeof(T) * count, alignof(T)));
+	}
+	void deallocate(T*, size_t) {}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; }
+};
+
+template <typename T>
+using ScratchVector = std::vector<T, ArenaAllocator<T>>;
+
+/************************************************************/
+/*															*/
+// Memory Tracker
+/*															*/
+/************************************************************/
+
+enum MemorySubsystem {
+	MS_OTHER,
+	MS_LOAD,		// scene, mesh and lod creation
+	MS_FRAME,		// Scene::render
+	MS_COUNT,
+};
+
+/*
+	counts the heap allocations (global operator new) of each subsystem.
+	the subsystem of the current thread is set by MemoryScope, and a block
+	is charged back to the subsystem that allocated it when it is freed.
+	threads started inside a scope count as MS_OTHER.
+*/
+class MemoryTracker
+{
+public:
+	struct Stats {
+		uint64_t allocations;
+		uint64_t bytes;			// allocated in total
+		uint64_t current;		// allocated and not freed yet
+		uint64_t peak;
+	};
+
+	static Stats getStats(MemorySubsystem subsystem);
+	static const char* getName(MemorySubsystem subsystem);
+	static MemorySubsystem getCurrent();
+	static void printStats();
+
+private:
+	friend class MemoryScope;
+	static void setCurrent(MemorySubsystem subsystem);
+};
+
+/*
+	allocations of this thread are charged to subsystem until the scope ends.
+*/
+class MemoryScope
+{
+	MemorySubsystem m_previous;
+
+public:
+	explicit MemoryScope(MemorySubsystem subsystem);
+	~MemoryScope();
+	MemoryScope(const MemoryScope&) = delete;
+	MemoryScope& operator=(const MemoryScope&) = delete;
+};
@@ -0,0 +1,563 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include "MeshLod.h"
+#include "Parallel.h"
+#include "Transform.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Mesh Simplification													  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+namespace {
+	// boundary planes are this much stronger than surface planes.
+	constexpr double BOUNDARY_WEIGHT = 10.0;
+	// a collapse is rejected if a triangle normal turns more than ~78 degrees.
+	constexpr float FLIP_COS = 0.2f;
+
+	/*
+		symmetric 4 x 4 matrix of the sum of squared plane distances.
+		weight is the sum of the plane weights, error / weight is the mean.
+	*/
+	struct Quadric {
+		double m[10] = {};	// aa ab ac ad bb bc bd cc cd dd
+		double weight = 0.0;
+
+		void addPlane(const glm::vec3& n, float d, double weight) {
+			double a = n.x, b = n.y, c = n.z, e = d;
+			m[0] += weight * a * a; m[1] += weight * a * b; m[2] += weight * a * c; m[3] += weight * a * e;
+			m[4] += weight * b * b; m[5] += weight * b * c; m[6] += weight * b * e;
+			m[7] += weight * c * c; m[8] += weight * c * e;
+			m[9] += weight * e * e;
+			this->weight += weight;
+		}
+
+		void add(const Quadric& q) {
+			for (int i = 0; i < 10; i++)
+				m[i] += q.m[i];
+			weight += q.weight;
+		}
+
+		double error(const glm::vec3& p) const {
+			double x = p.x, y = p.y, z = p.z;
+			return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+				+ m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+				+ m[7] * z * z + 2 * m[8] * z
+				+ m[9];
+		}
+	};
+
+	struct Triangle {
+		int v[3];
+		int part;
+	};
+
+	struct WeldKey {
+		int part;
+		uint32_t x, y, z;
+		uint32_t u, v;		// 0 without texcoords
+
+		bool operator==(const WeldKey& other) const {
+			return part == other.part && x == other.x && y == other.y && z == other.z
+				&& u == other.u && v == other.v;
+		}
+	};
+
+	struct WeldHash {
+		size_t operator()(const WeldKey& key) const {
+			size_t h = (size_t)key.part * 0x9E3779B1u;
+			h ^= key.x + 0x9E3779B9u + (h << 6) + (h >> 2);
+			h ^= key.y + 0x9E3779B9u + (h << 6) + (h >> 2);
+			h ^= key.z + 0x9E3779B9u + (h << 6) + (h >> 2);
+			h ^= key.u + 0x9E3779B9u + (h << 6) + (h >> 2);
+			h ^= key.v + 0x9E3779B9u + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	uint32_t floatBits(float value)
+	{
+		uint32_t bits;
+		value = value == 0.f ? 0.f : value;	// -0 == 0
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	uint64_t edgeKey(int a, int b)
+	{
+		return a < b ? ((uint64_t)a << 32) | (uint32_t)b : ((uint64_t)b << 32) | (uint32_t)a;
+	}
+}
+
+float simplifyMesh(const float *positions, int vertex_count, const std::vector<int>& part_first,
+	int target_triangles, std::vector<float>& out_positions, std::vector<float>& out_normals,
+	std::vector<int>& out_part_first, const float *texcoords, std::vector<float> *out_texcoords)
+{
+	bool has_uv = texcoords && out_texcoords;
+
+	// weld by position (and texcoord) inside each part
+	std::vector<glm::vec3> pos;
+	std::vector<glm::vec2> uv;
+	std::vector<Triangle> tris;
+	{
+		std::unordered_map<WeldKey, int, WeldHash> weld;
+		weld.reserve(vertex_count);
+		tris.reserve(vertex_count / 3);
+
+		int part = 0;
+		for (int t = 0; t < vertex_count / 3; t++) {
+			while (part + 1 < (int)part_first.size() && part_first[part + 1] <= 3 * t)
+				part++;
+
+			Triangle tri;
+			tri.part = part;
+			for (int k = 0; k < 3; k++) {
+				const float *p = positions + 3 * (3 * t + k);
+				const float *c = has_uv ? texcoords + 2 * (3 * t + k) : nullptr;
+				WeldKey key = { part, floatBits(p[0]), floatBits(p[1]), floatBits(p[2]),
+					c ? floatBits(c[0]) : 0, c ? floatBits(c[1]) : 0 };
+				auto it = weld.emplace(key, (int)pos.size());
+				if (it.second) {
+					pos.push_back(glm::vec3(p[0], p[1], p[2]));
+					if (c)
+						uv.push_back(glm::vec2(c[0], c[1]));
+				}
+				tri.v[k] = it.first->second;
+			}
+
+			if (tri.v[0] != tri.v[1] && tri.v[1] != tri.v[2] && tri.v[2] != tri.v[0])
+				tris.push_back(tri);
+		}
+	}
+
+	int n = (int)pos.size();
+
+	// surface quadrics, unweighted so the error stays a squared distance
+	std::vector<Quadric> quadric(n);
+	for (const Triangle& tri : tris) {
+		glm::vec3 normal = glm::cross(pos[tri.v[1]] - pos[tri.v[0]], pos[tri.v[2]] - pos[tri.v[0]]);
+		float length = glm::length(normal);
+		if (length <= 0.f)
+			continue;
+		normal /= length;
+		for (int k = 0; k < 3; k++)
+			quadric[tri.v[k]].addPlane(normal, -glm::dot(normal, pos[tri.v[0]]), 1.0);
+	}
+
+	// boundary quadrics: planes through edges used by one triangle, perpendicular to it
+	{
+		std::unordered_map<uint64_t, int> edge_use;
+		edge_use.reserve(tris.size() * 3);
+		for (const Triangle& tri : tris)
+			for (int k = 0; k < 3; k++)
+				edge_use[edgeKey(tri.v[k], tri.v[(k + 1) % 3])]++;
+
+		for (const Triangle& tri : tris) {
+			glm::vec3 normal = glm::cross(pos[tri.v[1]] - pos[tri.v[0]], pos[tri.v[2]] - pos[tri.v[0]]);
+			if (glm::length(normal) <= 0.f)
+				continue;
+			normal = glm::normalize(normal);
+
+			for (int k = 0; k < 3; k++) {
+				int a = tri.v[k], b = tri.v[(k + 1) % 3];
+				if (edge_use[edgeKey(a, b)] != 1)
+					continue;
+
+				glm::vec3 edge = pos[b] - pos[a];
+				glm::vec3 side = glm::cross(edge, normal);
+				if (glm::length(side) <= 0.f)
+					continue;
+				side = glm::normalize(side);
+
+				quadric[a].addPlane(side, -glm::dot(side, pos[a]), BOUNDARY_WEIGHT);
+				quadric[b].addPlane(side, -glm::dot(side, pos[a]), BOUNDARY_WEIGHT);
+			}
+		}
+	}
+
+	// greedy passes over independent edges, cheapest first
+	struct Edge {
+		int a, b;
+		double cost;		// mean squared distance to the planes
+		glm::vec3 target;
+		float blend;		// target = mix(a, b, blend), for the texcoords
+	};
+
+	std::vector<int> adj_offset, adj;
+	std::vector<Edge> edges;
+	std::vector<uint8_t> locked;
+	std::vector<int> remap(n);
+	double max_cost = 0.0;
+
+	while ((int)tris.size() > target_triangles) {
+		// vertex -> triangles
+		adj_offset.assign(n + 1, 0);
+		for (const Triangle& tri : tris)
+			for (int k = 0; k < 3; k++)
+				adj_offset[tri.v[k] + 1]++;
+		for (int i = 0; i < n; i++)
+			adj_offset[i + 1] += adj_offset[i];
+		adj.resize(adj_offset[n]);
+		{
+			std::vector<int> fill(adj_offset.begin(), adj_offset.end() - 1);
+			for (int t = 0; t < (int)tris.size(); t++)
+				for (int k = 0; k < 3; k++)
+					adj[fill[tris[t].v[k]]++] = t;
+		}
+
+		// unique edges and their best target (either end or the middle)
+		edges.clear();
+		for (const Triangle& tri : tris) {
+			for (int k = 0; k < 3; k++) {
+				int a = tri.v[k], b = tri.v[(k + 1) % 3];
+				if (a > b)
+					std::swap(a, b);
+				edges.push_back({ a, b, 0.0, glm::vec3(0.f), 0.f });
+			}
+		}
+		std::sort(edges.begin(), edges.end(), [](const Edge& x, const Edge& y) {
+			return x.a != y.a ? x.a < y.a : x.b < y.b;
+		});
+		edges.erase(std::unique(edges.begin(), edges.end(), [](const Edge& x, const Edge& y) {
+			return x.a == y.a && x.b == y.b;
+		}), edges.end());
+
+		parallelFor(0, (int)edges.size(), [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				Edge& e = edges[i];
+				Quadric q = quadric[e.a];
+				q.add(quadric[e.b]);
+
+				const glm::vec3 candidates[3] = { pos[e.a], pos[e.b], 0.5f * (pos[e.a] + pos[e.b]) };
+				const float blends[3] = { 0.f, 1.f, 0.5f };
+				e.cost = -1.0;
+				for (int c = 0; c < 3; c++) {
+					double cost = q.weight > 0.0 ? std::max(0.0, q.error(candidates[c])) / q.weight : 0.0;
+					if (e.cost < 0.0 || cost < e.cost) {
+						e.cost = cost;
+						e.target = candidates[c];
+						e.blend = blends[c];
+					}
+				}
+			}
+		}, 4096);
+
+		std::sort(edges.begin(), edges.end(), [](const Edge& x, const Edge& y) { return x.cost < y.cost; });
+
+		// collapses of one pass do not touch each other's triangles.
+		locked.assign(n, 0);
+		for (int i = 0; i < n; i++)
+			remap[i] = i;
+
+		int removed = 0;
+		int needed = (int)tris.size() - target_triangles;
+
+		for (const Edge& e : edges) {
+			if (removed >= needed)
+				break;
+			if (locked[e.a] || locked[e.b])
+				continue;
+
+			// reject flips, count the triangles that vanish
+			bool flip = false;
+			int vanish = 0;
+			for (int end = 0; end < 2 && !flip; end++) {
+				int v = end == 0 ? e.a : e.b;
+				for (int j = adj_offset[v]; j < adj_offset[v + 1]; j++) {
+					const Triangle& tri = tris[adj[j]];
+					bool has_a = tri.v[0] == e.a || tri.v[1] == e.a || tri.v[2] == e.a;
+					bool has_b = tri.v[0] == e.b || tri.v[1] == e.b || tri.v[2] == e.b;
+					if (has_a && has_b) {
+						if (end == 0)
+							vanish++;
+						continue;
+					}
+
+					glm::vec3 p[3], q[3];
+					for (int k = 0; k < 3; k++) {
+						p[k] = pos[tri.v[k]];
+						q[k] = tri.v[k] == v ? e.target : p[k];
+					}
+					glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+					glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+					if (glm::dot(before, after) < FLIP_COS * glm::length(before) * glm::length(after)) {
+						flip = true;
+						break;
+					}
+				}
+			}
+			if (flip)
+				continue;
+
+			// b -> a
+			pos[e.a] = e.target;
+			if (has_uv)
+				uv[e.a] += e.blend * (uv[e.b] - uv[e.a]);
+			quadric[e.a].add(quadric[e.b]);
+			remap[e.b] = e.a;
+			removed += vanish;
+			max_cost = std::max(max_cost, e.cost);
+
+			for (int end = 0; end < 2; end++) {
+				int v = end == 0 ? e.a : e.b;
+				for (int j = adj_offset[v]; j < adj_offset[v + 1]; j++)
+					for (int k = 0; k < 3; k++)
+						locked[tris[adj[j]].v[k]] = 1;
+			}
+		}
+
+		if (removed == 0)
+			break;
+
+		// apply the pass, drop collapsed triangles (order and parts are kept)
+		size_t kept = 0;
+		for (Triangle tri : tris) {
+			for (int k = 0; k < 3; k++)
+				tri.v[k] = remap[tri.v[k]];
+			if (tri.v[0] != tri.v[1] && tri.v[1] != tri.v[2] && tri.v[2] != tri.v[0])
+				tris[kept++] = tri;
+		}
+		tris.resize(kept);
+	}
+
+	// area weighted vertex normals
+	std::vector<glm::vec3> normal(n, glm::vec3(0.f));
+	for (const Triangle& tri : tris) {
+		glm::vec3 face = glm::cross(pos[tri.v[1]] - pos[tri.v[0]], pos[tri.v[2]] - pos[tri.v[0]]);
+		for (int k = 0; k < 3; k++)
+			normal[tri.v[k]] += face;
+	}
+
+	out_positions.resize(9 * tris.size());
+	out_normals.resize(9 * tris.size());
+	if (has_uv)
+		out_texcoords->resize(6 * tris.size());
+	out_part_first.assign(part_first.size(), 0);
+
+	int part = -1;
+	for (size_t t = 0; t < tris.size(); t++) {
+		while (part < tris[t].part)
+			out_part_first[++part] = (int)(3 * t);
+
+		for (int k = 0; k < 3; k++) {
+			int v = tris[t].v[k];
+			float length = glm::length(normal[v]);
+			glm::vec3 nv = length > 0.f ? normal[v] / length : glm::vec3(0.f, 1.f, 0.f);
+			memcpy(&out_positions[3 * (3 * t + k)], &pos[v][0], sizeof(float) * 3);
+			memcpy(&out_normals[3 * (3 * t + k)], &nv[0], sizeof(float) * 3);
+			if (has_uv)
+				memcpy(&(*out_texcoords)[2 * (3 * t + k)], &uv[v][0], sizeof(float) * 2);
+		}
+	}
+	while (part + 1 < (int)out_part_first.size())
+		out_part_first[++part] = (int)(3 * tris.size());
+
+	return (float)std::sqrt(max_cost);
+}
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Mesh LOD																  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+bool MeshLod::build(VAO& source, int max_levels, float ratio)
+{
+	m_source = &source;
+	m_levels.clear();
+	m_errors.assign(1, 0.f);
+	m_triangles.assign(1, source.getVertexCount() / 3);
+
+	std::vector<float> positions, out_positions, normals, texcoords, out_texcoords;
+	std::vector<int> part_first, out_part_first;
+	source.readPositions(positions);
+	bool has_uv = source.readTexCoords(texcoords);
+	for (int i = 0; i < source.getPartCount(); i++)
+		part_first.push_back(source.getPart(i).first);
+
+	// each level is simplified from the source, so errors do not pile up.
+	max_levels = std::min(max_levels, MAX_LEVELS - 1);
+	int target = m_triangles[0];
+	for (int level = 1; level <= max_levels; level++) {
+		target = (int)(target * ratio);
+		if (target < 4)
+			break;
+
+		float error = simplifyMesh(positions.data(), (int)positions.size() / 3, part_first, target,
+			out_positions, normals, out_part_first, has_uv ? texcoords.data() : nullptr, &out_texcoords);
+		int triangles = (int)out_positions.size() / 9;
+		if (triangles == 0 || triangles > m_triangles.back() * 9 / 10)
+			break;
+
+		std::vector<VAO::Part> parts(out_part_first.size());
+		for (size_t i = 0; i < parts.size(); i++) {
+			parts[i].name = source.getPart((int)i).name;
+			parts[i].first = out_part_first[i];
+		}
+
+		m_levels.emplace_back();
+		if (!m_levels.back().create(out_positions.data(), normals.data(), (int)out_positions.size() / 3, parts,
+			has_uv ? out_texcoords.data() : nullptr)) {
+			m_levels.pop_back();
+			break;
+		}
+		m_errors.push_back(error);
+		m_triangles.push_back(triangles);
+	}
+
+	// conservative proxy: coarsest level within 1% of the diagonal
+	AABB bounds = source.getBounds();
+	float diagonal = glm::length(bounds.max - bounds.min);
+	m_proxyLevel = 0;
+	for (int level = 1; level < getLevelCount(); level++)
+		if (m_errors[level] <= 0.01f * diagonal)
+			m_proxyLevel = level;
+
+	m_levelOffset.assign(getLevelCount(), 0);
+	m_levelCount.assign(getLevelCount(), 0);
+
+	return true;
+}
+
+int MeshLod::getLevelCount() const
+{
+	return 1 + (int)m_levels.size();
+}
+
+VAO& MeshLod::getLevel(int level)
+{
+	return level == 0 ? *m_source : m_levels[level - 1];
+}
+
+float MeshLod::getError(int level) const
+{
+	return m_errors[level];
+}
+
+int MeshLod::getTriangleCount(int level) const
+{
+	return m_triangles[level];
+}
+
+void MeshLod::setPixelError(float pixels)
+{
+	m_pixelError = pixels;
+}
+
+void MeshLod::setProxyLevel(int level)
+{
+	m_proxyLevel = std::max(0, std::min(level, getLevelCount() - 1));
+}
+
+int MeshLod::getProxyLevel() const
+{
+	return m_proxyLevel;
+}
+
+void MeshLod::classify(const TransformStore& transforms, int first, int count,
+	const glm::mat4& view, float pixel_scale, GLuint *order)
+{
+	int level_count = getLevelCount();
+	m_instanceCount = count;
+	m_instanceLevel.resize(count);
+
+	AABB bounds = m_source->getBounds();
+	glm::vec3 center = 0.5f * (bounds.min + bounds.max);
+	float radius = 0.5f * glm::length(bounds.max - bounds.min);
+
+	parallelFor(0, count, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			int level = 0;
+
+			if (pixel_scale > 0.f) {
+				const glm::mat4& world = transforms.getWorld(first + i);
+				float scale = std::max(glm::length(glm::vec3(world[0])),
+					std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+				float distance = glm::length(glm::vec3(view * world * glm::vec4(center, 1.f)));
+
+				// error in pixels shrinks with distance, the camera inside the bounds keeps level 0.
+				if (distance > radius * scale) {
+					float pixels_per_unit = scale * pixel_scale / distance;
+					while (level + 1 < level_count && m_errors[level + 1] * pixels_per_unit <= m_pixelError)
+						level++;
+				}
+			}
+
+			m_instanceLevel[i] = (uint8_t)level;
+		}
+	}, 4096);
+
+	// counting sort by level
+	std::fill(m_levelCount.begin(), m_levelCount.end(), 0);
+	for (int i = 0; i < count; i++)
+		m_levelCount[m_instanceLevel[i]]++;
+
+	int offset = 0;
+	for (int level = 0; level < level_count; level++) {
+		m_levelOffset[level] = offset;
+		offset += m_levelCount[level];
+	}
+
+	int fill[MAX_LEVELS];
+	std::copy(m_levelOffset.begin(), m_levelOffset.end(), fill);
+	for (int i = 0; i < count; i++)
+		order[first + fill[m_instanceLevel[i]]++] = (GLuint)(first + i);
+}
+
+void MeshLod::render(int first, int first_level, GLint level_location)
+{
+	for (int level = first_level; level < getLevelCount(); level++) {
+		if (m_levelCount[level] == 0)
+			continue;
+
+		if (level_location >= 0)
+			glUniform1ui(level_location, (GLuint)level);
+		VAO& vao = getLevel(level);
+		vao.bind();
+		vao.renderParts(m_levelCount[level], first + m_levelOffset[level]);
+	}
+}
+
+void MeshLod::renderProxy(int first, GLint level_location)
+{
+	if (m_instanceCount == 0)
+		return;
+
+	if (level_location >= 0)
+		glUniform1ui(level_location, (GLuint)m_proxyLevel);
+	VAO& vao = getLevel(m_proxyLevel);
+	vao.bind();
+	vao.renderParts(m_instanceCount, first);
+}
+
+int MeshLod::getLevelOffset(int level) const
+{
+	return level < (int)m_levelOffset.size() ? m_levelOffset[level] : 0;
+}
+
+int MeshLod::getLevelInstances(int level) const
+{
+	return level < (int)m_levelCount.size() ? m_levelCount[level] : 0;
+}
+
+uint64_t MeshLod::getShadedTriangles() const
+{
+	uint64_t triangles = 0;
+	for (int level = 0; level < getLevelCount(); level++)
+		triangles += (uint64_t)m_levelCount[level] * m_triangles[level];
+
+	return triangles;
+}
+
+uint64_t MeshLod::getProxyTriangles() const
+{
+	return (uint64_t)m_instanceCount * m_triangles[m_proxyLevel];
+}
+
+uint64_t MeshLod::getFullTriangles() const
+{
+	return (uint64_t)m_instanceCount * m_triangles[0];
+}
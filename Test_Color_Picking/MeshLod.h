@@ -0,0 +1,144 @@
+#pragma once
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "GLObject.h"
+
+class TransformStore;
+
+/************************************************************/
+/*															*/
+// Mesh Simplification
+/*															*/
+/************************************************************/
+
+/*
+	quadric error metric edge collapse (Garland and Heckbert) of a triangle list.
+	vertices are welded by position inside each part. open borders and part
+	borders get perpendicular boundary quadrics, and collapses that flip a
+	triangle are rejected, so silhouettes and part outlines are kept.
+
+	positions:
+	x, y, z of vertex_count vertices, 3 vertices per triangle.
+	part_first:
+	first vertex of each part (ascending), out_part_first gets the same parts.
+	out_normals:
+	area weighted normals of the welded result.
+	texcoords:
+	u, v per vertex or nullptr. vertices are also welded by texcoord, so uv
+	seams are kept like open borders, and a collapse blends the texcoords
+	like the position. out_texcoords gets them if both are given.
+	return: largest collapse error, rms distance to the merged planes (object space).
+*/
+float simplifyMesh(const float *positions, int vertex_count, const std::vector<int>& part_first,
+	int target_triangles, std::vector<float>& out_positions, std::vector<float>& out_normals,
+	std::vector<int>& out_part_first, const float *texcoords = nullptr, std::vector<float> *out_texcoords = nullptr);
+
+/************************************************************/
+/*															*/
+// Mesh LOD
+/*															*/
+/************************************************************/
+
+/*
+	lod chain of one VAO. level 0 is the source, level l has about
+	ratio^l of its triangles and a geometric error getError(l).
+	levels keep the texcoords of the source, if it has them.
+
+	the shaded passes pick a level per instance from the projected error:
+	the coarsest level whose error is at most pixel error pixels on screen.
+	id-only passes may draw every instance with the proxy level instead
+	(coarser, tuned separately), see renderProxy().
+
+	instances of a mesh range [first, first + count) are reordered by
+	level in the instance order buffer, so each level is one draw.
+*/
+class MeshLod
+{
+public:
+	static constexpr int MAX_LEVELS = 6;
+
+private:
+	VAO *m_source = nullptr;
+	std::deque<VAO> m_levels;		// level 1 ~
+	std::vector<float> m_errors;
+	std::vector<int> m_triangles;
+	float m_pixelError = 1.f;
+	int m_proxyLevel = 0;
+
+	// last classify(): instances of level l are [offset[l], offset[l] + count[l]) of the range
+	std::vector<int> m_levelOffset;
+	std::vector<int> m_levelCount;
+	std::vector<uint8_t> m_instanceLevel;
+	int m_instanceCount = 0;
+
+public:
+	MeshLod() = default;
+	~MeshLod() = default;
+
+	/*
+		max_levels:
+		levels after the source, the chain stops early when a level
+		removes less than 10% of the triangles.
+		source is kept by pointer and must not move while the chain is used.
+	*/
+	bool build(VAO& source, int max_levels = 4, float ratio = 0.5f);
+	int getLevelCount() const;
+	VAO& getLevel(int level);
+	/*
+		return: object space error of level (0 for the source).
+	*/
+	float getError(int level) const;
+	int getTriangleCount(int level) const;
+
+	void setPixelError(float pixels);
+	/*
+		level drawn by renderProxy(), default is the coarsest level
+		whose error is below 1% of the bounds diagonal.
+	*/
+	void setProxyLevel(int level);
+	int getProxyLevel() const;
+
+	/*
+		sorts instances [first, first + count) into order by level.
+		view: world -> camera.
+		pixel_scale: pixels per unit at distance 1 (proj[1][1] * height / 2),
+		0 puts every instance at level 0 (lod off).
+	*/
+	void classify(const TransformStore& transforms, int first, int count,
+		const glm::mat4& view, float pixel_scale, GLuint *order);
+	/*
+		instance order buffer must be bound to every level (setInstanceBuffer).
+		first_level:
+		levels below it are skipped (drawn by the caller, ex) culled meshlets).
+		level_location:
+		if >= 0, uniform (uint) of the bound shader set to the level of each draw.
+	*/
+	void render(int first, int first_level = 0, GLint level_location = -1);
+	void renderProxy(int first, GLint level_location = -1);
+	/*
+		instances of level in the last classify(): [offset, offset + count)
+		of the mesh range in the instance order.
+	*/
+	int getLevelOffset(int level) const;
+	int getLevelInstances(int level) const;
+	/*
+		for each level of the chain, calls fn(vao).
+	*/
+	template <typename Fn>
+	void forEachLevel(Fn fn) {
+		fn(*m_source);
+		for (VAO& level : m_levels)
+			fn(level);
+	}
+
+	/*
+		return: triangles drawn by render() / renderProxy() / level 0
+		for the last classify().
+	*/
+	uint64_t getShadedTriangles() const;
+	uint64_t getProxyTriangles() const;
+	uint64_t getFullTriangles() const;
+};
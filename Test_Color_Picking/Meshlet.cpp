@@ -0,0 +1,529 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include "Meshlet.h"
+#include "BVH.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Meshlet																  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+namespace {
+	// cones wider than ~84 degrees around the axis cull nothing.
+	constexpr float MIN_CONE_DOT = 0.1f;
+
+	struct WeldKey {
+		int part;
+		uint32_t x, y, z;
+
+		bool operator==(const WeldKey& other) const {
+			return part == other.part && x == other.x && y == other.y && z == other.z;
+		}
+	};
+
+	struct WeldHash {
+		size_t operator()(const WeldKey& key) const {
+			size_t h = (size_t)key.part * 0x9E3779B1u;
+			h ^= key.x + 0x9E3779B9u + (h << 6) + (h >> 2);
+			h ^= key.y + 0x9E3779B9u + (h << 6) + (h >> 2);
+			h ^= key.z + 0x9E3779B9u + (h << 6) + (h >> 2);
+			return h;
+		}
+	};
+
+	uint32_t floatBits(float value)
+	{
+		uint32_t bits;
+		value = value == 0.f ? 0.f : value;	// -0 == 0
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	uint64_t edgeKey(int a, int b)
+	{
+		return a < b ? ((uint64_t)a << 32) | (uint32_t)b : ((uint64_t)b << 32) | (uint32_t)a;
+	}
+}
+
+void buildMeshlets(const float *positions, int vertex_count, const std::vector<int>& part_first,
+	std::vector<int>& out_order, std::vector<Meshlet>& out_meshlets)
+{
+	int triangle_count = vertex_count / 3;
+	out_order.clear();
+	out_order.reserve(triangle_count);
+	out_meshlets.clear();
+
+	// triangle range of each part
+	std::vector<int> part_begin;
+	for (int first : part_first)
+		part_begin.push_back(first / 3);
+	int part_shift = 0;
+	if (part_begin.empty() || part_begin[0] != 0) {
+		part_begin.insert(part_begin.begin(), 0);
+		part_shift = 1;
+	}
+	part_begin.push_back(triangle_count);
+	int part_count = (int)part_begin.size() - 1;
+
+	// weld by position inside each part, corners[3t + k] is the welded vertex
+	std::vector<glm::vec3> pos;
+	std::vector<int> corners(3 * (size_t)triangle_count);
+	std::vector<glm::vec3> normals(triangle_count);
+	std::vector<uint8_t> closed(part_count, 1);
+	{
+		std::unordered_map<WeldKey, int, WeldHash> weld;
+		weld.reserve(vertex_count);
+		std::unordered_map<uint64_t, int> edges;
+
+		for (int part = 0; part < part_count; part++) {
+			edges.clear();
+			for (int t = part_begin[part]; t < part_begin[part + 1]; t++) {
+				for (int k = 0; k < 3; k++) {
+					const float *p = positions + 3 * (3 * t + k);
+					WeldKey key = { part, floatBits(p[0]), floatBits(p[1]), floatBits(p[2]) };
+					auto it = weld.emplace(key, (int)pos.size());
+					if (it.second)
+						pos.push_back(glm::vec3(p[0], p[1], p[2]));
+					corners[3 * t + k] = it.first->second;
+				}
+
+				const int *v = &corners[3 * t];
+				normals[t] = glm::cross(pos[v[1]] - pos[v[0]], pos[v[2]] - pos[v[0]]);
+				if (v[0] != v[1] && v[1] != v[2] && v[2] != v[0])
+					for (int k = 0; k < 3; k++)
+						edges[edgeKey(v[k], v[(k + 1) % 3])]++;
+			}
+
+			// closed: every edge has two triangles, so back faces are hidden.
+			for (const auto& edge : edges)
+				if (edge.second != 2)
+					closed[part] = 0;
+		}
+	}
+
+	// welded vertex -> triangles
+	std::vector<int> adjacency_first(pos.size() + 1, 0);
+	std::vector<int> adjacency(3 * (size_t)triangle_count);
+	for (int corner : corners)
+		adjacency_first[corner + 1]++;
+	for (size_t i = 0; i < pos.size(); i++)
+		adjacency_first[i + 1] += adjacency_first[i];
+	{
+		std::vector<int> fill(adjacency_first.begin(), adjacency_first.end() - 1);
+		for (int i = 0; i < 3 * triangle_count; i++)
+			adjacency[fill[corners[i]]++] = i / 3;
+	}
+
+	std::vector<uint8_t> emitted(triangle_count, 0);
+	std::vector<int> vertex_mark(pos.size(), -1);
+	std::vector<int> candidate_mark(triangle_count, -1);
+	std::vector<int> candidates;
+
+	for (int part = 0; part < part_count; part++) {
+		int seed = part_begin[part];
+
+		while (true) {
+			while (seed < part_begin[part + 1] && emitted[seed])
+				seed++;
+			if (seed >= part_begin[part + 1])
+				break;
+
+			int index = (int)out_meshlets.size();
+			int first = (int)out_order.size();
+			int vertices = 0;
+			glm::vec3 normal_sum(0.f);
+			candidates.clear();
+
+			for (int next = seed; next >= 0;) {
+				emitted[next] = 1;
+				out_order.push_back(next);
+				normal_sum += normals[next];
+
+				for (int k = 0; k < 3; k++) {
+					int v = corners[3 * next + k];
+					if (vertex_mark[v] == index)
+						continue;
+
+					vertex_mark[v] = index;
+					vertices++;
+					for (int a = adjacency_first[v]; a < adjacency_first[v + 1]; a++) {
+						int t = adjacency[a];
+						if (!emitted[t] && candidate_mark[t] != index) {
+							candidate_mark[t] = index;
+							candidates.push_back(t);
+						}
+					}
+				}
+
+				if ((int)out_order.size() - first == Meshlet::MAX_TRIANGLES)
+					break;
+
+				// fewest new vertices, then closest to the meshlet normal
+				float length = glm::length(normal_sum);
+				glm::vec3 axis = length > 0.f ? normal_sum / length : glm::vec3(0.f);
+				int best_new = 4;
+				float best_dot = -2.f;
+				size_t kept = 0;
+				next = -1;
+
+				for (int t : candidates) {
+					if (emitted[t])
+						continue;
+					candidates[kept++] = t;
+
+					const int *v = &corners[3 * t];
+					int added = 0;
+					for (int k = 0; k < 3; k++) {
+						bool repeated = (k > 0 && v[k] == v[0]) || (k > 1 && v[k] == v[1]);
+						if (vertex_mark[v[k]] != index && !repeated)
+							added++;
+					}
+					if (vertices + added > Meshlet::MAX_VERTICES)
+						continue;
+
+					float n_length = glm::length(normals[t]);
+					float dot = n_length > 0.f ? glm::dot(normals[t] / n_length, axis) : -1.f;
+					if (added < best_new || (added == best_new && dot > best_dot)) {
+						best_new = added;
+						best_dot = dot;
+						next = t;
+					}
+				}
+				candidates.resize(kept);
+			}
+
+			// bounds of the meshlet vertices
+			int count = (int)out_order.size() - first;
+			AABB box;
+			for (int i = first; i < first + count; i++)
+				for (int k = 0; k < 3; k++)
+					box.expand(pos[corners[3 * out_order[i] + k]]);
+
+			glm::vec3 center = 0.5f * (box.min + box.max);
+			float radius = 0.f;
+			for (int i = first; i < first + count; i++)
+				for (int k = 0; k < 3; k++)
+					radius = std::max(radius, glm::length(pos[corners[3 * out_order[i] + k]] - center));
+
+			// normal cone, the smallest dot of a triangle normal and the axis
+			float length = glm::length(normal_sum);
+			glm::vec3 axis = length > 0.f ? normal_sum / length : glm::vec3(0.f, 0.f, 1.f);
+			float min_dot = length > 0.f ? 1.f : -1.f;
+			for (int i = first; i < first + count; i++) {
+				const glm::vec3& n = normals[out_order[i]];
+				float n_length = glm::length(n);
+				if (n_length > 0.f)
+					min_dot = std::min(min_dot, glm::dot(n / n_length, axis));
+			}
+
+			Meshlet meshlet;
+			meshlet.sphere = glm::vec4(center, radius);
+			meshlet.cone = glm::vec4(axis,
+				(!closed[part] || min_dot <= MIN_CONE_DOT) ? 1.f : std::sqrt(1.f - min_dot * min_dot));
+			meshlet.first = 3 * (uint32_t)first;
+			meshlet.count = 3 * (uint32_t)count;
+			meshlet.part = (uint32_t)std::max(part - part_shift, 0);
+			meshlet.visible = 1;
+			out_meshlets.push_back(meshlet);
+		}
+	}
+}
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Meshlet Culler														  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+MeshletCuller::~MeshletCuller()
+{
+	if (isCreated())
+		destroy();
+}
+
+bool MeshletCuller::create(const char *comp_file, size_t max_commands)
+{
+	if (!m_shader.loadCompute(comp_file))
+		return false;
+
+	m_timer.create();
+	m_maxCommands = max_commands;
+	m_drawCount = GLEW_ARB_indirect_parameters != 0;
+
+	// stats of each mesh are bound as a range
+	GLint alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	m_statsStride = sizeof(Stats);
+	if (alignment > 0)
+		m_statsStride = (m_statsStride + alignment - 1) / alignment * alignment;
+
+	return true;
+}
+
+void MeshletCuller::destroy()
+{
+	if (m_fence)
+		glDeleteSync(m_fence);
+	m_fence = nullptr;
+
+	m_shader.unload();
+	m_timer.destroy();
+	m_sources.clear();
+	m_meshes.clear();
+	m_stats.destroy();
+	m_readback.destroy();
+	m_result.clear();
+	m_readbackData.clear();
+}
+
+bool MeshletCuller::isCreated() const
+{
+	return m_shader.isLoaded();
+}
+
+int MeshletCuller::addMesh(VAO& vao)
+{
+	if (vao.getVertexCount() < 3)
+		return -1;
+
+	int source = -1;
+	for (size_t i = 0; i < m_sources.size(); i++)
+		if (m_sources[i].vao == &vao)
+			source = (int)i;
+
+	if (source < 0) {
+		std::vector<float> positions;
+		std::vector<int> part_first, order;
+		vao.readPositions(positions);
+		for (int part = 0; part < vao.getPartCount(); part++)
+			part_first.push_back(vao.getPart(part).first);
+
+		m_sources.emplace_back();
+		Source& added = m_sources.back();
+		added.vao = &vao;
+		buildMeshlets(positions.data(), vao.getVertexCount(), part_first, order, added.meshlets);
+		vao.reorderTriangles(order);
+		uploadMeshlets(added);
+		source = (int)m_sources.size() - 1;
+	}
+
+	m_meshes.emplace_back();
+	m_meshes.back().source = source;
+
+	// counters of every mesh, a pending readback is dropped.
+	if (m_fence)
+		glDeleteSync(m_fence);
+	m_fence = nullptr;
+	m_stats.destroy();
+	m_readback.destroy();
+	m_stats.create(m_statsStride * m_meshes.size(), nullptr, GL_DYNAMIC_COPY);
+	m_stats.clear();
+	m_readback.create(m_statsStride * m_meshes.size(), nullptr, GL_DYNAMIC_READ);
+	m_result.assign(m_meshes.size(), Stats());
+	m_readbackData.resize(m_readback.getSize());
+
+	return (int)m_meshes.size() - 1;
+}
+
+int MeshletCuller::getMeshletCount(int mesh) const
+{
+	return (int)m_sources[m_meshes[mesh].source].meshlets.size();
+}
+
+bool MeshletCuller::cull(int mesh, int first, int count, const glm::mat4& view_proj, const glm::vec3& camera,
+	Buffer& instance_buffer, Buffer& order_buffer)
+{
+	struct Command {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+
+	Mesh& target = m_meshes[mesh];
+	Source& source = m_sources[target.source];
+	target.culled = false;
+
+	size_t commands = (size_t)std::max(count, 0) * source.meshlets.size();
+	if (commands == 0 || commands > m_maxCommands)
+		return false;
+
+	// part visibility is a meshlet flag.
+	for (int part = 0; part < source.vao->getPartCount(); part++) {
+		if (source.vao->isPartVisible(part) != (source.partVisible[part] != 0)) {
+			uploadMeshlets(source);
+			break;
+		}
+	}
+
+	// command buffer only grows.
+	if (target.capacity < commands) {
+		target.commands.destroy();
+		target.commands.create(sizeof(Command) * commands, nullptr, GL_DYNAMIC_COPY);
+		target.capacity = commands;
+	}
+
+	// counters of this mesh, and without the draw count the unused slots must be empty draws.
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_stats.getBuffer());
+	glClearBufferSubData(GL_COPY_WRITE_BUFFER, GL_R32UI, m_statsStride * mesh, sizeof(Stats),
+		GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	if (!m_drawCount) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, target.commands.getBuffer());
+		glClearBufferSubData(GL_COPY_WRITE_BUFFER, GL_R32UI, 0, sizeof(Command) * commands,
+			GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	Frustum frustum(view_proj);
+
+	m_shader.use();
+	glUniform4fv(SL_planes, 6, &frustum.planes[0][0]);
+	glUniform3fv(SL_camera, 1, &camera[0]);
+	glUniform1ui(SL_meshlet_count, (GLuint)source.meshlets.size());
+	glUniform1ui(SL_order_first, (GLuint)first);
+	glUniform1ui(SL_instance_count, (GLuint)count);
+	instance_buffer.bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+	source.buffer.bindBase(GL_SHADER_STORAGE_BUFFER, 6);
+	target.commands.bindBase(GL_SHADER_STORAGE_BUFFER, 7);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 8, m_stats.getBuffer(), m_statsStride * mesh, sizeof(Stats));
+	order_buffer.bindBase(GL_SHADER_STORAGE_BUFFER, 9);
+
+	// more than 65535 groups are spread over y.
+	GLuint groups = (GLuint)((commands + GROUP_SIZE - 1) / GROUP_SIZE);
+	GLuint groups_x = std::min(groups, 65535u);
+
+	m_timer.begin();
+	glDispatchCompute(groups_x, (groups + groups_x - 1) / groups_x, 1);
+	m_timer.end();
+
+	Shader::unuse();
+
+	// the draws read the commands and the count, the readback copies the counters.
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	target.count = commands;
+	target.culled = true;
+	m_statsDirty = true;
+
+	return true;
+}
+
+void MeshletCuller::invalidate(int mesh)
+{
+	m_meshes[mesh].culled = false;
+}
+
+bool MeshletCuller::isCulled(int mesh) const
+{
+	return mesh >= 0 && m_meshes[mesh].culled;
+}
+
+void MeshletCuller::render(int mesh)
+{
+	Mesh& target = m_meshes[mesh];
+	if (!target.culled)
+		return;
+
+	target.commands.bind(GL_DRAW_INDIRECT_BUFFER);
+	if (m_drawCount) {
+		m_stats.bind(GL_PARAMETER_BUFFER_ARB);
+		glMultiDrawArraysIndirectCountARB(GL_TRIANGLES, nullptr, (GLintptr)(m_statsStride * mesh),
+			(GLsizei)target.count, 0);
+		Buffer::unbind(GL_PARAMETER_BUFFER_ARB);
+	}
+	else {
+		glMultiDrawArraysIndirect(GL_TRIANGLES, nullptr, (GLsizei)target.count, 0);
+	}
+	Buffer::unbind(GL_DRAW_INDIRECT_BUFFER);
+}
+
+void MeshletCuller::poll()
+{
+	m_timer.poll();
+
+	if (m_fence) {
+		GLenum state = glClientWaitSync(m_fence, 0, 0);
+		if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+			return;
+
+		glDeleteSync(m_fence);
+		m_fence = nullptr;
+
+		m_readback.read(0, m_readbackData.size(), m_readbackData.data());
+		for (size_t i = 0; i < m_result.size(); i++)
+			memcpy(&m_result[i], &m_readbackData[m_statsStride * i], sizeof(Stats));
+	}
+
+	// one readback in flight, started after the culls of a frame.
+	if (m_statsDirty && m_stats.isCreated()) {
+		glBindBuffer(GL_COPY_READ_BUFFER, m_stats.getBuffer());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_readback.getBuffer());
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_stats.getSize());
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_statsDirty = false;
+	}
+}
+
+uint64_t MeshletCuller::getDrawnTriangles() const
+{
+	uint64_t triangles = 0;
+	for (const Stats& stats : m_result)
+		triangles += stats.drawn;
+
+	return triangles;
+}
+
+uint64_t MeshletCuller::getFrustumCulledTriangles() const
+{
+	uint64_t triangles = 0;
+	for (const Stats& stats : m_result)
+		triangles += stats.frustumCulled;
+
+	return triangles;
+}
+
+uint64_t MeshletCuller::getConeCulledTriangles() const
+{
+	uint64_t triangles = 0;
+	for (const Stats& stats : m_result)
+		triangles += stats.coneCulled;
+
+	return triangles;
+}
+
+int MeshletCuller::getTotalMeshletCount() const
+{
+	int count = 0;
+	for (const Source& source : m_sources)
+		count += (int)source.meshlets.size();
+
+	return count;
+}
+
+double MeshletCuller::getGpuTime() const
+{
+	return m_timer.getMean();
+}
+
+void MeshletCuller::uploadMeshlets(Source& source)
+{
+	source.partVisible.resize(source.vao->getPartCount());
+	for (int part = 0; part < source.vao->getPartCount(); part++)
+		source.partVisible[part] = source.vao->isPartVisible(part) ? 1 : 0;
+	for (Meshlet& meshlet : source.meshlets)
+		meshlet.visible = source.partVisible[meshlet.part];
+
+	size_t size = sizeof(Meshlet) * source.meshlets.size();
+	if (size == 0)
+		return;
+	if (source.buffer.isCreated())
+		source.buffer.update(0, size, source.meshlets.data());
+	else
+		source.buffer.create(size, source.meshlets.data(), GL_STATIC_DRAW);
+}
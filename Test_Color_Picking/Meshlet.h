@@ -0,0 +1,186 @@
+#pragma once
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "GLObject.h"
+
+/************************************************************/
+/*															*/
+// Meshlet
+/*															*/
+/************************************************************/
+
+/*
+	cluster of at most MAX_TRIANGLES triangles that touch at most
+	MAX_VERTICES welded vertices, drawn as vertices [first, first + count).
+
+	sphere: object space bounding sphere (center, radius).
+	cone: normal cone (axis, cutoff), back facing for every camera with
+	dot(center - camera, axis) >= cutoff * length(center - camera) + radius.
+	cutoff is 1 (never culled) for wide cones and for parts that are not
+	closed, where back faces are visible.
+
+	std430 layout, same as cull.comp.
+*/
+struct Meshlet {
+	static constexpr int MAX_VERTICES = 64;
+	static constexpr int MAX_TRIANGLES = 124;
+
+	glm::vec4 sphere;
+	glm::vec4 cone;
+	uint32_t first;
+	uint32_t count;
+	uint32_t part;
+	uint32_t visible;
+};
+
+/*
+	greedy partition of a triangle list into meshlets, inside each part.
+	a meshlet grows from a seed over triangles sharing its vertices,
+	preferring triangles that add the fewest vertices and then the ones
+	facing the meshlet normal, and ends when no neighbour fits.
+
+	positions:
+	x, y, z of vertex_count vertices, 3 vertices per triangle.
+	part_first:
+	first vertex of each part (ascending).
+	out_order:
+	new triangle order, triangle i of the result is out_order[i] of the source.
+	meshlets are contiguous in that order and stay inside their part.
+*/
+void buildMeshlets(const float *positions, int vertex_count, const std::vector<int>& part_first,
+	std::vector<int>& out_order, std::vector<Meshlet>& out_meshlets);
+
+/************************************************************/
+/*															*/
+// Meshlet Culler
+/*															*/
+/************************************************************/
+
+/*
+	per meshlet frustum and normal cone culling in a compute pass.
+
+	addMesh() partitions a VAO once (its triangles are reordered) and
+	returns a handle; several handles may share a VAO. cull() tests every
+	(instance, meshlet) pair of an instance range and appends one draw
+	command per surviving pair, render() draws that list with one
+	multi draw. the list stays valid until the next cull(), so the id
+	pass and the pick pass draw the same triangles.
+
+	the draw count is read on the gpu (GL_ARB_indirect_parameters), without
+	the extension the command buffer is cleared so unused slots draw nothing.
+	statistics are read back after a fence, cull() never stalls.
+*/
+class MeshletCuller
+{
+	enum ShaderLocation {
+		SL_planes,
+		SL_camera = 6,
+		SL_meshlet_count,
+		SL_order_first,
+		SL_instance_count,
+	};
+
+	static constexpr int GROUP_SIZE = 64;
+
+	// draw_count, drawn, frustum culled, cone culled (triangles)
+	struct Stats {
+		uint32_t drawCount;
+		uint32_t drawn;
+		uint32_t frustumCulled;
+		uint32_t coneCulled;
+	};
+
+	struct Source {
+		VAO *vao = nullptr;
+		std::vector<Meshlet> meshlets;
+		std::vector<uint8_t> partVisible;
+		Buffer buffer;
+	};
+
+	struct Mesh {
+		int source = 0;
+		Buffer commands;
+		size_t capacity = 0;
+		size_t count = 0;		// commands of the last cull()
+		bool culled = false;
+	};
+
+	Shader m_shader;
+	std::deque<Source> m_sources;
+	std::deque<Mesh> m_meshes;
+	Buffer m_stats;			// Stats per mesh, m_statsStride apart
+	Buffer m_readback;
+	size_t m_statsStride = sizeof(Stats);
+	GLsync m_fence = nullptr;
+	bool m_statsDirty = false;
+	GpuTimer m_timer;
+	size_t m_maxCommands = 0;
+	bool m_drawCount = false;
+
+	// last finished readback, per mesh
+	std::vector<Stats> m_result;
+	std::vector<char> m_readbackData;		// m_readback copy, sized by addMesh()
+
+public:
+	MeshletCuller() = default;
+	~MeshletCuller();
+
+	/*
+		comp_file: cull.comp
+		max_commands:
+		largest command list of one mesh (instances x meshlets),
+		bigger ranges are not culled.
+	*/
+	bool create(const char *comp_file, size_t max_commands = 1 << 22);
+	void destroy();
+	bool isCreated() const;
+
+	/*
+		vao is kept by pointer and must not move until destroy().
+		return: mesh handle, -1 if vao has no triangles.
+	*/
+	int addMesh(VAO& vao);
+	int getMeshletCount(int mesh) const;
+
+	/*
+		culls the meshlets of instances [first, first + count) of the
+		instance order buffer (attribute location 3 of the vao).
+		return: false if the range is too big or empty, then isCulled() is
+		false and the caller draws the range as usual.
+	*/
+	bool cull(int mesh, int first, int count, const glm::mat4& view_proj, const glm::vec3& camera,
+		Buffer& instance_buffer, Buffer& order_buffer);
+	/*
+		drops the list, ex) while the vertices are deformed.
+	*/
+	void invalidate(int mesh);
+	bool isCulled(int mesh) const;
+	/*
+		draws the list of the last cull(), the vao must be bound.
+	*/
+	void render(int mesh);
+
+	/*
+		call once per frame after the culls.
+		collects the statistics of a finished cull() and starts the next readback.
+	*/
+	void poll();
+
+	/*
+		triangles of the last finished cull over all meshes.
+	*/
+	uint64_t getDrawnTriangles() const;
+	uint64_t getFrustumCulledTriangles() const;
+	uint64_t getConeCulledTriangles() const;
+	int getTotalMeshletCount() const;
+	/*
+		return: mean gpu time of a cull() in ms.
+	*/
+	double getGpuTime() const;
+
+private:
+	void uploadMeshlets(Source& source);
+};
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include "MultiView.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Multi View															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+bool MultiView::create(int width, int height, int view_count,
+	const char *vert_file, const char *geom_file, const char *frag_file)
+{
+	if (view_count < 1 || view_count > MAX_VIEWS)
+		return false;
+
+	if (!m_fbo.createLayered(width, height, view_count, { GL_RGBA32F, GL_RG32UI }))
+		return false;
+
+	if (!m_shader.load(vert_file, geom_file, frag_file)) {
+		m_fbo.destroy();
+		return false;
+	}
+
+	m_viewBuffer.create(sizeof(glm::mat4) * MAX_VIEWS);
+
+	return true;
+}
+
+void MultiView::destroy()
+{
+	m_fbo.destroy();
+	m_shader.unload();
+	m_viewBuffer.destroy();
+	m_views.clear();
+}
+
+bool MultiView::isCreated() const
+{
+	return m_shader.isLoaded();
+}
+
+void MultiView::setViews(const std::vector<glm::mat4>& view_projs)
+{
+	size_t count = std::min(view_projs.size(), (size_t)m_fbo.getLayerCount());
+
+	m_views.assign(view_projs.begin(), view_projs.begin() + count);
+	if (count)
+		m_viewBuffer.update(0, sizeof(glm::mat4) * count, m_views.data());
+}
+
+int MultiView::getViewCount() const
+{
+	return (int)m_views.size();
+}
+
+const glm::mat4& MultiView::getViewProj(int view) const
+{
+	return m_views[view];
+}
+
+void MultiView::render(const DrawScene& draw_scene)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo.getFBO());
+	glViewport(0, 0, m_fbo.getWidth(), m_fbo.getHeight());
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+
+	// clears every layer.
+	const GLfloat clear_color[4] = { 0, 0, 0, 0 };
+	const GLuint clear_element[4] = { 0, 0, 0, 0 };
+	const GLfloat clear_depth = 1.f;
+	glClearBufferfv(GL_COLOR, 0, clear_color);
+	glClearBufferuiv(GL_COLOR, 1, clear_element);
+	glClearBufferfv(GL_DEPTH, 0, &clear_depth);
+
+	m_shader.use();
+	glUniform1i(SL_view_count, getViewCount());
+	m_viewBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+
+	draw_scene();
+
+	Shader::unuse();
+	FBO::unbind();
+}
+
+const FBO& MultiView::getFBO() const
+{
+	return m_fbo;
+}
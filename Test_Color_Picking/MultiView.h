@@ -0,0 +1,70 @@
+#pragma once
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <functional>
+#include <vector>
+#include "GLObject.h"
+
+/************************************************************/
+/*															*/
+// Multi View
+/*															*/
+/************************************************************/
+
+/*
+	id pass of up to MAX_VIEWS cameras in one draw.
+	the target is a layered FBO (one layer per view), and the geometry shader
+	runs one invocation per view and selects the layer with gl_Layer.
+	so the cpu cost does not depend on the number of views.
+
+	layers have the same layout as the single view id buffer:
+	attachment 0 (GL_RGBA32F): r = id, gba = world normal.
+	attachment 1 (GL_RG32UI): x = triangle and lod level, y = barycentric.
+*/
+class MultiView
+{
+	enum ShaderLocation {
+		SL_view_count,
+	};
+
+public:
+	static constexpr int MAX_VIEWS = 16;
+	using DrawScene = std::function<void()>;
+
+private:
+	FBO m_fbo;
+	Shader m_shader;
+	Buffer m_viewBuffer;
+	std::vector<glm::mat4> m_views;
+
+public:
+	MultiView() = default;
+	~MultiView() = default;
+
+	/*
+		width, height: size of one view.
+		view_count: number of layers, up to MAX_VIEWS.
+		vert_file, geom_file, frag_file: multiview.vert, multiview.geom and the id pass fragment shader.
+	*/
+	bool create(int width, int height, int view_count,
+		const char *vert_file, const char *geom_file, const char *frag_file);
+	void destroy();
+	bool isCreated() const;
+
+	/*
+		view_projs: pmat * vmat of each view. extra views are ignored.
+	*/
+	void setViews(const std::vector<glm::mat4>& view_projs);
+	int getViewCount() const;
+	const glm::mat4& getViewProj(int view) const;
+
+	/*
+		draw_scene: draws every instance with the multiview vertex shader.
+	*/
+	void render(const DrawScene& draw_scene);
+
+	/*
+		layer of view is view.
+	*/
+	const FBO& getFBO() const;
+};
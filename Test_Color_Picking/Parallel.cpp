@@ -0,0 +1,111 @@
+#include "Parallel.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Thread Pool															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+ThreadPool::ThreadPool()
+{
+	int worker_count = (int)std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+	m_workers.reserve(worker_count);
+	for (int i = 0; i < worker_count; i++)
+		m_workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& worker : m_workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::get()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::run(Task task, void *context, int chunk_count)
+{
+	std::unique_lock<std::mutex> dispatch(m_dispatch, std::try_to_lock);
+	int participants = std::min((int)m_workers.size(), chunk_count - 1);
+
+	if (!dispatch.owns_lock() || participants <= 0) {
+		for (int chunk = 0; chunk < chunk_count; chunk++)
+			task(context, chunk);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = task;
+		m_context = context;
+		m_chunkCount = chunk_count;
+		m_participants = participants;
+		m_finished = 0;
+		m_next = 0;
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	int chunk;
+	while (claim(chunk))
+		task(context, chunk);
+
+	// the participants have to leave before the next run resets the chunks.
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_finished == m_participants; });
+}
+
+int ThreadPool::getThreadCount() const
+{
+	return (int)m_workers.size() + 1;
+}
+
+void ThreadPool::work(int worker)
+{
+	uint64_t seen = 0;
+
+	for (;;) {
+		Task task;
+		void *context;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]() { return m_stop || m_generation != seen; });
+			if (m_stop)
+				return;
+
+			seen = m_generation;
+			if (worker >= m_participants)
+				continue;
+			task = m_task;
+			context = m_context;
+		}
+
+		int chunk;
+		while (claim(chunk))
+			task(context, chunk);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (++m_finished == m_participants)
+			m_done.notify_one();
+	}
+}
+
+bool ThreadPool::claim(int& chunk)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_next >= m_chunkCount)
+		return false;
+
+	chunk = m_next++;
+	return true;
+}
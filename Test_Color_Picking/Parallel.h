@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/************************************************************/
+/*															*/
+// Thread Pool
+/*															*/
+/************************************************************/
+
+/*
+	hardware_concurrency() - 1 worker threads, created on the first get()
+	and joined at exit. the calling thread works too, so a run uses up to
+	getThreadCount() threads and does not allocate.
+
+	one run at a time: a run() from a worker (nested) or while another
+	thread is running one calls the chunks serially on the calling thread.
+*/
+class ThreadPool
+{
+public:
+	typedef void(*Task)(void *context, int chunk);
+
+private:
+	std::vector<std::thread> m_workers;
+	std::mutex m_dispatch;				// held by the running run()
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+
+	// current run, written under m_mutex
+	Task m_task = nullptr;
+	void *m_context = nullptr;
+	int m_chunkCount = 0;
+	int m_participants = 0;				// workers [0, m_participants) take part
+	int m_finished = 0;
+	int m_next = 0;						// next unclaimed chunk
+	uint64_t m_generation = 0;
+	bool m_stop = false;
+
+	ThreadPool();
+
+public:
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	static ThreadPool& get();
+
+	/*
+		calls task(context, chunk) for every chunk in [0, chunk_count),
+		returns when all of them are done.
+	*/
+	void run(Task task, void *context, int chunk_count);
+
+	// workers and the calling thread
+	int getThreadCount() const;
+
+private:
+	void work(int worker);
+	bool claim(int& chunk);
+};
+
+/*
+	calls fn(begin, end) for sub ranges of [begin, end) on the thread pool.
+	the calling thread works on sub ranges too.
+
+	min_chunk:
+	ranges smaller than this are not split.
+*/
+template <typename Fn>
+void parallelFor(int begin, int end, Fn fn, int min_chunk = 1024)
+{
+	int count = end - begin;
+	if (count <= 0)
+		return;
+
+	ThreadPool& pool = ThreadPool::get();
+	int thread_count = std::min(pool.getThreadCount(), (count + min_chunk - 1) / min_chunk);
+
+	if (thread_count <= 1) {
+		fn(begin, end);
+		return;
+	}
+
+	struct Range {
+		Fn *fn;
+		int begin;
+		int end;
+		int chunk;
+	};
+	Range range = { &fn, begin, end, (count + thread_count - 1) / thread_count };
+
+	pool.run([](void *context, int chunk) {
+		const Range& range = *(const Range*)context;
+		int first = range.begin + range.chunk * chunk;
+		int last = std::min(range.end, first + range.chunk);
+		if (first < last)
+			(*range.fn)(first, last);
+	}, &range, thread_count);
+}
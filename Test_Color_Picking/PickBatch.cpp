@@ -0,0 +1,156 @@
+#include <cstdio>
+#include "PickBatch.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Pick Batch															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+PickBatch::~PickBatch()
+{
+	if (isCreated())
+		destroy();
+}
+
+bool PickBatch::create(const char *comp_file)
+{
+	if (!m_shader.loadCompute(comp_file))
+		return false;
+
+	for (auto& slot : m_slots)
+		glGenQueries(1, &slot.timer);
+
+	return true;
+}
+
+void PickBatch::destroy()
+{
+	for (auto& slot : m_slots) {
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+		glDeleteQueries(1, &slot.timer);
+		slot.timer = 0;
+		slot.points.destroy();
+		slot.hits.destroy();
+		slot.count = 0;
+	}
+
+	m_shader.unload();
+	m_head = 0;
+	m_pendingCount = 0;
+}
+
+bool PickBatch::isCreated() const
+{
+	return m_shader.isLoaded();
+}
+
+bool PickBatch::submit(const FBO& fbo, const std::vector<glm::ivec2>& points, uint64_t tag)
+{
+	if (points.empty() || m_pendingCount == SLOT_COUNT)
+		return false;
+
+	Slot& slot = m_slots[m_head];
+
+	// buffers only grow.
+	size_t point_size = points.size() * sizeof(glm::ivec2);
+	size_t hit_size = points.size() * sizeof(Hit);
+	if (slot.points.getSize() < point_size) {
+		slot.points.destroy();
+		slot.hits.destroy();
+		slot.points.create(point_size, nullptr, GL_STREAM_DRAW);
+		slot.hits.create(hit_size, nullptr, GL_STREAM_READ);
+	}
+	slot.points.update(0, point_size, points.data());
+	slot.count = points.size();
+	slot.tag = tag;
+
+	// gather
+	m_shader.use();
+	glUniform1ui(SL_point_count, (GLuint)slot.count);
+	slot.points.bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+	slot.hits.bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, fbo.getColorTex());
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, fbo.getDepthTex());
+
+	glBeginQuery(GL_TIME_ELAPSED, slot.timer);
+	glDispatchCompute((GLuint)((slot.count + GROUP_SIZE - 1) / GROUP_SIZE), 1, 1);
+	glEndQuery(GL_TIME_ELAPSED);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	Shader::unuse();
+
+	// the readback in poll() sees the storage writes.
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	m_head = (m_head + 1) % SLOT_COUNT;
+	m_pendingCount++;
+
+	return true;
+}
+
+bool PickBatch::poll(std::vector<Hit>& hits, uint64_t& tag)
+{
+	if (m_pendingCount == 0)
+		return false;
+
+	Slot& slot = m_slots[(m_head - m_pendingCount + SLOT_COUNT) % SLOT_COUNT];
+
+	GLenum state = glClientWaitSync(slot.fence, 0, 0);
+	if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+		return false;
+
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+	m_pendingCount--;
+
+	// one read for the whole batch.
+	hits.resize(slot.count);
+	slot.hits.read(0, slot.count * sizeof(Hit), hits.data());
+	tag = slot.tag;
+
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(slot.timer, GL_QUERY_RESULT, &elapsed);
+	m_gpuTime += (double)elapsed * 1e-6;
+	m_batchCount++;
+	m_pointCount += slot.count;
+
+	return true;
+}
+
+bool PickBatch::isPending() const
+{
+	return m_pendingCount > 0;
+}
+
+uint64_t PickBatch::getBatchCount() const
+{
+	return m_batchCount;
+}
+
+uint64_t PickBatch::getPointCount() const
+{
+	return m_pointCount;
+}
+
+double PickBatch::getGpuTimeMean() const
+{
+	return m_batchCount ? m_gpuTime / m_batchCount : 0.0;
+}
+
+void PickBatch::printStats() const
+{
+	double points = m_batchCount ? (double)m_pointCount / m_batchCount : 0.0;
+	double mean = getGpuTimeMean();
+
+	printf("pick batch: %llu batches, %.0f points per batch, gpu %.3f ms per batch (%.1f M points/s)\n",
+		(unsigned long long)m_batchCount, points, mean, mean > 0.0 ? points / mean * 1e-3 : 0.0);
+}
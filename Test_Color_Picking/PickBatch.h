@@ -0,0 +1,91 @@
+#pragma once
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "GLObject.h"
+
+/************************************************************/
+/*															*/
+// Pick Batch
+/*															*/
+/************************************************************/
+
+/*
+	resolves many pick points with one compute dispatch.
+	submit() uploads the points and gathers id and depth of each point from
+	the id buffer into a storage buffer. poll() reads the whole batch back
+	with one read when its fence is signaled, some frames later.
+
+	id buffer layout (GL_RGBA32F):
+	r = id.
+*/
+class PickBatch
+{
+public:
+	struct Hit {
+		uint32_t id;
+		float depth;
+	};
+
+private:
+	enum ShaderLocation {
+		SL_point_count,
+	};
+
+	static constexpr int SLOT_COUNT = 3;
+	static constexpr int GROUP_SIZE = 64;
+
+	struct Slot {
+		Buffer points;
+		Buffer hits;
+		GLuint timer = 0;
+		GLsync fence = nullptr;
+		size_t count = 0;
+		uint64_t tag = 0;
+	};
+
+	Shader m_shader;
+	Slot m_slots[SLOT_COUNT];
+	int m_head = 0;
+	int m_pendingCount = 0;
+
+	// statistics
+	uint64_t m_batchCount = 0;
+	uint64_t m_pointCount = 0;
+	double m_gpuTime = 0.0;
+
+public:
+	PickBatch() = default;
+	~PickBatch();
+
+	/*
+		comp_file:
+		gather compute shader (*.comp).
+	*/
+	bool create(const char *comp_file);
+	void destroy();
+	bool isCreated() const;
+
+	/*
+		points: pixels of fbo. points outside get id 0 and depth 1.
+		tag: returned with the results by poll().
+		return: false if all slots are busy.
+	*/
+	bool submit(const FBO& fbo, const std::vector<glm::ivec2>& points, uint64_t tag = 0);
+	/*
+		hits: hits[i] is the result of points[i] of the submitted batch.
+		tag: tag of the batch.
+		return: true if the oldest batch has finished.
+	*/
+	bool poll(std::vector<Hit>& hits, uint64_t& tag);
+	bool isPending() const;
+
+	uint64_t getBatchCount() const;
+	uint64_t getPointCount() const;
+	/*
+		return: mean gpu time of a gather dispatch in ms.
+	*/
+	double getGpuTimeMean() const;
+	void printStats() const;
+};
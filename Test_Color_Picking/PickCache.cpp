@@ -0,0 +1,82 @@
+#include <cstring>
+#include "PickCache.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Pick Cache															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+namespace {
+	bool sameMatrix(const glm::mat4& a, const glm::mat4& b)
+	{
+		return memcmp(&a[0][0], &b[0][0], sizeof(glm::mat4)) == 0;
+	}
+}
+
+bool PickCache::needsIdPass(const glm::mat4& view_proj, uint64_t version)
+{
+	return !(m_idView.valid && m_idView.version == version && sameMatrix(m_idView.viewProj, view_proj));
+}
+
+void PickCache::storeIdPass(const glm::mat4& view_proj, uint64_t version)
+{
+	m_idView.viewProj = view_proj;
+	m_idView.version = version;
+	m_idView.valid = true;
+	m_idPasses++;
+}
+
+bool PickCache::lookup(int x, int y, const glm::mat4& view_proj, uint64_t version, uint32_t& id)
+{
+	bool hit = m_pickView.valid && m_x == x && m_y == y
+		&& m_pickView.version == version && sameMatrix(m_pickView.viewProj, view_proj);
+
+	if (hit) {
+		id = m_id;
+		m_hits++;
+	}
+	else {
+		m_misses++;
+	}
+
+	return hit;
+}
+
+void PickCache::store(int x, int y, const glm::mat4& view_proj, uint64_t version, uint32_t id)
+{
+	m_pickView.viewProj = view_proj;
+	m_pickView.version = version;
+	m_pickView.valid = true;
+	m_x = x;
+	m_y = y;
+	m_id = id;
+}
+
+void PickCache::invalidate()
+{
+	m_idView.valid = false;
+	m_pickView.valid = false;
+}
+
+uint64_t PickCache::getHits() const
+{
+	return m_hits;
+}
+
+uint64_t PickCache::getMisses() const
+{
+	return m_misses;
+}
+
+uint64_t PickCache::getIdPasses() const
+{
+	return m_idPasses;
+}
+
+float PickCache::getHitRatio() const
+{
+	uint64_t total = m_hits + m_misses;
+
+	return total == 0 ? 0.f : (float)m_hits / (float)total;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+
+/************************************************************/
+/*															*/
+// Pick Cache
+/*															*/
+/************************************************************/
+
+/*
+	the id buffer only depends on (camera, scene version),
+	and a pick result on (cursor, camera, scene version).
+
+	needsIdPass():
+	true if the id buffer must be rendered again.
+	lookup():
+	true (hit) if the last pick result is still valid.
+*/
+class PickCache
+{
+	struct View {
+		glm::mat4 viewProj;
+		uint64_t version;
+		bool valid = false;
+	};
+
+	View m_idView;
+	View m_pickView;
+	int m_x = 0;
+	int m_y = 0;
+	uint32_t m_id = 0;
+
+	uint64_t m_hits = 0;
+	uint64_t m_misses = 0;
+	uint64_t m_idPasses = 0;
+
+public:
+	PickCache() = default;
+	~PickCache() = default;
+
+	bool needsIdPass(const glm::mat4& view_proj, uint64_t version);
+	void storeIdPass(const glm::mat4& view_proj, uint64_t version);
+
+	bool lookup(int x, int y, const glm::mat4& view_proj, uint64_t version, uint32_t& id);
+	void store(int x, int y, const glm::mat4& view_proj, uint64_t version, uint32_t id);
+	void invalidate();
+
+	uint64_t getHits() const;
+	uint64_t getMisses() const;
+	uint64_t getIdPasses() const;
+	/*
+		return: hits / (hits + misses)
+	*/
+	float getHitRatio() const;
+};
@@ -0,0 +1,193 @@
+#include <cstring>
+#include "PickReader.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Pick Result															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+int PickResult::getCorner() const
+{
+	if (barycentric.x >= barycentric.y && barycentric.x >= barycentric.z)
+		return 0;
+
+	return barycentric.y >= barycentric.z ? 1 : 2;
+}
+
+int PickResult::getVertex() const
+{
+	return triangle < 0 ? -1 : triangle * 3 + getCorner();
+}
+
+int PickResult::getEdge() const
+{
+	// the edge opposite to the farthest corner.
+	int farthest;
+	if (barycentric.x <= barycentric.y && barycentric.x <= barycentric.z)
+		farthest = 0;
+	else
+		farthest = barycentric.y <= barycentric.z ? 1 : 2;
+
+	return (farthest + 1) % 3;
+}
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Pick Reader															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+PickReader::~PickReader()
+{
+	if (isCreated())
+		destroy();
+}
+
+bool PickReader::create()
+{
+	for (auto& slot : m_slots) {
+		if (!slot.pbo.create(PIXEL_SIZE, nullptr, GL_STREAM_READ)) {
+			destroy();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void PickReader::destroy()
+{
+	for (auto& slot : m_slots) {
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+		slot.pbo.destroy();
+	}
+
+	m_head = 0;
+	m_pendingCount = 0;
+	m_hasLast = false;
+}
+
+bool PickReader::isCreated() const
+{
+	return m_slots[0].pbo.isCreated();
+}
+
+bool PickReader::request(const FBO& fbo, int x, int y, const glm::mat4& view_proj, uint64_t version, int layer)
+{
+	if (x < 0 || y < 0 || x >= fbo.getWidth() || y >= fbo.getHeight())
+		return false;
+	if (layer < 0 || layer >= (fbo.getLayerCount() ? fbo.getLayerCount() : 1))
+		return false;
+	if (m_pendingCount == SLOT_COUNT)
+		return false;
+
+	// same pick as the newest request in flight.
+	if (m_hasLast && m_last.x == x && m_last.y == y && m_last.layer == layer && m_last.version == version
+		&& memcmp(&m_last.viewProj[0][0], &view_proj[0][0], sizeof(glm::mat4)) == 0)
+		return false;
+
+	Slot& slot = m_slots[m_head];
+	slot.request = PickResult();
+	slot.request.x = x;
+	slot.request.y = y;
+	slot.request.layer = layer;
+	slot.request.viewProj = view_proj;
+	slot.request.version = version;
+	slot.width = fbo.getWidth();
+	slot.height = fbo.getHeight();
+	slot.hasElement = fbo.getColorTexCount() > 1;
+
+	// copy to the pixel pack buffer. glReadPixels returns immediately.
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo.getReadFBO(layer));
+	slot.pbo.bind(GL_PIXEL_PACK_BUFFER);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(x, y, 1, 1, GL_RGBA, GL_FLOAT, (void*)COLOR_OFFSET);
+	glReadPixels(x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, (void*)DEPTH_OFFSET);
+	if (slot.hasElement) {
+		glReadBuffer(GL_COLOR_ATTACHMENT1);
+		glReadPixels(x, y, 1, 1, GL_RG_INTEGER, GL_UNSIGNED_INT, (void*)ELEMENT_OFFSET);
+	}
+	Buffer::unbind(GL_PIXEL_PACK_BUFFER);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	m_last = slot.request;
+	m_hasLast = true;
+	m_head = (m_head + 1) % SLOT_COUNT;
+	m_pendingCount++;
+
+	return true;
+}
+
+bool PickReader::poll(PickResult& result)
+{
+	bool finished = false;
+
+	// oldest first, stop at the first unfinished one.
+	while (m_pendingCount > 0) {
+		Slot& slot = m_slots[(m_head - m_pendingCount + SLOT_COUNT) % SLOT_COUNT];
+
+		GLenum state = glClientWaitSync(slot.fence, 0, 0);
+		if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+			break;
+
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+		m_pendingCount--;
+
+		Pixel pixel;
+		slot.pbo.read(0, PIXEL_SIZE, &pixel);
+
+		result = slot.request;
+		resolve(pixel, slot.hasElement, result, slot.width, slot.height);
+		finished = true;
+	}
+
+	// nothing in flight, the same pick may be requested again.
+	if (m_pendingCount == 0)
+		m_hasLast = false;
+
+	return finished;
+}
+
+bool PickReader::isPending() const
+{
+	return m_pendingCount > 0;
+}
+
+void PickReader::resolve(const Pixel& pixel, bool has_element, PickResult& result, int width, int height)
+{
+	const float *rgba = pixel.rgba;
+	float depth = pixel.depth;
+
+	result.id = (uint32_t)(rgba[0] + 0.5f);
+	result.depth = depth;
+
+	if (result.id == 0)
+		return;
+
+	// pixel center -> ndc -> world
+	glm::vec4 ndc(
+		((float)result.x + 0.5f) / (float)width * 2.f - 1.f,
+		((float)result.y + 0.5f) / (float)height * 2.f - 1.f,
+		depth * 2.f - 1.f,
+		1.f);
+	glm::vec4 world = glm::inverse(result.viewProj) * ndc;
+
+	result.position = glm::vec3(world) / world.w;
+	result.normal = glm::vec3(rgba[1], rgba[2], rgba[3]);
+
+	if (has_element) {
+		float b1 = (float)(pixel.element[1] & 0xffff) / 65535.f;
+		float b2 = (float)(pixel.element[1] >> 16) / 65535.f;
+
+		result.triangle = (int)(pixel.element[0] & ((1u << LEVEL_SHIFT) - 1));
+		result.level = (int)(pixel.element[0] >> LEVEL_SHIFT);
+		result.barycentric = glm::vec3(1.f - b1 - b2, b1, b2);
+	}
+}
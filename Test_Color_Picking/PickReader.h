@@ -0,0 +1,117 @@
+#pragma once
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include "GLObject.h"
+
+/************************************************************/
+/*															*/
+// Pick Reader
+/*															*/
+/************************************************************/
+
+/*
+	result of one gpu pick.
+	position and normal are in world space, valid only if id != 0.
+	depth is the window depth [0, 1].
+	triangle and barycentric are valid only if the id buffer has the element
+	attachment, otherwise triangle is -1.
+	triangle counts from the start of the vertex buffer (not per draw),
+	so VAO::findPart(triangle) gives the part. level is the lod level
+	whose vertex buffer was drawn (MeshLod::getLevel), 0 without lod.
+
+	corner, edge:
+	vertex of the triangle is triangle * 3 + corner.
+	edge e connects corner e and corner (e + 1) % 3.
+*/
+struct PickResult
+{
+	uint32_t id = 0;
+	float depth = 1.f;
+	glm::vec3 position = glm::vec3(0.f);
+	glm::vec3 normal = glm::vec3(0.f);
+	int triangle = -1;
+	int level = 0;
+	glm::vec3 barycentric = glm::vec3(0.f);
+	int x = 0;
+	int y = 0;
+	int layer = 0;
+	glm::mat4 viewProj;
+	uint64_t version = 0;
+
+	/*
+		return: nearest corner (0 ~ 2) / vertex / edge (0 ~ 2) of the triangle.
+	*/
+	int getCorner() const;
+	int getVertex() const;
+	int getEdge() const;
+};
+
+/*
+	reads id, normal and depth of one pixel of the id buffer without stalling.
+	request() copies the pixel into a pixel pack buffer and puts a fence,
+	poll() returns the result some frames later when the fence is signaled.
+
+	id buffer layout:
+	attachment 0 (GL_RGBA32F): r = id, gba = world normal.
+	attachment 1 (GL_RG32UI, optional): x = triangle | lod level << LEVEL_SHIFT,
+	y = barycentric of corner 1 and 2 (unorm 16 x 2).
+*/
+class PickReader
+{
+public:
+	static constexpr int LEVEL_SHIFT = 29;
+
+private:
+	static constexpr int SLOT_COUNT = 3;
+	static constexpr size_t COLOR_OFFSET = 0;
+	static constexpr size_t DEPTH_OFFSET = sizeof(float) * 4;
+	static constexpr size_t ELEMENT_OFFSET = DEPTH_OFFSET + sizeof(float);
+	static constexpr size_t PIXEL_SIZE = ELEMENT_OFFSET + sizeof(GLuint) * 2;
+
+	struct Pixel {
+		float rgba[4];
+		float depth;
+		GLuint element[2];
+	};
+
+	struct Slot {
+		Buffer pbo;
+		GLsync fence = nullptr;
+		PickResult request;
+		int width = 0;
+		int height = 0;
+		bool hasElement = false;
+	};
+
+	Slot m_slots[SLOT_COUNT];
+	int m_head = 0;
+	int m_pendingCount = 0;
+	PickResult m_last;
+	bool m_hasLast = false;
+
+public:
+	PickReader() = default;
+	~PickReader();
+
+	bool create();
+	void destroy();
+	bool isCreated() const;
+
+	/*
+		x, y: pixel of fbo.
+		layer: layer of a layered fbo (view of MultiView).
+		return: false if the pixel is outside, all slots are busy,
+		or the same pick is already requested.
+	*/
+	bool request(const FBO& fbo, int x, int y, const glm::mat4& view_proj, uint64_t version, int layer = 0);
+	/*
+		result: newest finished pick.
+		return: true if a pick has finished since the last poll().
+	*/
+	bool poll(PickResult& result);
+	bool isPending() const;
+
+private:
+	static void resolve(const Pixel& pixel, bool has_element, PickResult& result, int width, int height);
+};
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cmath>
+#include "RegionSelect.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Region Select														  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+RegionSelect::~RegionSelect()
+{
+	if (isCreated())
+		destroy();
+}
+
+bool RegionSelect::create(const char *comp_file, const char *vert_file, const char *frag_file)
+{
+	if (!m_computeShader.loadCompute(comp_file))
+		return false;
+	if (!m_rasterShader.load(vert_file, frag_file)) {
+		m_computeShader.unload();
+		return false;
+	}
+
+	m_timer.create();
+
+	return true;
+}
+
+void RegionSelect::destroy()
+{
+	if (m_fence)
+		glDeleteSync(m_fence);
+	m_fence = nullptr;
+
+	m_timer.destroy();
+
+	m_computeShader.unload();
+	m_rasterShader.unload();
+	m_polygon.destroy();
+	m_bits.destroy();
+	m_list.destroy();
+}
+
+bool RegionSelect::isCreated() const
+{
+	return m_computeShader.isLoaded();
+}
+
+void RegionSelect::setRectangle(const glm::vec2& a, const glm::vec2& b)
+{
+	m_rect = glm::ivec4(
+		(int)std::floor(std::min(a.x, b.x)), (int)std::floor(std::min(a.y, b.y)),
+		(int)std::floor(std::max(a.x, b.x)) + 1, (int)std::floor(std::max(a.y, b.y)) + 1);
+	m_points.clear();
+}
+
+void RegionSelect::setLasso(const glm::vec2 *points, int count)
+{
+	if (count < 3) {
+		m_rect = glm::ivec4(0);
+		m_points.clear();
+		return;
+	}
+
+	glm::vec2 lo = points[0];
+	glm::vec2 hi = points[0];
+	for (int i = 0; i < count; i++) {
+		const glm::vec2& p = points[i];
+		lo = glm::vec2(std::min(lo.x, p.x), std::min(lo.y, p.y));
+		hi = glm::vec2(std::max(hi.x, p.x), std::max(hi.y, p.y));
+	}
+
+	setRectangle(lo, hi);
+	m_points.assign(points, points + count);
+}
+
+bool RegionSelect::selectVisible(const FBO& fbo, uint32_t id_count)
+{
+	if (!begin(fbo, id_count))
+		return false;
+
+	m_computeShader.use();
+	setRegionUniforms();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, fbo.getColorTex());
+
+	glDispatchCompute(
+		(GLuint)(m_rect.z - m_rect.x + GROUP_SIZE - 1) / GROUP_SIZE,
+		(GLuint)(m_rect.w - m_rect.y + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	Shader::unuse();
+
+	end();
+
+	return true;
+}
+
+bool RegionSelect::selectAll(const FBO& fbo, uint32_t id_count,
+	const glm::mat4& pmat, const glm::mat4& vmat, const DrawScene& draw_scene)
+{
+	if (!begin(fbo, id_count))
+		return false;
+
+	// no color, no depth. fragments only mark their ids.
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo.getFBO());
+	glViewport(0, 0, fbo.getWidth(), fbo.getHeight());
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(m_rect.x, m_rect.y, m_rect.z - m_rect.x, m_rect.w - m_rect.y);
+
+	m_rasterShader.use();
+	glUniformMatrix4fv(SL_pmat, 1, GL_FALSE, &pmat[0][0]);
+	glUniformMatrix4fv(SL_vmat, 1, GL_FALSE, &vmat[0][0]);
+	setRegionUniforms();
+
+	draw_scene();
+
+	Shader::unuse();
+
+	glDisable(GL_SCISSOR_TEST);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	end();
+
+	return true;
+}
+
+bool RegionSelect::poll(std::vector<uint32_t>& ids)
+{
+	if (!m_fence)
+		return false;
+
+	GLenum state = glClientWaitSync(m_fence, 0, 0);
+	if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+		return false;
+
+	glDeleteSync(m_fence);
+	m_fence = nullptr;
+
+	// count first, then only the used part of the list.
+	uint32_t count = 0;
+	m_list.read(0, sizeof(uint32_t), &count);
+	ids.resize(count);
+	if (count)
+		m_list.read(sizeof(uint32_t), sizeof(uint32_t) * count, ids.data());
+	std::sort(ids.begin(), ids.end());
+
+	m_timer.poll();
+
+	return true;
+}
+
+bool RegionSelect::isPending() const
+{
+	return m_fence != nullptr;
+}
+
+double RegionSelect::getGpuTime() const
+{
+	return m_timer.getLast();
+}
+
+bool RegionSelect::begin(const FBO& fbo, uint32_t id_count)
+{
+	if (isPending() || id_count == 0)
+		return false;
+
+	m_rect = glm::ivec4(
+		std::max(m_rect.x, 0), std::max(m_rect.y, 0),
+		std::min(m_rect.z, fbo.getWidth()), std::min(m_rect.w, fbo.getHeight()));
+	if (m_rect.x >= m_rect.z || m_rect.y >= m_rect.w)
+		return false;
+
+	// buffers only grow.
+	size_t bits_size = sizeof(uint32_t) * ((id_count + 31) / 32);
+	size_t list_size = sizeof(uint32_t) * (id_count + 1);
+	if (m_bits.getSize() < bits_size) {
+		m_bits.destroy();
+		m_bits.create(bits_size, nullptr, GL_DYNAMIC_COPY);
+	}
+	if (m_list.getSize() < list_size) {
+		m_list.destroy();
+		m_list.create(list_size, nullptr, GL_DYNAMIC_READ);
+	}
+	m_bits.clear();
+	m_list.clear();
+
+	size_t polygon_size = std::max<size_t>(m_points.size(), 1) * sizeof(glm::vec2);
+	if (m_polygon.getSize() < polygon_size) {
+		m_polygon.destroy();
+		m_polygon.create(polygon_size, nullptr, GL_STREAM_DRAW);
+	}
+	if (!m_points.empty())
+		m_polygon.update(0, m_points.size() * sizeof(glm::vec2), m_points.data());
+
+	m_polygon.bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+	m_bits.bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+	m_list.bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+	m_idCount = id_count;
+
+	m_timer.begin();
+
+	return true;
+}
+
+void RegionSelect::setRegionUniforms()
+{
+	glUniform4i(SL_rect, m_rect.x, m_rect.y, m_rect.z, m_rect.w);
+	glUniform1i(SL_polygon_size, (GLint)m_points.size());
+	glUniform1ui(SL_id_count, m_idCount);
+}
+
+void RegionSelect::end()
+{
+	m_timer.end();
+
+	// the readback in poll() sees the storage writes.
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+}
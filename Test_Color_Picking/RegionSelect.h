@@ -0,0 +1,105 @@
+#pragma once
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "GLObject.h"
+
+/************************************************************/
+/*															*/
+// Region Select
+/*															*/
+/************************************************************/
+
+/*
+	finds all ids inside a rectangle or a lasso of the id buffer.
+	each pixel sets the bit of its id with atomicOr, and the invocation that
+	sets a bit first appends the id to a compact list. the list is read back
+	asynchronously by poll().
+
+	visible:
+	a compute pass over the id buffer, so only unoccluded ids are found.
+	all:
+	the scene is rasterized again without depth test and the fragments mark
+	their ids, so occluded ids are found too.
+
+	region coordinates are pixels of the id buffer.
+*/
+class RegionSelect
+{
+	enum ShaderLocation {
+		SL_pmat = 0,
+		SL_vmat = 1,
+		SL_rect = 5,
+		SL_polygon_size = 6,
+		SL_id_count = 7,
+	};
+
+	static constexpr int GROUP_SIZE = 8;
+
+	Shader m_computeShader;
+	Shader m_rasterShader;
+	Buffer m_polygon;
+	Buffer m_bits;
+	Buffer m_list;
+	GpuTimer m_timer;
+	GLsync m_fence = nullptr;
+
+	// region
+	glm::ivec4 m_rect;
+	std::vector<glm::vec2> m_points;
+	uint32_t m_idCount = 0;
+
+public:
+	using DrawScene = std::function<void()>;
+
+	RegionSelect() = default;
+	~RegionSelect();
+
+	/*
+		comp_file: region.comp
+		vert_file, frag_file: id pass vertex shader and region.frag
+	*/
+	bool create(const char *comp_file, const char *vert_file, const char *frag_file);
+	void destroy();
+	bool isCreated() const;
+
+	/*
+		corners in any order, both inclusive.
+	*/
+	void setRectangle(const glm::vec2& a, const glm::vec2& b);
+	/*
+		closed polygon, even-odd rule.
+	*/
+	void setLasso(const glm::vec2 *points, int count);
+
+	/*
+		id_count: ids 1 ~ id_count - 1 can be found.
+		return: false if the previous selection is not finished or the region is empty.
+	*/
+	bool selectVisible(const FBO& fbo, uint32_t id_count);
+	/*
+		draw_scene: draws every instance with the id pass vertex shader.
+		pmat, vmat: camera of the id pass.
+	*/
+	bool selectAll(const FBO& fbo, uint32_t id_count,
+		const glm::mat4& pmat, const glm::mat4& vmat, const DrawScene& draw_scene);
+
+	/*
+		ids: found ids in ascending order.
+		return: true if the selection has finished.
+	*/
+	bool poll(std::vector<uint32_t>& ids);
+	bool isPending() const;
+
+	/*
+		return: gpu time of the last finished selection in ms.
+	*/
+	double getGpuTime() const;
+
+private:
+	bool begin(const FBO& fbo, uint32_t id_count);
+	void setRegionUniforms();
+	void end();
+};
@@ -0,0 +1,193 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/************************************************************/
+/*															*/
+// Handle
+/*															*/
+/************************************************************/
+
+/*
+	32 bit generational handle of a Registry<T>:
+	slot index in the low INDEX_BITS, generation of the slot in the rest.
+	a handle stays invalid after its object is removed, even when the slot
+	is reused. 0 is never a valid handle.
+*/
+template <typename T>
+class Handle
+{
+	uint32_t m_value = 0;
+
+public:
+	static constexpr int INDEX_BITS = 20;
+	static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+	static constexpr uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+
+	Handle() = default;
+	Handle(uint32_t index, uint32_t generation) : m_value((generation << INDEX_BITS) | index) {}
+
+	uint32_t getIndex() const { return m_value & INDEX_MASK; }
+	uint32_t getGeneration() const { return m_value >> INDEX_BITS; }
+	uint32_t getValue() const { return m_value; }
+	bool isNull() const { return m_value == 0; }
+
+	bool operator==(const Handle& other) const { return m_value == other.m_value; }
+	bool operator!=(const Handle& other) const { return m_value != other.m_value; }
+};
+
+/************************************************************/
+/*															*/
+// Registry
+/*															*/
+/************************************************************/
+
+/*
+	objects (gl wrappers, meshes ..) in one dense array, addressed by handles.
+	remove() moves the last object into the hole, so the array has no gaps
+	and a pass over all objects is a linear walk (begin(), end()).
+	removed objects are kept until collect(), which destroys them together,
+	ex) once per frame after the draws that may still use them.
+
+	pointers and references from get() are valid until the next add() that
+	grows the array (see reserve()) or the next remove().
+*/
+template <typename T>
+class Registry
+{
+	struct Slot {
+		uint32_t dense = 0;
+		uint32_t generation = 1;
+	};
+
+	// dense, index i of both arrays is the same object
+	std::vector<T> m_objects;
+	std::vector<Handle<T>> m_handles;
+
+	std::vector<Slot> m_slots;
+	std::vector<uint32_t> m_freeSlots;
+	std::vector<T> m_released;
+
+public:
+	static constexpr uint32_t MAX_COUNT = Handle<T>::INDEX_MASK + 1;
+
+	Registry() = default;
+	~Registry() = default;
+	Registry(const Registry&) = delete;
+	Registry& operator=(const Registry&) = delete;
+
+	void reserve(size_t count) {
+		m_objects.reserve(count);
+		m_handles.reserve(count);
+		m_slots.reserve(count);
+	}
+
+	/*
+		return: handle of the object, null if MAX_COUNT slots are in use.
+	*/
+	Handle<T> add(T&& object) {
+		uint32_t index;
+		if (!m_freeSlots.empty()) {
+			index = m_freeSlots.back();
+			m_freeSlots.pop_back();
+		}
+		else {
+			if (m_slots.size() >= MAX_COUNT)
+				return Handle<T>();
+			index = (uint32_t)m_slots.size();
+			m_slots.emplace_back();
+		}
+
+		Slot& slot = m_slots[index];
+		slot.dense = (uint32_t)m_objects.size();
+		Handle<T> handle(index, slot.generation);
+
+		m_objects.push_back(std::move(object));
+		m_handles.push_back(handle);
+
+		return handle;
+	}
+
+	/*
+		return: nullptr if the handle is null or its object was removed.
+	*/
+	T* get(Handle<T> handle) {
+		return contains(handle) ? &m_objects[m_slots[handle.getIndex()].dense] : nullptr;
+	}
+	const T* get(Handle<T> handle) const {
+		return contains(handle) ? &m_objects[m_slots[handle.getIndex()].dense] : nullptr;
+	}
+
+	bool contains(Handle<T> handle) const {
+		uint32_t index = handle.getIndex();
+		return !handle.isNull() && index < m_slots.size() && m_slots[index].generation == handle.getGeneration();
+	}
+
+	/*
+		the handle is invalid from now on, the object is destroyed by collect().
+		return: false if the handle was not valid.
+	*/
+	bool remove(Handle<T> handle) {
+		if (!contains(handle))
+			return false;
+
+		uint32_t index = handle.getIndex();
+		Slot& slot = m_slots[index];
+		uint32_t dense = slot.dense;
+		uint32_t last = (uint32_t)m_objects.size() - 1;
+
+		m_released.push_back(std::move(m_objects[dense]));
+		if (dense != last) {
+			m_objects[dense] = std::move(m_objects[last]);
+			m_handles[dense] = m_handles[last];
+			m_slots[m_handles[dense].getIndex()].dense = dense;
+		}
+		m_objects.pop_back();
+		m_handles.pop_back();
+
+		// generation 0 is skipped so that no valid handle is 0.
+		slot.generation = (slot.generation + 1) & Handle<T>::GENERATION_MASK;
+		if (slot.generation == 0)
+			slot.generation = 1;
+		m_freeSlots.push_back(index);
+
+		return true;
+	}
+
+	/*
+		destroys the objects removed since the last collect().
+		return: number of destroyed objects.
+	*/
+	size_t collect() {
+		size_t count = m_released.size();
+		m_released.clear();
+		return count;
+	}
+
+	/*
+		removes and destroys every object, old handles stay invalid.
+	*/
+	void clear() {
+		while (!m_handles.empty())
+			remove(m_handles.back());
+		collect();
+	}
+
+	size_t size() const { return m_objects.size(); }
+	// objects that fit before add() grows the array
+	size_t capacity() const { return m_objects.capacity(); }
+	bool empty() const { return m_objects.empty(); }
+	/*
+		dense index (0 ~ size() - 1) -> handle, the order changes with remove().
+	*/
+	Handle<T> getHandle(size_t dense) const { return m_handles[dense]; }
+	T& operator[](size_t dense) { return m_objects[dense]; }
+	const T& operator[](size_t dense) const { return m_objects[dense]; }
+
+	typename std::vector<T>::iterator begin() { return m_objects.begin(); }
+	typename std::vector<T>::iterator end() { return m_objects.end(); }
+	typename std::vector<T>::const_iterator begin() const { return m_objects.begin(); }
+	typename std::vector<T>::const_iterator end() const { return m_objects.end(); }
+};
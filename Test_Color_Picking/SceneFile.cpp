@@ -0,0 +1,472 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Parallel.h"
+#include "SceneFile.h"
+#include "Transform.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Mapped File															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char *path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	m_file = file;
+	m_size = (uint64_t)size.QuadPart;
+
+	// an empty file can not be mapped.
+	if (m_size > 0) {
+		m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_mapping) {
+			close();
+			return false;
+		}
+	}
+#else
+	m_file = ::open(path, O_RDONLY);
+	if (m_file < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(m_file, &st) != 0) {
+		close();
+		return false;
+	}
+	m_size = (uint64_t)st.st_size;
+#endif
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	unmap();
+
+#ifdef _WIN32
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_file >= 0)
+		::close(m_file);
+	m_file = -1;
+#endif
+
+	m_size = 0;
+}
+
+const void* MappedFile::map(uint64_t offset, size_t size)
+{
+	unmap();
+
+	if (!isOpen() || size == 0 || offset + size > m_size)
+		return nullptr;
+
+	// views start at the allocation granularity.
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	uint64_t granularity = info.dwAllocationGranularity;
+#else
+	uint64_t granularity = (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+	uint64_t aligned = offset - offset % granularity;
+	size_t view_size = (size_t)(offset - aligned) + size;
+
+#ifdef _WIN32
+	m_view = MapViewOfFile(m_mapping, FILE_MAP_READ, (DWORD)(aligned >> 32), (DWORD)aligned, view_size);
+	if (!m_view)
+		return nullptr;
+#else
+	void *view = mmap(nullptr, view_size, PROT_READ, MAP_PRIVATE, m_file, (off_t)aligned);
+	if (view == MAP_FAILED)
+		return nullptr;
+	madvise(view, view_size, MADV_SEQUENTIAL);
+	m_view = view;
+#endif
+	m_viewSize = view_size;
+
+	return (const char*)m_view + (offset - aligned);
+}
+
+void MappedFile::unmap()
+{
+	if (!m_view)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_view);
+#else
+	munmap(m_view, m_viewSize);
+#endif
+	m_view = nullptr;
+	m_viewSize = 0;
+}
+
+uint64_t MappedFile::getSize() const
+{
+	return m_size;
+}
+
+bool MappedFile::isOpen() const
+{
+#ifdef _WIN32
+	return m_file != nullptr;
+#else
+	return m_file >= 0;
+#endif
+}
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Scene File															  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+namespace {
+	const char MAGIC[4] = { 'T', 'C', 'P', 'S' };
+
+	/*
+		return: number of floats read from str, at most max_count.
+	*/
+	int parseFloats(const char *str, float *values, int max_count)
+	{
+		int count = 0;
+		while (count < max_count) {
+			char *end;
+			float value = strtof(str, &end);
+			if (end == str)
+				break;
+			values[count++] = value;
+			str = end;
+		}
+		return count;
+	}
+
+	void copyName(char *dst, size_t dst_size, const std::string& src)
+	{
+		memset(dst, 0, dst_size);
+		memcpy(dst, src.c_str(), std::min(src.size(), dst_size - 1));
+	}
+}
+
+bool SceneFile::load(const char *path, TransformStore& store)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	MappedFile file;
+	if (!file.open(path)) {
+		printf("scene: can not open %s\n", path);
+		return false;
+	}
+
+	bool binary = false;
+	if (file.getSize() >= sizeof(Header)) {
+		const Header *header = (const Header*)file.map(0, sizeof(Header));
+		binary = header && memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0;
+	}
+
+	bool ok;
+	if (binary) {
+		ok = loadBinary(file, store);
+	}
+	else {
+		file.close();
+		ok = loadText(path, store);
+	}
+
+	m_loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return ok;
+}
+
+bool SceneFile::loadText(const char *path, TransformStore& store)
+{
+	FILE *fin;
+	fopen_s(&fin, path, "rt");
+	if (!fin) {
+		printf("scene: can not open %s\n", path);
+		return false;
+	}
+
+	int first = store.size();
+	size_t first_mesh = m_meshes.size();
+	char line[1024];
+	int line_number = 0;
+	bool ok = true;
+
+	while (ok && fgets(line, sizeof(line), fin)) {
+		line_number++;
+
+		char *comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+
+		char cmd[16];
+		int length = 0;
+		if (sscanf(line, "%15s%n", cmd, &length) != 1)
+			continue;
+		const char *args = line + length;
+
+		if (strcmp(cmd, "mesh") == 0) {
+			char name[64], file[192], texture[192];
+			int count = sscanf(args, "%63s %191s %191s", name, file, texture);
+			if (count < 2) {
+				ok = false;
+				break;
+			}
+
+			Mesh mesh;
+			mesh.name = name;
+			mesh.path = file;
+			if (count == 3)
+				mesh.texture = texture;
+			mesh.first = store.size();
+			m_meshes.push_back(mesh);
+		}
+		else if (strcmp(cmd, "instance") == 0) {
+			// id, position, rotation, scale, parent
+			char *end;
+			uint32_t id = (uint32_t)strtoul(args, &end, 10);
+			float v[11];
+			int count = parseFloats(end, v, 11);
+			if (m_meshes.size() == first_mesh || end == args || (count != 3 && count != 7 && count != 10 && count != 11)) {
+				ok = false;
+				break;
+			}
+
+			glm::vec4 rotation = count >= 7 ? glm::vec4(v[3], v[4], v[5], v[6]) : glm::vec4(0, 0, 0, 1);
+			glm::vec3 scale = count >= 10 ? glm::vec3(v[7], v[8], v[9]) : glm::vec3(1.f);
+			int parent = count == 11 && v[10] >= 0.f ? first + (int)v[10] : -1;
+
+			int index = store.append(1);
+			store.assign(index, glm::vec3(v[0], v[1], v[2]), rotation, scale, parent, id);
+		}
+		else if (strcmp(cmd, "grid") == 0) {
+			// id, nx, ny, nz, spacing, scale
+			char *end;
+			uint32_t id = (uint32_t)strtoul(args, &end, 10);
+			float v[5];
+			int count = parseFloats(end, v, 5);
+			if (m_meshes.size() == first_mesh || end == args || count < 4
+				|| v[0] < 1.f || v[1] < 1.f || v[2] < 1.f || (double)v[0] * v[1] * v[2] > INT_MAX - store.size()) {
+				ok = false;
+				break;
+			}
+
+			int nx = (int)v[0], ny = (int)v[1], nz = (int)v[2];
+			float spacing = v[3];
+			glm::vec3 scale(count == 5 ? v[4] : 1.f);
+			glm::vec3 origin = -0.5f * spacing * glm::vec3((float)(nx - 1), (float)(ny - 1), (float)(nz - 1));
+
+			int base = store.append(nx * ny * nz);
+			parallelFor(0, nx * ny * nz, [&](int begin, int end) {
+				for (int i = begin; i < end; i++) {
+					glm::vec3 cell((float)(i % nx), (float)(i / nx % ny), (float)(i / (nx * ny)));
+					store.assign(base + i, origin + spacing * cell, glm::vec4(0, 0, 0, 1), scale, -1,
+						id != 0 ? id + (uint32_t)i : 0);
+				}
+			}, 16384);
+		}
+		else {
+			ok = false;
+		}
+	}
+	fclose(fin);
+
+	if (!ok)
+		printf("scene: %s(%d): invalid line\n", path, line_number);
+
+	for (size_t i = first_mesh; i < m_meshes.size(); i++)
+		m_meshes[i].count = (i + 1 < m_meshes.size() ? m_meshes[i + 1].first : store.size()) - m_meshes[i].first;
+
+	store.commit(first, store.size() - first);
+
+	return ok;
+}
+
+bool SceneFile::loadBinary(MappedFile& file, TransformStore& store)
+{
+	Header header = *(const Header*)file.map(0, sizeof(Header));
+
+	// version 1 mesh entries have no texture.
+	if (header.version < 1 || header.version > VERSION || header.recordSize != sizeof(Instance)
+		|| header.instanceCount > (uint64_t)(INT_MAX - store.size())) {
+		puts("scene: unsupported binary scene");
+		return false;
+	}
+
+	size_t entry_size = header.version == 1 ? offsetof(MeshEntry, texture) : sizeof(MeshEntry);
+	uint64_t data_offset = sizeof(Header) + entry_size * (uint64_t)header.meshCount;
+	if (file.getSize() < data_offset + sizeof(Instance) * header.instanceCount) {
+		puts("scene: truncated binary scene");
+		return false;
+	}
+
+	int base = store.size();
+	int count = (int)header.instanceCount;
+
+	// mesh table
+	if (header.meshCount > 0) {
+		const char *entries = (const char*)file.map(sizeof(Header), entry_size * header.meshCount);
+		if (!entries)
+			return false;
+
+		for (uint32_t i = 0; i < header.meshCount; i++) {
+			MeshEntry entry = {};
+			memcpy(&entry, entries + entry_size * i, entry_size);
+			if (entry.first + entry.count > header.instanceCount) {
+				puts("scene: invalid mesh range");
+				return false;
+			}
+
+			Mesh mesh;
+			mesh.name.assign(entry.name, strnlen(entry.name, sizeof(entry.name)));
+			mesh.path.assign(entry.path, strnlen(entry.path, sizeof(entry.path)));
+			mesh.texture.assign(entry.texture, strnlen(entry.texture, sizeof(entry.texture)));
+			mesh.first = base + (int)entry.first;
+			mesh.count = (int)entry.count;
+			m_meshes.push_back(mesh);
+		}
+	}
+
+	// instances, one mapped window at a time
+	store.append(count);
+
+	for (int window = 0; window < count; window += WINDOW_RECORDS) {
+		int window_count = std::min(WINDOW_RECORDS, count - window);
+		const Instance *records = (const Instance*)file.map(
+			data_offset + sizeof(Instance) * (uint64_t)window, sizeof(Instance) * (size_t)window_count);
+		if (!records) {
+			puts("scene: can not map instances");
+			store.commit(base, count);
+			return false;
+		}
+
+		parallelFor(0, window_count, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				const Instance& r = records[i];
+				store.assign(base + window + i,
+					glm::vec3(r.position[0], r.position[1], r.position[2]),
+					glm::vec4(r.rotation[0], r.rotation[1], r.rotation[2], r.rotation[3]),
+					glm::vec3(r.scale[0], r.scale[1], r.scale[2]),
+					r.parent >= 0 ? base + r.parent : -1, r.id);
+			}
+		}, 16384);
+	}
+	file.unmap();
+
+	store.commit(base, count);
+
+	return true;
+}
+
+bool SceneFile::save(const char *path, const TransformStore& store) const
+{
+	FILE *fout;
+	fopen_s(&fout, path, "wb");
+	if (!fout) {
+		printf("scene: can not create %s\n", path);
+		return false;
+	}
+
+	Header header = {};
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.meshCount = (uint32_t)m_meshes.size();
+	header.recordSize = sizeof(Instance);
+	header.instanceCount = (uint64_t)store.size();
+	bool ok = fwrite(&header, sizeof(header), 1, fout) == 1;
+
+	for (const Mesh& mesh : m_meshes) {
+		MeshEntry entry = {};
+		copyName(entry.name, sizeof(entry.name), mesh.name);
+		copyName(entry.path, sizeof(entry.path), mesh.path);
+		copyName(entry.texture, sizeof(entry.texture), mesh.texture);
+		entry.first = (uint64_t)mesh.first;
+		entry.count = (uint64_t)mesh.count;
+		ok = ok && fwrite(&entry, sizeof(entry), 1, fout) == 1;
+	}
+
+	// written in blocks, memory does not grow with the scene.
+	std::vector<Instance> block(std::min(store.size(), 65536));
+	for (int first = 0; ok && first < store.size(); first += (int)block.size()) {
+		int count = std::min((int)block.size(), store.size() - first);
+		for (int i = 0; i < count; i++) {
+			int index = first + i;
+			glm::vec3 p = store.getPosition(index);
+			glm::vec4 r = store.getRotation(index);
+			glm::vec3 s = store.getScale(index);
+			Instance& record = block[i];
+			record = { { p.x, p.y, p.z }, { r.x, r.y, r.z, r.w }, { s.x, s.y, s.z },
+				store.getParent(index), store.getId(index) };
+		}
+		ok = fwrite(block.data(), sizeof(Instance), count, fout) == (size_t)count;
+	}
+
+	fclose(fout);
+
+	if (!ok)
+		printf("scene: can not write %s\n", path);
+
+	return ok;
+}
+
+const std::vector<SceneFile::Mesh>& SceneFile::getMeshes() const
+{
+	return m_meshes;
+}
+
+int SceneFile::findMesh(int instance) const
+{
+	auto it = std::upper_bound(m_meshes.begin(), m_meshes.end(), instance,
+		[](int index, const Mesh& mesh) { return index < mesh.first; });
+	if (it == m_meshes.begin())
+		return -1;
+
+	--it;
+	return instance < it->first + it->count ? (int)(it - m_meshes.begin()) : -1;
+}
+
+double SceneFile::getLoadTime() const
+{
+	return m_loadTime;
+}
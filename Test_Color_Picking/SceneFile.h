@@ -0,0 +1,143 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class TransformStore;
+
+/************************************************************/
+/*															*/
+// Mapped File
+/*															*/
+/************************************************************/
+
+/*
+	read only file mapping.
+	one view is mapped at a time, so large files are read in windows
+	and only the current window is resident.
+*/
+class MappedFile
+{
+#ifdef _WIN32
+	void *m_file = nullptr;
+	void *m_mapping = nullptr;
+#else
+	int m_file = -1;
+#endif
+	uint64_t m_size = 0;
+	void *m_view = nullptr;
+	size_t m_viewSize = 0;
+
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char *path);
+	void close();
+	/*
+		maps [offset, offset + size) and unmaps the previous view.
+		return: pointer to offset, nullptr if out of range.
+	*/
+	const void* map(uint64_t offset, size_t size);
+	void unmap();
+
+	uint64_t getSize() const;
+	bool isOpen() const;
+};
+
+/************************************************************/
+/*															*/
+// Scene File
+/*															*/
+/************************************************************/
+
+/*
+	meshes and their instances (transform and pick id).
+	instances of a mesh are contiguous: mesh i owns [first, first + count).
+
+	text form (authoring), one entry per line, # starts a comment:
+	mesh <name> <obj path> [texture path]
+	instance <id> px py pz [qx qy qz qw [sx sy sz [parent]]]
+	grid <id> nx ny nz spacing [scale]
+	instances and grids belong to the last mesh, id 0 means index + 1.
+	grid ids are id, id + 1, ... (or index + 1 for id 0).
+	the texture of a mesh is used by all of its instances (see TextureAtlas).
+
+	binary form (loading), little endian:
+	Header, MeshEntry x meshCount, Instance x instanceCount.
+	instances are memory mapped and streamed into the store in windows
+	of WINDOW_RECORDS, so peak memory is the store plus one window.
+*/
+class SceneFile
+{
+public:
+	static constexpr uint32_t VERSION = 2;
+	static constexpr int WINDOW_RECORDS = 1 << 20;
+
+	struct Mesh {
+		std::string name;
+		std::string path;
+		std::string texture;	// empty if untextured
+		int first = 0;
+		int count = 0;
+	};
+
+	struct Header {
+		char magic[4];			// "TCPS"
+		uint32_t version;
+		uint32_t meshCount;
+		uint32_t recordSize;	// sizeof(Instance)
+		uint64_t instanceCount;
+	};
+
+	struct MeshEntry {
+		char name[64];
+		char path[192];
+		uint64_t first;
+		uint64_t count;
+		char texture[192];		// version 2
+	};
+
+	struct Instance {
+		float position[3];
+		float rotation[4];		// quaternion (x, y, z, w)
+		float scale[3];
+		int32_t parent;			// -1 is root
+		uint32_t id;			// 0 means index + 1
+	};
+
+private:
+	std::vector<Mesh> m_meshes;
+	double m_loadTime = 0.0;
+
+public:
+	SceneFile() = default;
+	~SceneFile() = default;
+
+	/*
+		appends the instances of path (text or binary) to store.
+	*/
+	bool load(const char *path, TransformStore& store);
+	/*
+		writes the meshes and store as a binary scene.
+		store must hold exactly the instances of getMeshes().
+	*/
+	bool save(const char *path, const TransformStore& store) const;
+
+	const std::vector<Mesh>& getMeshes() const;
+	/*
+		return: mesh of instance, -1 if none.
+	*/
+	int findMesh(int instance) const;
+	/*
+		return: seconds spent in the last load().
+	*/
+	double getLoadTime() const;
+
+private:
+	bool loadText(const char *path, TransformStore& store);
+	bool loadBinary(MappedFile& file, TransformStore& store);
+};
@@ -0,0 +1,170 @@
+#include <gl/glew.h>
+#include <algorithm>
+#include <bitset>
+#include "GLObject.h"
+#include "Selection.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Selection Set														  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+void SelectionSet::resize(uint32_t id_count)
+{
+	size_t word_count = (id_count + 31) / 32;
+
+	if (word_count != m_words.size()) {
+		m_words.resize(word_count, 0);
+		m_resized = true;
+	}
+
+	// bits over id_count in the last word are cleared.
+	if (id_count < m_idCount && (id_count & 31) && word_count > 0) {
+		m_words.back() &= (1u << (id_count & 31)) - 1u;
+		markDirty(word_count - 1, word_count);
+	}
+
+	m_idCount = id_count;
+}
+
+uint32_t SelectionSet::getIdCount() const
+{
+	return m_idCount;
+}
+
+void SelectionSet::set(uint32_t id)
+{
+	if (id >= m_idCount)
+		return;
+
+	m_words[id >> 5] |= (1u << (id & 31));
+	markDirty(id >> 5, (id >> 5) + 1);
+}
+
+void SelectionSet::clear(uint32_t id)
+{
+	if (id >= m_idCount)
+		return;
+
+	m_words[id >> 5] &= ~(1u << (id & 31));
+	markDirty(id >> 5, (id >> 5) + 1);
+}
+
+void SelectionSet::toggle(uint32_t id)
+{
+	if (id >= m_idCount)
+		return;
+
+	m_words[id >> 5] ^= (1u << (id & 31));
+	markDirty(id >> 5, (id >> 5) + 1);
+}
+
+bool SelectionSet::isSelected(uint32_t id) const
+{
+	if (id >= m_idCount)
+		return false;
+
+	return (m_words[id >> 5] >> (id & 31)) & 1u;
+}
+
+void SelectionSet::setRange(uint32_t first, uint32_t last)
+{
+	applyRange(first, last, RO_SET);
+}
+
+void SelectionSet::clearRange(uint32_t first, uint32_t last)
+{
+	applyRange(first, last, RO_CLEAR);
+}
+
+void SelectionSet::toggleRange(uint32_t first, uint32_t last)
+{
+	applyRange(first, last, RO_TOGGLE);
+}
+
+void SelectionSet::clearAll()
+{
+	std::fill(m_words.begin(), m_words.end(), 0u);
+	markDirty(0, m_words.size());
+}
+
+uint32_t SelectionSet::count() const
+{
+	uint32_t result = 0;
+
+	for (uint32_t word : m_words)
+		result += (uint32_t)std::bitset<32>(word).count();
+
+	return result;
+}
+
+bool SelectionSet::upload(Buffer& buffer)
+{
+	if (m_words.empty())
+		return false;
+
+	if (m_resized || buffer.getSize() != sizeof(uint32_t) * m_words.size()) {
+		if (buffer.isCreated())
+			buffer.destroy();
+
+		buffer.create(sizeof(uint32_t) * m_words.size(), m_words.data());
+
+		m_dirtyBegin = m_dirtyEnd = 0;
+		m_resized = false;
+
+		return true;
+	}
+
+	if (m_dirtyBegin < m_dirtyEnd) {
+		buffer.update(sizeof(uint32_t) * m_dirtyBegin, sizeof(uint32_t) * (m_dirtyEnd - m_dirtyBegin),
+			&m_words[m_dirtyBegin]);
+
+		m_dirtyBegin = m_dirtyEnd = 0;
+	}
+
+	return false;
+}
+
+const uint32_t * SelectionSet::data() const
+{
+	return m_words.data();
+}
+
+void SelectionSet::applyRange(uint32_t first, uint32_t last, RangeOp op)
+{
+	if (m_idCount == 0 || first > last || first >= m_idCount)
+		return;
+
+	last = std::min(last, m_idCount - 1);
+
+	size_t first_word = first >> 5;
+	size_t last_word = last >> 5;
+
+	for (size_t w = first_word; w <= last_word; w++) {
+		// mask of bits inside [first, last] for this word
+		uint32_t lo = (w == first_word) ? (first & 31) : 0;
+		uint32_t hi = (w == last_word) ? (last & 31) : 31;
+		uint32_t mask = (hi == 31 ? ~0u : ((1u << (hi + 1)) - 1u)) & ~((1u << lo) - 1u);
+
+		switch (op) {
+		case RO_SET:    m_words[w] |= mask;  break;
+		case RO_CLEAR:  m_words[w] &= ~mask; break;
+		case RO_TOGGLE: m_words[w] ^= mask;  break;
+		}
+	}
+
+	markDirty(first_word, last_word + 1);
+}
+
+void SelectionSet::markDirty(size_t begin, size_t end)
+{
+	if (m_dirtyBegin == m_dirtyEnd) {
+		m_dirtyBegin = begin;
+		m_dirtyEnd = end;
+	}
+	else {
+		m_dirtyBegin = std::min(m_dirtyBegin, begin);
+		m_dirtyEnd = std::max(m_dirtyEnd, end);
+	}
+}
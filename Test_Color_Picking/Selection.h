@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+class Buffer;
+
+/************************************************************/
+/*															*/
+// Selection Set
+/*															*/
+/************************************************************/
+
+/*
+	one bit per pick id, uploaded as a shader storage buffer (uint[]).
+	range functions work on whole 32 bit words, so millions of ids are cheap.
+
+	range:
+	[first, last] is inclusive.
+*/
+class SelectionSet
+{
+	std::vector<uint32_t> m_words;
+	uint32_t m_idCount = 0;
+
+	// dirty words [begin, end)
+	size_t m_dirtyBegin = 0;
+	size_t m_dirtyEnd = 0;
+	bool m_resized = false;
+
+public:
+	SelectionSet() = default;
+	~SelectionSet() = default;
+
+	/*
+		id_count:
+		ids 0 ~ id_count - 1 can be selected. selection of remaining ids is kept.
+	*/
+	void resize(uint32_t id_count);
+	uint32_t getIdCount() const;
+
+	void set(uint32_t id);
+	void clear(uint32_t id);
+	void toggle(uint32_t id);
+	bool isSelected(uint32_t id) const;
+
+	void setRange(uint32_t first, uint32_t last);
+	void clearRange(uint32_t first, uint32_t last);
+	void toggleRange(uint32_t first, uint32_t last);
+	void clearAll();
+
+	/*
+		return: number of selected ids.
+	*/
+	uint32_t count() const;
+
+	/*
+		only dirty words are uploaded. buffer is recreated when resized.
+		return: true if the buffer was recreated.
+	*/
+	bool upload(Buffer& buffer);
+
+	const uint32_t* data() const;
+
+private:
+	enum RangeOp { RO_SET, RO_CLEAR, RO_TOGGLE };
+
+	void applyRange(uint32_t first, uint32_t last, RangeOp op);
+	void markDirty(size_t begin, size_t end);
+};
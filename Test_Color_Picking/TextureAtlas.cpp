@@ -0,0 +1,220 @@
+#include <stb_image.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "TextureAtlas.h"
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Texture Atlas														  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+TextureAtlas::TextureAtlas(int layer_size, int border)
+	: m_layerSize(std::max(layer_size, 1)), m_border(1)
+{
+	while (m_border < border)
+		m_border *= 2;
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	destroy();
+}
+
+int TextureAtlas::add(const char *image_file)
+{
+	if (m_texture)
+		return -1;
+
+	for (size_t i = 0; i < m_images.size(); i++)
+		if (m_images[i].path == image_file)
+			return (int)i;
+
+	stbi_set_flip_vertically_on_load(true);
+
+	Image image;
+	int channel;
+	image.pixels = stbi_load(image_file, &image.width, &image.height, &channel, 4);
+	if (!image.pixels) {
+		printf("texture: can not load %s\n", image_file);
+		return -1;
+	}
+
+	// a layer of its own, or a cell with the border on both sides (see build())
+	auto align = [this](int value) { return (value + m_border - 1) / m_border * m_border; };
+	bool whole = image.width == m_layerSize && image.height == m_layerSize;
+	if (!whole && (align(image.width + 2 * m_border) > m_layerSize || align(image.height + 2 * m_border) > m_layerSize)) {
+		printf("texture: %s (%d x %d) is larger than a layer\n", image_file, image.width, image.height);
+		stbi_image_free(image.pixels);
+		return -1;
+	}
+
+	image.path = image_file;
+	m_images.push_back(image);
+	m_regions.emplace_back();
+
+	return (int)m_images.size() - 1;
+}
+
+bool TextureAtlas::build()
+{
+	if (m_texture || m_images.empty())
+		return false;
+
+	int size = m_layerSize;
+	int border = m_border;
+	auto align = [border](int value) { return (value + border - 1) / border * border; };
+
+	// whole layers first, then shelves of the packed textures, tallest first
+	std::vector<int> packed;
+	for (int i = 0; i < (int)m_images.size(); i++) {
+		const Image& image = m_images[i];
+		if (image.width == size && image.height == size) {
+			m_regions[i].layer = m_layerCount++;
+			m_regions[i].scale = glm::vec2(1.f);
+			m_regions[i].offset = glm::vec2(0.f);
+		}
+		else {
+			packed.push_back(i);
+		}
+	}
+	std::sort(packed.begin(), packed.end(), [this](int a, int b) {
+		return m_images[a].height > m_images[b].height;
+	});
+
+	// cell: texture and border, aligned to border. cell origins of packed textures.
+	int first_packed_layer = m_layerCount;
+	std::vector<glm::ivec2> cells(m_images.size());
+	int x = 0, y = 0, shelf = 0;
+	if (!packed.empty())
+		m_layerCount++;
+	for (int i : packed) {
+		int w = align(m_images[i].width + 2 * border);
+		int h = align(m_images[i].height + 2 * border);
+		if (x + w > size) {
+			x = 0;
+			y += shelf;
+			shelf = 0;
+		}
+		if (y + h > size) {
+			x = y = shelf = 0;
+			m_layerCount++;
+		}
+
+		cells[i] = glm::ivec2(x, y);
+		m_regions[i].layer = m_layerCount - 1;
+		m_regions[i].scale = glm::vec2((float)m_images[i].width, (float)m_images[i].height) / (float)size;
+		m_regions[i].offset = glm::vec2((float)(x + border), (float)(y + border)) / (float)size;
+
+		x += w;
+		shelf = std::max(shelf, h);
+	}
+
+	// packed layers stop at mip log2(border), coarser mips would mix neighbouring cells.
+	int levels = 1;
+	while ((size >> levels) > 0 && (packed.empty() || (border >> levels) > 0))
+		levels++;
+
+	glGenTextures(1, &m_texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, size, size, m_layerCount);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t i = 0; i < m_images.size(); i++)
+		if (m_regions[i].layer < first_packed_layer)
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, m_regions[i].layer, size, size, 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, m_images[i].pixels);
+
+	// packed layers are composed in memory, borders repeat the edge texels.
+	std::vector<unsigned char> layer;
+	for (int l = first_packed_layer; l < m_layerCount; l++) {
+		layer.assign((size_t)size * size * 4, 0);
+
+		for (int i : packed) {
+			if (m_regions[i].layer != l)
+				continue;
+
+			const Image& image = m_images[i];
+			size_t row_bytes = (size_t)image.width * 4;
+			for (int row = -border; row < image.height + border; row++) {
+				const unsigned char *src = image.pixels + row_bytes * std::min(std::max(row, 0), image.height - 1);
+				unsigned char *dst = &layer[((size_t)(cells[i].y + border + row) * size + cells[i].x) * 4];
+
+				for (int k = 0; k < border; k++)
+					memcpy(dst + k * 4, src, 4);
+				memcpy(dst + border * 4, src, row_bytes);
+				for (int k = 0; k < border; k++)
+					memcpy(dst + row_bytes + (border + k) * 4, src + row_bytes - 4, 4);
+			}
+		}
+
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, l, size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer.data());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	freeImages();
+
+	return true;
+}
+
+void TextureAtlas::destroy()
+{
+	if (m_texture)
+		glDeleteTextures(1, &m_texture);
+	m_texture = 0;
+	m_layerCount = 0;
+
+	freeImages();
+	m_images.clear();
+	m_regions.clear();
+}
+
+void TextureAtlas::bind(int unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+}
+
+void TextureAtlas::unbind(int unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+const TextureAtlas::Region& TextureAtlas::getRegion(int texture) const
+{
+	return m_regions[texture];
+}
+
+int TextureAtlas::getTextureCount() const
+{
+	return (int)m_images.size();
+}
+
+int TextureAtlas::getLayerCount() const
+{
+	return m_layerCount;
+}
+
+GLuint TextureAtlas::getTexture() const
+{
+	return m_texture;
+}
+
+void TextureAtlas::freeImages()
+{
+	for (Image& image : m_images) {
+		stbi_image_free(image.pixels);
+		image.pixels = nullptr;
+	}
+}
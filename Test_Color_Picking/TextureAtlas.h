@@ -0,0 +1,86 @@
+#pragma once
+#include <gl/glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+/************************************************************/
+/*															*/
+// Texture Atlas
+/*															*/
+/************************************************************/
+
+/*
+	textures of a scene in one GL_TEXTURE_2D_ARRAY (rgba8), so every
+	textured object is drawn with the same bind.
+	a layer_size x layer_size texture gets a layer of its own, smaller ones
+	are packed into shared layers. packed textures are surrounded by border
+	copies of their edge texels and aligned to border, so mip levels up to
+	log2(border) do not bleed into the neighbours. if any texture is packed,
+	the mip chain of the array ends at log2(border).
+
+	a texture is addressed by its Region, which is stored per instance
+	(see TransformStore::setTexture). packed regions do not repeat,
+	uv is clamped to [0, 1] first.
+
+	usage:
+	add() every texture, build() once, then bind() before drawing.
+*/
+class TextureAtlas
+{
+public:
+	struct Region {
+		int layer = -1;							// -1 is untextured
+		glm::vec2 scale = glm::vec2(1.f);		// layer uv = uv * scale + offset
+		glm::vec2 offset = glm::vec2(0.f);
+	};
+
+private:
+	struct Image {
+		std::string path;
+		unsigned char *pixels = nullptr;		// rgba8, freed by build()
+		int width = 0;
+		int height = 0;
+	};
+
+	GLuint m_texture = 0;
+	int m_layerSize;
+	int m_border;
+	int m_layerCount = 0;
+	std::vector<Image> m_images;
+	std::vector<Region> m_regions;
+
+public:
+	/*
+		layer_size: width and height of a layer.
+		border: texels around a packed texture, rounded up to a power of two.
+	*/
+	explicit TextureAtlas(int layer_size = 1024, int border = 8);
+	~TextureAtlas();
+	TextureAtlas(const TextureAtlas&) = delete;
+	TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+	/*
+		loads an image, the same path is loaded once.
+		return: texture index, -1 if it can not be loaded, is larger than a layer
+		or build() was called.
+	*/
+	int add(const char *image_file);
+	/*
+		packs the added textures and creates the array with mipmaps.
+		called once after the last add(), the images are freed.
+	*/
+	bool build();
+	void destroy();
+
+	void bind(int unit = 0);
+	static void unbind(int unit = 0);
+
+	const Region& getRegion(int texture) const;
+	int getTextureCount() const;
+	int getLayerCount() const;
+	GLuint getTexture() const;
+
+private:
+	void freeImages();
+};
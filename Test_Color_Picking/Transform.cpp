@@ -0,0 +1,482 @@
+#include <gl/glew.h>
+#include <algorithm>
+#include <cmath>
+#include "GLObject.h"
+#include "Parallel.h"
+#include "Transform.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define TRANSFORM_USE_SSE
+#endif
+
+/*////////////////////////////////////////////////////////////////////////*/
+/*																		  */
+/* Transform Store														  */
+/*																		  */
+/*////////////////////////////////////////////////////////////////////////*/
+
+int TransformStore::add(const glm::vec3& position, const glm::vec4& rotation,
+	const glm::vec3& scale, int parent)
+{
+	int index = size();
+
+	m_px.push_back(position.x);
+	m_py.push_back(position.y);
+	m_pz.push_back(position.z);
+	m_rx.push_back(rotation.x);
+	m_ry.push_back(rotation.y);
+	m_rz.push_back(rotation.z);
+	m_rw.push_back(rotation.w);
+	m_sx.push_back(scale.x);
+	m_sy.push_back(scale.y);
+	m_sz.push_back(scale.z);
+	m_parent.push_back(parent < index ? parent : -1);
+	m_visible.push_back(1);
+	m_dirty.push_back(0);
+
+	InstanceData instance = {};
+	instance.id = index + 1;
+	m_instances.push_back(instance);
+
+	if (parent >= 0)
+		m_hasParent = true;
+
+	m_resized = true;
+	markDirty(index);
+
+	return index;
+}
+
+void TransformStore::clear()
+{
+	m_px.clear(); m_py.clear(); m_pz.clear();
+	m_rx.clear(); m_ry.clear(); m_rz.clear(); m_rw.clear();
+	m_sx.clear(); m_sy.clear(); m_sz.clear();
+	m_parent.clear();
+	m_visible.clear();
+	m_dirty.clear();
+	m_instances.clear();
+	m_dirtyList.clear();
+	m_updatedList.clear();
+	m_uploadList.clear();
+	m_hasParent = false;
+	m_resized = true;
+	m_version++;
+}
+
+void TransformStore::reserve(int count)
+{
+	m_px.reserve(count); m_py.reserve(count); m_pz.reserve(count);
+	m_rx.reserve(count); m_ry.reserve(count); m_rz.reserve(count); m_rw.reserve(count);
+	m_sx.reserve(count); m_sy.reserve(count); m_sz.reserve(count);
+	m_parent.reserve(count);
+	m_visible.reserve(count);
+	m_dirty.reserve(count);
+	m_instances.reserve(count);
+}
+
+int TransformStore::size() const
+{
+	return (int)m_parent.size();
+}
+
+int TransformStore::append(int count)
+{
+	int first = size();
+	int total = first + count;
+
+	m_px.resize(total, 0.f); m_py.resize(total, 0.f); m_pz.resize(total, 0.f);
+	m_rx.resize(total, 0.f); m_ry.resize(total, 0.f); m_rz.resize(total, 0.f); m_rw.resize(total, 1.f);
+	m_sx.resize(total, 1.f); m_sy.resize(total, 1.f); m_sz.resize(total, 1.f);
+	m_parent.resize(total, -1);
+	m_visible.resize(total, 1);
+	m_dirty.resize(total, 0);
+	m_instances.resize(total, InstanceData());
+	for (int index = first; index < total; index++)
+		m_instances[index].id = index + 1;
+
+	m_resized = true;
+
+	return first;
+}
+
+void TransformStore::assign(int index, const glm::vec3& position, const glm::vec4& rotation,
+	const glm::vec3& scale, int parent, uint32_t id)
+{
+	m_px[index] = position.x;
+	m_py[index] = position.y;
+	m_pz[index] = position.z;
+	m_rx[index] = rotation.x;
+	m_ry[index] = rotation.y;
+	m_rz[index] = rotation.z;
+	m_rw[index] = rotation.w;
+	m_sx[index] = scale.x;
+	m_sy[index] = scale.y;
+	m_sz[index] = scale.z;
+	m_parent[index] = parent < index ? parent : -1;
+	m_instances[index].id = id != 0 ? id : (uint32_t)index + 1;
+}
+
+void TransformStore::commit(int first, int count)
+{
+	m_dirtyList.reserve(m_dirtyList.size() + count);
+
+	for (int index = first; index < first + count; index++) {
+		if (m_parent[index] >= 0)
+			m_hasParent = true;
+		if (!m_dirty[index]) {
+			m_dirty[index] = 1;
+			m_dirtyList.push_back(index);
+		}
+	}
+
+	m_version++;
+}
+
+void TransformStore::setPosition(int index, const glm::vec3& position)
+{
+	m_px[index] = position.x;
+	m_py[index] = position.y;
+	m_pz[index] = position.z;
+	markDirty(index);
+}
+
+void TransformStore::setRotation(int index, const glm::vec4& rotation)
+{
+	m_rx[index] = rotation.x;
+	m_ry[index] = rotation.y;
+	m_rz[index] = rotation.z;
+	m_rw[index] = rotation.w;
+	markDirty(index);
+}
+
+void TransformStore::setRotation(int index, const glm::vec3& axis, float radian)
+{
+	glm::vec3 n = glm::normalize(axis);
+	float s = std::sin(radian * 0.5f);
+
+	setRotation(index, glm::vec4(n.x * s, n.y * s, n.z * s, std::cos(radian * 0.5f)));
+}
+
+void TransformStore::setScale(int index, const glm::vec3& scale)
+{
+	m_sx[index] = scale.x;
+	m_sy[index] = scale.y;
+	m_sz[index] = scale.z;
+	markDirty(index);
+}
+
+void TransformStore::setParent(int index, int parent)
+{
+	if (parent >= index)
+		return;
+
+	m_parent[index] = parent;
+	if (parent >= 0)
+		m_hasParent = true;
+	markDirty(index);
+}
+
+void TransformStore::setId(int index, uint32_t id)
+{
+	m_instances[index].id = id;
+	markDirty(index);
+}
+
+void TransformStore::setTexture(int index, int layer, const glm::vec2& uv_scale, const glm::vec2& uv_offset)
+{
+	auto unorm16 = [](const glm::vec2& v) {
+		uint32_t x = (uint32_t)(glm::clamp(v.x, 0.f, 1.f) * 65535.f + 0.5f);
+		uint32_t y = (uint32_t)(glm::clamp(v.y, 0.f, 1.f) * 65535.f + 0.5f);
+		return x | (y << 16);
+	};
+
+	InstanceData& d = m_instances[index];
+	d.layer = layer >= 0 ? (uint32_t)layer + 1 : 0;
+	d.uvScale = unorm16(uv_scale);
+	d.uvOffset = unorm16(uv_offset);
+	markDirty(index);
+}
+
+void TransformStore::setVisible(int index, bool visible)
+{
+	m_visible[index] = visible ? 1 : 0;
+	markDirty(index);
+}
+
+glm::vec3 TransformStore::getPosition(int index) const
+{
+	return glm::vec3(m_px[index], m_py[index], m_pz[index]);
+}
+
+glm::vec4 TransformStore::getRotation(int index) const
+{
+	return glm::vec4(m_rx[index], m_ry[index], m_rz[index], m_rw[index]);
+}
+
+glm::vec3 TransformStore::getScale(int index) const
+{
+	return glm::vec3(m_sx[index], m_sy[index], m_sz[index]);
+}
+
+int TransformStore::getParent(int index) const
+{
+	return m_parent[index];
+}
+
+uint32_t TransformStore::getId(int index) const
+{
+	return m_instances[index].id;
+}
+
+bool TransformStore::isVisible(int index) const
+{
+	return m_visible[index] != 0;
+}
+
+const glm::mat4& TransformStore::getWorld(int index) const
+{
+	return m_instances[index].model;
+}
+
+int TransformStore::update()
+{
+	m_updatedList.clear();
+
+	if (m_dirtyList.empty())
+		return 0;
+
+	if (m_hasParent) {
+		// children of dirty parents become dirty, parents come first.
+		int first = *std::min_element(m_dirtyList.begin(), m_dirtyList.end());
+		m_dirtyList.clear();
+
+		for (int i = first; i < size(); i++) {
+			int parent = m_parent[i];
+			if (!m_dirty[i] && parent >= 0 && m_dirty[parent])
+				m_dirty[i] = 1;
+			if (m_dirty[i])
+				m_dirtyList.push_back(i);
+		}
+	}
+	else {
+		std::sort(m_dirtyList.begin(), m_dirtyList.end());
+	}
+
+	// indices are disjoint, so large batches (scene loads) are split over threads.
+	parallelFor(0, (int)m_dirtyList.size(), [this](int begin, int end) {
+		computeLocal(m_dirtyList.data() + begin, end - begin);
+	}, 16384);
+
+	for (int index : m_dirtyList) {
+		int parent = m_parent[index];
+		if (parent >= 0) {
+			InstanceData& child = m_instances[index];
+			const InstanceData& p = m_instances[parent];
+
+			child.model = p.model * child.model;
+
+			glm::vec4 n[3];
+			for (int c = 0; c < 3; c++) {
+				n[c] = p.normal[0] * child.normal[c].x
+					+ p.normal[1] * child.normal[c].y
+					+ p.normal[2] * child.normal[c].z;
+			}
+			child.normal[0] = n[0];
+			child.normal[1] = n[1];
+			child.normal[2] = n[2];
+		}
+
+		if (!m_visible[index])
+			m_instances[index].model = glm::mat4(0.f);
+
+		m_dirty[index] = 0;
+	}
+
+	int count = (int)m_dirtyList.size();
+
+	if (!m_resized)
+		m_uploadList.insert(m_uploadList.end(), m_dirtyList.begin(), m_dirtyList.end());
+	m_updatedList.swap(m_dirtyList);
+	m_dirtyList.clear();
+
+	return count;
+}
+
+const std::vector<int>& TransformStore::getUpdated() const
+{
+	return m_updatedList;
+}
+
+bool TransformStore::upload(Buffer& instance_buffer, Buffer& index_buffer)
+{
+	size_t instance_size = sizeof(InstanceData) * m_instances.size();
+
+	if (instance_size == 0)
+		return false;
+
+	// recreate buffers when the store was resized.
+	if (m_resized || instance_buffer.getSize() != instance_size) {
+		std::vector<GLuint> index(m_instances.size());
+		for (size_t i = 0; i < index.size(); i++)
+			index[i] = (GLuint)i;
+
+		if (instance_buffer.isCreated())
+			instance_buffer.destroy();
+		if (index_buffer.isCreated())
+			index_buffer.destroy();
+
+		instance_buffer.create(instance_size, m_instances.data());
+		index_buffer.create(sizeof(GLuint) * index.size(), index.data(), GL_STATIC_DRAW);
+
+		m_uploadList.clear();
+		m_resized = false;
+
+		return true;
+	}
+
+	if (m_uploadList.empty())
+		return false;
+
+	// only contiguous runs of changed instances are uploaded.
+	std::sort(m_uploadList.begin(), m_uploadList.end());
+	m_uploadList.erase(std::unique(m_uploadList.begin(), m_uploadList.end()), m_uploadList.end());
+
+	size_t run_begin = 0;
+	for (size_t i = 1; i <= m_uploadList.size(); i++) {
+		if (i == m_uploadList.size() || m_uploadList[i] != m_uploadList[i - 1] + 1) {
+			int first = m_uploadList[run_begin];
+			int count = m_uploadList[i - 1] - first + 1;
+			instance_buffer.update(sizeof(InstanceData) * first, sizeof(InstanceData) * count, &m_instances[first]);
+			run_begin = i;
+		}
+	}
+	m_uploadList.clear();
+
+	return false;
+}
+
+const TransformStore::InstanceData * TransformStore::data() const
+{
+	return m_instances.data();
+}
+
+uint64_t TransformStore::getVersion() const
+{
+	return m_version;
+}
+
+void TransformStore::markDirty(int index)
+{
+	m_version++;
+
+	if (!m_dirty[index]) {
+		m_dirty[index] = 1;
+		m_dirtyList.push_back(index);
+	}
+}
+
+/*
+	local = T * R * S
+	normal = transpose(inverse(R * S)) = R * inverse(S)
+*/
+void TransformStore::computeLocal(const int *index, int count)
+{
+	int i = 0;
+
+#ifdef TRANSFORM_USE_SSE
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 two = _mm_set1_ps(2.f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i < count; i += 4) {
+		// the last group is padded with the last index.
+		int id[4];
+		for (int k = 0; k < 4; k++)
+			id[k] = index[std::min(i + k, count - 1)];
+
+#define GATHER(v) _mm_set_ps(v[id[3]], v[id[2]], v[id[1]], v[id[0]])
+		__m128 x = GATHER(m_rx), y = GATHER(m_ry), z = GATHER(m_rz), w = GATHER(m_rw);
+		__m128 sx = GATHER(m_sx), sy = GATHER(m_sy), sz = GATHER(m_sz);
+		__m128 px = GATHER(m_px), py = GATHER(m_py), pz = GATHER(m_pz);
+#undef GATHER
+
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		// rotation, rRC: row R, column C
+		__m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		__m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		__m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+		__m128 r01 = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+		__m128 r10 = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+		__m128 r02 = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+		__m128 r20 = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+		__m128 r12 = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+		__m128 r21 = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+
+		__m128 isx = _mm_div_ps(one, sx), isy = _mm_div_ps(one, sy), isz = _mm_div_ps(one, sz);
+
+		// model columns
+		__m128 m0x = _mm_mul_ps(r00, sx), m0y = _mm_mul_ps(r10, sx), m0z = _mm_mul_ps(r20, sx), m0w = zero;
+		__m128 m1x = _mm_mul_ps(r01, sy), m1y = _mm_mul_ps(r11, sy), m1z = _mm_mul_ps(r21, sy), m1w = zero;
+		__m128 m2x = _mm_mul_ps(r02, sz), m2y = _mm_mul_ps(r12, sz), m2z = _mm_mul_ps(r22, sz), m2w = zero;
+		__m128 m3w = one;
+
+		// normal columns
+		__m128 n0x = _mm_mul_ps(r00, isx), n0y = _mm_mul_ps(r10, isx), n0z = _mm_mul_ps(r20, isx), n0w = zero;
+		__m128 n1x = _mm_mul_ps(r01, isy), n1y = _mm_mul_ps(r11, isy), n1z = _mm_mul_ps(r21, isy), n1w = zero;
+		__m128 n2x = _mm_mul_ps(r02, isz), n2y = _mm_mul_ps(r12, isz), n2z = _mm_mul_ps(r22, isz), n2w = zero;
+
+		// SoA -> AoS, each transposed register is one column of one instance.
+		_MM_TRANSPOSE4_PS(m0x, m0y, m0z, m0w);
+		_MM_TRANSPOSE4_PS(m1x, m1y, m1z, m1w);
+		_MM_TRANSPOSE4_PS(m2x, m2y, m2z, m2w);
+		_MM_TRANSPOSE4_PS(px, py, pz, m3w);
+		_MM_TRANSPOSE4_PS(n0x, n0y, n0z, n0w);
+		_MM_TRANSPOSE4_PS(n1x, n1y, n1z, n1w);
+		_MM_TRANSPOSE4_PS(n2x, n2y, n2z, n2w);
+
+		const __m128 model[4][4] = {
+			{ m0x, m1x, m2x, px },
+			{ m0y, m1y, m2y, py },
+			{ m0z, m1z, m2z, pz },
+			{ m0w, m1w, m2w, m3w },
+		};
+		const __m128 normal[4][3] = {
+			{ n0x, n1x, n2x },
+			{ n0y, n1y, n2y },
+			{ n0z, n1z, n2z },
+			{ n0w, n1w, n2w },
+		};
+
+		for (int k = 0; k < 4; k++) {
+			InstanceData& d = m_instances[id[k]];
+			for (int c = 0; c < 4; c++)
+				_mm_storeu_ps(&d.model[c][0], model[k][c]);
+			for (int c = 0; c < 3; c++)
+				_mm_storeu_ps(&d.normal[c][0], normal[k][c]);
+		}
+	}
+#else
+	for (; i < count; i++) {
+		int id = index[i];
+		float x = m_rx[id], y = m_ry[id], z = m_rz[id], w = m_rw[id];
+
+		glm::vec3 r0(1.f - 2.f * (y * y + z * z), 2.f * (x * y + w * z), 2.f * (x * z - w * y));
+		glm::vec3 r1(2.f * (x * y - w * z), 1.f - 2.f * (x * x + z * z), 2.f * (y * z + w * x));
+		glm::vec3 r2(2.f * (x * z + w * y), 2.f * (y * z - w * x), 1.f - 2.f * (x * x + y * y));
+
+		InstanceData& d = m_instances[id];
+		d.model[0] = glm::vec4(r0 * m_sx[id], 0.f);
+		d.model[1] = glm::vec4(r1 * m_sy[id], 0.f);
+		d.model[2] = glm::vec4(r2 * m_sz[id], 0.f);
+		d.model[3] = glm::vec4(m_px[id], m_py[id], m_pz[id], 1.f);
+		d.normal[0] = glm::vec4(r0 / m_sx[id], 0.f);
+		d.normal[1] = glm::vec4(r1 / m_sy[id], 0.f);
+		d.normal[2] = glm::vec4(r2 / m_sz[id], 0.f);
+	}
+#endif
+}
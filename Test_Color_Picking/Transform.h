@@ -0,0 +1,139 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+class Buffer;
+
+/************************************************************/
+/*															*/
+// Transform Store
+/*															*/
+/************************************************************/
+
+/*
+	positions, rotations, scales and parents are kept in SoA layout.
+	only dirty transforms (and their children) are recomputed by update().
+
+	parent:
+	-1 is root. parent index must be smaller than child index.
+*/
+class TransformStore
+{
+public:
+	/*
+		GPU layout of one instance (std430, 128 bytes).
+		normal is the columns of transpose(inverse(mat3(model))).
+		layer: texture array layer + 1 (0 is untextured), and the uv
+		transform of its region as unorm16 pairs (see TextureAtlas).
+	*/
+	struct InstanceData
+	{
+		glm::mat4 model;
+		glm::vec4 normal[3];
+		uint32_t id;
+		uint32_t layer;
+		uint32_t uvScale;
+		uint32_t uvOffset;
+	};
+
+private:
+	// SoA
+	std::vector<float> m_px, m_py, m_pz;
+	std::vector<float> m_rx, m_ry, m_rz, m_rw; // quaternion
+	std::vector<float> m_sx, m_sy, m_sz;
+	std::vector<int> m_parent;
+	std::vector<uint8_t> m_visible;
+	std::vector<uint8_t> m_dirty;
+
+	// world and normal matrices, mirror of the instance buffer
+	std::vector<InstanceData> m_instances;
+
+	std::vector<int> m_dirtyList;
+	std::vector<int> m_updatedList;
+	std::vector<int> m_uploadList;
+	bool m_hasParent = false;
+	bool m_resized = false;
+	uint64_t m_version = 0;
+
+public:
+	TransformStore() = default;
+	~TransformStore() = default;
+
+	/*
+		rotation:
+		quaternion (x, y, z, w), must be normalized.
+		return: index of the new transform.
+	*/
+	int add(const glm::vec3& position, const glm::vec4& rotation = glm::vec4(0, 0, 0, 1),
+		const glm::vec3& scale = glm::vec3(1.f), int parent = -1);
+	void clear();
+	void reserve(int count);
+	int size() const;
+	/*
+		bulk loading: appends count identity transforms.
+		return: index of the first new transform.
+		fill them with assign() (threads may assign disjoint indices),
+		then call commit() once.
+	*/
+	int append(int count);
+	void assign(int index, const glm::vec3& position, const glm::vec4& rotation,
+		const glm::vec3& scale, int parent, uint32_t id);
+	/*
+		marks [first, first + count) dirty after assign().
+	*/
+	void commit(int first, int count);
+
+	void setPosition(int index, const glm::vec3& position);
+	void setRotation(int index, const glm::vec4& rotation);
+	void setRotation(int index, const glm::vec3& axis, float radian);
+	void setScale(int index, const glm::vec3& scale);
+	void setParent(int index, int parent);
+	/*
+		id:
+		pick id written to the id buffer, default is index + 1 (0 is background).
+	*/
+	void setId(int index, uint32_t id);
+	/*
+		layer: texture array layer, -1 is untextured.
+		uv_scale, uv_offset: layer uv = uv * uv_scale + uv_offset, in [0, 1].
+	*/
+	void setTexture(int index, int layer, const glm::vec2& uv_scale, const glm::vec2& uv_offset);
+	/*
+		hidden instances (and their children) get a zero model matrix.
+	*/
+	void setVisible(int index, bool visible);
+
+	glm::vec3 getPosition(int index) const;
+	glm::vec4 getRotation(int index) const;
+	glm::vec3 getScale(int index) const;
+	int getParent(int index) const;
+	uint32_t getId(int index) const;
+	bool isVisible(int index) const;
+	const glm::mat4& getWorld(int index) const;
+
+	/*
+		return: number of recomputed transforms.
+	*/
+	int update();
+	/*
+		return: indices recomputed by the last update(), ascending.
+	*/
+	const std::vector<int>& getUpdated() const;
+	/*
+		writes recomputed instances into instance_buffer and keeps
+		index_buffer filled with 0, 1, 2 ... (see VAO::setInstanceBuffer).
+		return: true if the buffers were recreated.
+	*/
+	bool upload(Buffer& instance_buffer, Buffer& index_buffer);
+
+	const InstanceData* data() const;
+	/*
+		return: counter bumped by every transform and visibility edit.
+	*/
+	uint64_t getVersion() const;
+
+private:
+	void markDirty(int index);
+	void computeLocal(const int *index, int count);
+};
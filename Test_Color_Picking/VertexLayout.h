@@ -0,0 +1,106 @@
+#pragma once
+#include <gl/GL.h>
+#include <cstddef>
+#include <cstdint>
+
+/*
+	vertex layouts as types. a layout lists its attributes, and loaders and
+	the attribute setup are templates on the layout: the per vertex code is
+	compiled for one layout and has no format branches.
+
+	buffer layout: one tightly packed section per attribute, in list order.
+	ex) VertexLayout<PositionAttribute, NormalAttribute>
+	positions of all vertices, then normals of all vertices.
+*/
+
+// where an attribute comes from (obj element)
+enum VertexSource {
+	VS_POSITION,	// v
+	VS_NORMAL,		// vn
+	VS_TEXCOORD,	// vt
+	VS_COUNT,
+};
+
+/*
+	component type of a gl vertex format and its conversion from float.
+	a new format (ex. normalized GL_SHORT) is one more specialization.
+*/
+template <GLenum Type, bool Normalized>
+struct VertexComponent;
+
+template <>
+struct VertexComponent<GL_FLOAT, false>
+{
+	using type = float;
+	static float convert(float value) { return value; }
+};
+
+template <VertexSource Source, GLuint Location, int Size, GLenum Type = GL_FLOAT, bool Normalized = false>
+struct VertexAttribute
+{
+	using Component = VertexComponent<Type, Normalized>;
+
+	static constexpr VertexSource SOURCE = Source;
+	static constexpr GLuint LOCATION = Location;
+	static constexpr int SIZE = Size;
+	static constexpr GLenum TYPE = Type;
+	static constexpr GLboolean NORMALIZED = Normalized ? GL_TRUE : GL_FALSE;
+	static constexpr size_t STRIDE = sizeof(typename Component::type) * Size;
+};
+
+template <typename... Attributes>
+struct VertexLayout
+{
+	static constexpr int ATTRIBUTE_COUNT = sizeof...(Attributes);
+
+	/*
+		return: bytes of one vertex over all sections.
+	*/
+	static constexpr size_t getVertexBytes() {
+		const size_t strides[] = { Attributes::STRIDE... };
+		size_t bytes = 0;
+		for (size_t stride : strides)
+			bytes += stride;
+		return bytes;
+	}
+
+	static constexpr bool has(VertexSource source) {
+		const VertexSource sources[] = { Attributes::SOURCE... };
+		for (VertexSource s : sources)
+			if (s == source)
+				return true;
+		return false;
+	}
+
+	/*
+		return: byte offset of the section of source in a buffer of vertex_count vertices.
+	*/
+	static constexpr size_t getSectionOffset(VertexSource source, size_t vertex_count) {
+		const VertexSource sources[] = { Attributes::SOURCE... };
+		const size_t strides[] = { Attributes::STRIDE... };
+		size_t offset = 0;
+		for (int i = 0; i < ATTRIBUTE_COUNT && sources[i] != source; i++)
+			offset += strides[i] * vertex_count;
+		return offset;
+	}
+
+	/*
+		calls fn(Attribute()) for each attribute in list order.
+	*/
+	template <typename Fn>
+	static void forEach(Fn&& fn) {
+		int expand[] = { 0, (fn(Attributes()), 0)... };
+		(void)expand;
+	}
+};
+
+// attribute locations of the shaders (0 position, 1 normal, 2 texcoord, 3 instance)
+using PositionAttribute = VertexAttribute<VS_POSITION, 0, 3>;
+using NormalAttribute = VertexAttribute<VS_NORMAL, 1, 3>;
+using TexCoordAttribute = VertexAttribute<VS_TEXCOORD, 2, 2>;
+
+// layouts of VAO::load, by the elements the faces of the obj file use
+using LayoutP = VertexLayout<PositionAttribute>;
+using LayoutPN = VertexLayout<PositionAttribute, NormalAttribute>;
+using LayoutPT = VertexLayout<PositionAttribute, TexCoordAttribute>;
+using LayoutPNT = VertexLayout<PositionAttribute, NormalAttribute, TexCoordAttribute>;
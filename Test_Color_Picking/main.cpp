@@ -2,8 +2,32 @@
 #include <gl/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/gtx/transform.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include "FramePacer.h"
+#include "CoverageStats.h"
 #include "GLObject.h"
+#include "InputCapture.h"
+#include "MeshLod.h"
+#include "Memory.h"
+#include "Meshlet.h"
+#include "MultiView.h"
+#include "PickBatch.h"
+#include "PickCache.h"
+#include "PickReader.h"
+#include "RegionSelect.h"
+#include "Registry.h"
+#include "SceneFile.h"
+#include "Selection.h"
+#include "TextureAtlas.h"
+#include "Transform.h"
 
 #ifdef _DEBUG
 #include <cstdlib>
@@ -16,14 +40,41 @@ int g_x = 0;
 int g_y = 0;
 float g_aspect = (float)g_width / (float)g_height;
 bool g_pause = false;
+bool g_toggleSelect = false;
+bool g_dirty = true;
+bool g_showViews = false;
+bool g_deform = false;
+bool g_pickProxy = true;
+bool g_probeGrid = false;
+double g_targetFps = 60.0;
+// 애니메이션 시각 (재생 중에는 기록된 시각)
+double g_time = 0.0;
+InputCapture g_capture;
+
+// 영역 선택 (shift + 드래그: 사각형, ctrl + 드래그: 올가미, alt: 가려진 객체 포함)
+enum RegionMode { RM_NONE, RM_RECTANGLE, RM_LASSO };
+RegionMode g_regionMode = RM_NONE;
+bool g_regionAll = false;
+bool g_regionDone = false;
+std::vector<glm::vec2> g_regionPoints;
 
 void initContext(bool useDefault, int major = 3, int minor = 3, bool useCompatibility = false);
 void framebufferSizeCallback(GLFWwindow*, int w, int h);
 void mousebuttonCallback(GLFWwindow*, int btn, int act, int);
 void cursorPosCallback(GLFWwindow*, double x, double y);
+void windowRefreshCallback(GLFWwindow*);
+void keyCallback(GLFWwindow*, int key, int scancode, int action, int mods);
 
 class Scene
 {
+	// probe grid (B) resolved by one compute gather per frame (100 x 100 points)
+	static constexpr int PROBE_GRID = 100;
+	// views of the multi view wall, shown in tiles 1 ~ 8 of logQR
+	static constexpr int VIEW_COUNT = 8;
+	static constexpr int VIEW_SIZE = 512;
+	// color.frag uniform, lod level written next to the triangle id
+	static constexpr GLint LOD_LEVEL_LOCATION = 2;
+
 	// objects
 	FBO colorFBO;
 	FBO pickFBO;
@@ -33,25 +84,308 @@ class Scene
 	VAO monkeyVAO;
 	QuadRenderer logQR;
 	QuadRenderer baseQR;
+	TransformStore transforms;
+	SceneFile sceneFile;
+	std::vector<VAO*> meshVAOs;		// per scene file mesh
+	Registry<VAO> meshRegistry;		// meshes other than ball and monkey
+	std::deque<MeshLod> meshLods;	// per scene file mesh
+	TextureAtlas textureAtlas;		// textures of the scene file meshes, one bind
+	Buffer lodOrderBuffer;			// instances of each mesh sorted by lod level
+	std::vector<GLuint> lodOrder;
+	uint64_t lodVersion = ~0ull;
+	glm::mat4 lodViewProj;
+	bool proxyActive = false;
+	MeshletCuller meshletCuller;
+	std::vector<int> meshlets;		// per scene file mesh, culler handle (-1 if none)
+	Buffer instanceBuffer;
+	Buffer instanceIndexBuffer;
+	SelectionSet selection;
+	Buffer selectionBuffer;
+	uint32_t hoverId = 0;
+	uint64_t renderedVersion = ~0ull;
+	uint64_t geometryVersion = 0;
+	std::vector<glm::vec3> basePositions;
+	std::vector<float> deformed;
+	std::vector<float> deformedNormals;
+	bool monkeyDeformed = false;	// meshlet bounds of the monkey are stale
+	InstanceBVH sceneBVH;
+	PickCache pickCache;
+	PickReader pickReader;
+	PickResult hoverHit;
+	PickBatch pickBatch;
+	std::vector<glm::ivec2> probes;
+	glm::ivec2 probeSize{ 0 };	// id buffer size of probes
+	std::vector<PickBatch::Hit> probeHits;
+	int probeHitCount = 0;
+	uint64_t frameIndex = 0;
+	Arena frameArena{ 1 << 16 };	// scratch of one render(), reset every frame
+	RegionSelect regionSelect;
+	std::vector<uint32_t> regionIds;
+	CoverageStats coverage;
+	MultiView multiView;
+	uint64_t multiViewVersion = ~0ull;
+	bool sharedDepth = false;
+	GpuTimer pickTimer;
+	glm::mat4 pmat;
+	glm::mat4 vmat;
 
 public:
-	bool create() {
+	/*
+		scene_file: text or binary scene (see SceneFile).
+		save_file: if not nullptr, the loaded scene is written there as binary.
+	*/
+	bool create(const char *scene_file, const char *save_file = nullptr) {
+		MemoryScope memory_scope(MS_LOAD);
+
 		//if (!) return false;
-		if (!colorFBO.create(2048, 2048)) return false;
+		// id buffer: (id, normal), (triangle, barycentric)
+		if (!colorFBO.create(2048, 2048, { GL_RGBA32F, GL_RG32UI })) return false;
 		if (!pickFBO.create(2048, 2048)) return false;
+		// 피킹 이미지는 색상 이미지의 깊이를 그대로 씁니다. (같은 삼각형을 그릴 때만)
+		proxyActive = usesProxy();
+		sharedDepth = !proxyActive && pickFBO.shareDepth(colorFBO);
+		pickTimer.create();
 		if (!colorShader.load("resources/shaders/color")) return false;
 		if (!pickShader.load("resources/shaders/pick")) return false;
 		if (!ballVAO.load("resources/objects/ball.obj")) return false;
 		if (!monkeyVAO.load("resources/objects/monkey.obj")) return false;
+		if (!pickReader.create()) return false;
+		if (!pickBatch.create("resources/Shaders/gather.comp")) return false;
+		if (!regionSelect.create("resources/Shaders/region.comp",
+			"resources/Shaders/color.vert", "resources/Shaders/region.frag")) return false;
+		if (!coverage.create("resources/Shaders/coverage.comp")) return false;
+		if (!meshletCuller.create("resources/Shaders/cull.comp")) return false;
+		coverage.setInterval(30);
+		if (!multiView.create(VIEW_SIZE, VIEW_SIZE, VIEW_COUNT, "resources/Shaders/multiview.vert",
+			"resources/Shaders/multiview.geom", "resources/Shaders/color.frag")) return false;
+
+		// 원점을 둘러싼 카메라들
+		std::vector<glm::mat4> views;
+		for (int i = 0; i < VIEW_COUNT; i++) {
+			float angle = 6.2831853f * (float)i / (float)VIEW_COUNT;
+			glm::vec3 eye(12.f * std::sin(angle), 3.f, 12.f * std::cos(angle));
+			views.push_back(glm::perspective(45.f, 1.f, 0.1f, 100.f)
+				* glm::lookAt(eye, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0)));
+		}
+		multiView.setViews(views);
 
 		logQR.create(3, 3);
 
+		// 장면 파일 (메쉬, 인스턴스, 트랜스폼, 피킹 id)
+		if (!sceneFile.load(scene_file, transforms)) return false;
+		printf("scene: %d meshes, %d instances, %.3f s\n",
+			(int)sceneFile.getMeshes().size(), transforms.size(), sceneFile.getLoadTime());
+		// meshVAOs, lod and meshlets keep pointers, the registry must not grow while loading.
+		meshRegistry.reserve(sceneFile.getMeshes().size());
+		for (const auto& mesh : sceneFile.getMeshes()) {
+			VAO *vao = loadMesh(mesh.path);
+			if (!vao) return false;
+			meshVAOs.push_back(vao);
+
+			// 메시렛 (삼각형 순서가 메시렛 순서로 바뀝니다)
+			meshlets.push_back(meshletCuller.addMesh(*vao));
+			if (meshlets.back() >= 0)
+				printf("meshlets %s: %d\n", mesh.name.c_str(), meshletCuller.getMeshletCount(meshlets.back()));
+
+			// LOD 체인 (QEM 단순화)
+			meshLods.emplace_back();
+			meshLods.back().build(*vao);
+			printf("lod %s:", mesh.name.c_str());
+			for (int level = 0; level < meshLods.back().getLevelCount(); level++)
+				printf(" %d", meshLods.back().getTriangleCount(level));
+			printf(" triangles, pick proxy level %d\n", meshLods.back().getProxyLevel());
+		}
+		if (!loadTextures()) return false;
+		if (save_file && !sceneFile.save(save_file, transforms)) return false;
+
+		// 변형 애니메이션의 기준 위치 (메시렛 순서로 바뀐 뒤)
+		for (int i = 0; i < monkeyVAO.getVertexCount(); i++)
+			basePositions.push_back(monkeyVAO.getBVH().getVertex(i));
+
 		return true;
 	}
 
 	void render() {
-		// 색상 이미지 만들기
-		makeColorMap();
+		// 프레임 중의 힙 할당은 MS_FRAME으로 셉니다. (임시 메모리는 frameArena)
+		MemoryScope memory_scope(MS_FRAME);
+		frameArena.reset();
+		frameIndex++;
+
+		// 변경된 트랜스폼만 계산하고 업로드
+		transforms.update();
+		transforms.upload(instanceBuffer, instanceIndexBuffer);
+
+		// 정점 변형 (바뀐 범위만 스트림 버퍼로 올리고 메쉬 BVH 리핏)
+		bool geometry_changed = false;
+		if (g_deform) {
+			deform((float)g_time);
+			monkeyVAO.flushUpdates();
+			geometryVersion++;
+			geometry_changed = true;
+		}
+		updatePickDepth();
+		renderedVersion = sceneVersion();
+
+		// 움직인 객체만 BVH 리핏 (장면의 크기가 바뀐 경우만 새로 만듭니다)
+		// 품질이 나빠지면 refit()이 다시 만듭니다.
+		if (sceneBVH.size() != transforms.size()) {
+			sceneBVH.build(transforms.size(), [this](int index) {
+				return instanceVAO(index).getBounds().transform(transforms.getWorld(index));
+			});
+		}
+		else {
+			for (int index : transforms.getUpdated())
+				sceneBVH.insert(index, instanceVAO(index).getBounds().transform(transforms.getWorld(index)));
+
+			// 변형된 메쉬(원숭이)의 인스턴스만 경계가 바뀝니다.
+			if (geometry_changed) {
+				const auto& meshes = sceneFile.getMeshes();
+				for (size_t i = 0; i < meshes.size(); i++) {
+					if (meshVAOs[i] != &monkeyVAO)
+						continue;
+					for (int index = meshes[i].first; index < meshes[i].first + meshes[i].count; index++)
+						sceneBVH.update(index, monkeyVAO.getBounds().transform(transforms.getWorld(index)));
+				}
+			}
+		}
+		sceneBVH.refit();
+
+		// 카메라
+		pmat = glm::perspective(45.f, g_aspect, 0.1f, 100.f);
+		vmat = glm::lookAt(glm::vec3(0, 0, 10), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+
+		// 색상 이미지 만들기 (카메라나 장면이 바뀐 경우만)
+		glm::mat4 view_proj = pmat * vmat;
+		uint64_t version = sceneVersion();
+		updateLod(view_proj, version);
+		meshletCuller.poll();
+		if (pickCache.needsIdPass(view_proj, version)) {
+			makeColorMap();
+			pickCache.storeIdPass(view_proj, version);
+		}
+
+		// 여러 카메라의 색상 이미지를 한번의 드로우로 (장면이 바뀐 경우만)
+		if (g_showViews && multiViewVersion != version) {
+			multiView.render([this]() { renderScene(usesProxy(), false, LOD_LEVEL_LOCATION); });
+			multiViewVersion = version;
+		}
+
+		// 객체별 화면 점유 픽셀 수와 영역 (coverage.getInterval() 프레임마다)
+		coverage.update(colorFBO, transforms.size() + 1);
+		coverage.poll();
+
+		// 마우스 아래의 id (커서, 카메라, 장면이 바뀐 경우만 읽음)
+		// 결과는 몇 프레임 뒤에 도착합니다.
+		// 카메라 벽이 보이면 커서 아래 타일의 카메라에서 읽습니다.
+		int view = hoverView();
+		const FBO& pick_fbo = view < 0 ? colorFBO : multiView.getFBO();
+		glm::mat4 pick_view_proj = view < 0 ? view_proj : multiView.getViewProj(view);
+		int x, y;
+		if (view < 0) {
+			x = (int)((float)g_x / (float)g_width * colorFBO.getWidth());
+			y = (int)((float)(g_height - g_y) / (float)g_height * colorFBO.getHeight());
+		}
+		else {
+			int row, col;
+			float s, t;
+			logQR.hitTile((float)g_x / (float)g_width, (float)g_y / (float)g_height, row, col, s, t);
+			x = (int)(s * VIEW_SIZE);
+			y = (int)(t * VIEW_SIZE);
+		}
+
+		uint32_t cached_id;
+		if (!pickCache.lookup(x, y, pick_view_proj, version, cached_id)) {
+			if (x < 0 || y < 0 || x >= pick_fbo.getWidth() || y >= pick_fbo.getHeight()) {
+				hoverHit = PickResult();
+				pickCache.store(x, y, pick_view_proj, version, 0);
+			}
+			else {
+				pickReader.request(pick_fbo, x, y, pick_view_proj, version, view < 0 ? 0 : view);
+			}
+		}
+
+		PickResult result;
+		if (pickReader.poll(result)) {
+			hoverHit = result;
+			pickCache.store(result.x, result.y, result.viewProj, result.version, result.id);
+		}
+		hoverId = hoverHit.id;
+
+		// 여러 점을 한번에 피킹 (한번의 compute 디스패치와 한번의 읽기, B로 켭니다)
+		if (g_probeGrid) {
+			updateProbes();
+			pickBatch.submit(colorFBO, probes, frameIndex);
+		}
+		uint64_t probe_frame;
+		if (pickBatch.poll(probeHits, probe_frame))
+			probeHitCount = (int)std::count_if(probeHits.begin(), probeHits.end(),
+				[](const PickBatch::Hit& hit) { return hit.id != 0; });
+
+		// 영역 선택 (결과는 몇 프레임 뒤에 도착합니다.)
+		if (g_regionDone) {
+			int region_count = (int)g_regionPoints.size();
+			glm::vec2 *region = frameArena.allocateArray<glm::vec2>(region_count);
+			for (int i = 0; i < region_count; i++)
+				region[i] = glm::vec2(
+					g_regionPoints[i].x / (float)g_width * colorFBO.getWidth(),
+					((float)g_height - g_regionPoints[i].y) / (float)g_height * colorFBO.getHeight());
+
+			if (g_regionMode == RM_RECTANGLE && region_count == 2)
+				regionSelect.setRectangle(region[0], region[1]);
+			else
+				regionSelect.setLasso(region, region_count);
+
+			uint32_t id_count = transforms.size() + 1;
+			if (g_regionAll)
+				regionSelect.selectAll(colorFBO, id_count, pmat, vmat, [this]() { renderScene(usesProxy()); });
+			else
+				regionSelect.selectVisible(colorFBO, id_count);
+
+			g_regionMode = RM_NONE;
+			g_regionDone = false;
+		}
+		// 선택 전에 새 인스턴스의 id까지 늘립니다.
+		selection.resize(transforms.size() + 1);
+		if (regionSelect.poll(regionIds)) {
+			selection.clearAll();
+			for (uint32_t id : regionIds)
+				selection.set(id);
+			printf("region select: %d ids, gpu %.3f ms\n", (int)regionIds.size(), regionSelect.getGpuTime());
+		}
+
+		// 선택 상태 갱신
+		if (g_toggleSelect) {
+			// GPU 결과가 아직 커서 위치의 것이 아니면 (몇 프레임 늦습니다) BVH 레이캐스트로 고릅니다.
+			uint32_t pick_id = hoverId;
+			bool cpu_pick = view < 0 && (hoverHit.x != x || hoverHit.y != y || pickReader.isPending());
+			if (cpu_pick) {
+				pick_id = raycast(g_x, g_y);
+				printf("pick %u: cpu raycast\n", pick_id);
+			}
+			else if (hoverId != 0)
+				printf("pick %u: depth %f, position (%.3f, %.3f, %.3f), normal (%.3f, %.3f, %.3f)\n",
+					hoverId, hoverHit.depth,
+					hoverHit.position.x, hoverHit.position.y, hoverHit.position.z,
+					hoverHit.normal.x, hoverHit.normal.y, hoverHit.normal.z);
+			if (!cpu_pick && hoverId != 0 && hoverHit.triangle >= 0)
+				printf("  triangle %d of lod %d, vertex %d, edge %d\n",
+					hoverHit.triangle, hoverHit.level, hoverHit.getVertex(), hoverHit.getEdge());
+			// 삼각형으로 부품(o, g, usemtl)을 찾습니다. id는 기본값(index + 1)인 경우만
+			// (삼각형은 id 패스가 그린 LOD 레벨의 삼각형입니다.)
+			int instance = (int)hoverId - 1;
+			if (!cpu_pick && hoverId != 0 && hoverHit.triangle >= 0 && instance < transforms.size() && transforms.getId(instance) == hoverId) {
+				const VAO& vao = idPassVAO(instance, hoverHit.level);
+				int part = vao.findPart(hoverHit.triangle);
+				if (part >= 0)
+					printf("  part %d '%s'\n", part, vao.getPart(part).name.c_str());
+			}
+			selection.toggle(pick_id);
+			g_toggleSelect = false;
+		}
+		// 0은 배경입니다. 고른 경우만 지워서 매 프레임 더티 워드를 만들지 않습니다.
+		if (selection.isSelected(0))
+			selection.clear(0);
+		selection.upload(selectionBuffer);
 
 		// 피킹 이미지 만들기
 		makePickMap();
@@ -71,28 +405,114 @@ public:
 		// 피킹 이미지
 		logQR.use();
 		logQR.render(0, 0, colorFBO.getColorTex());
+		if (g_showViews) {
+			for (int i = 0; i < VIEW_COUNT; i++)
+				logQR.render((i + 1) / 3, (i + 1) % 3, multiView.getFBO().getLayerTex(0, i));
+		}
 		logQR.unuse();
 	}
 
+	/*
+		CPU picking with the instance BVH and the mesh BVH.
+		x, y: window coordinates.
+		return: pick id, 0 if nothing is hit.
+	*/
+	uint32_t raycast(int x, int y) const {
+		glm::mat4 inv = glm::inverse(pmat * vmat);
+		float nx = 2.f * (float)x / (float)g_width - 1.f;
+		float ny = 1.f - 2.f * (float)y / (float)g_height;
+		glm::vec4 p0 = inv * glm::vec4(nx, ny, -1.f, 1.f);
+		glm::vec4 p1 = inv * glm::vec4(nx, ny, 1.f, 1.f);
+		glm::vec3 origin = glm::vec3(p0) / p0.w;
+		Ray ray(origin, glm::normalize(glm::vec3(p1) / p1.w - origin));
+
+		auto hit = sceneBVH.raycast(ray, [this](int index, const Ray& r, float tMax) {
+			MeshBVH::Hit mesh_hit;
+			Ray local = r.transform(glm::inverse(transforms.getWorld(index)));
+			return instanceVAO(index).getBVH().intersect(local, tMax, mesh_hit) ? mesh_hit.t : -1.f;
+		});
+
+		return hit.instance < 0 ? 0 : transforms.getId(hit.instance);
+	}
+
+	/*
+		GPU pick under the cursor: id, depth, world position and normal.
+		it is the newest finished pick, so it may lag the cursor by a few frames.
+	*/
+	const PickResult& getHover() const {
+		return hoverHit;
+	}
+
+	/*
+		return: true if the scene changed since the last render()
+		or a pick is still in flight.
+	*/
+	bool needsRedraw() const {
+		return g_deform || sceneVersion() != renderedVersion
+			|| pickReader.isPending() || regionSelect.isPending();
+	}
+
+	void printStats() const {
+		printf("pick cache: %llu hits, %llu misses (%.1f%%), %llu id passes\n",
+			(unsigned long long)pickCache.getHits(), (unsigned long long)pickCache.getMisses(),
+			pickCache.getHitRatio() * 100.f, (unsigned long long)pickCache.getIdPasses());
+		pickBatch.printStats();
+		if (!probeHits.empty())
+			printf("probes: %d of %d points hit\n", probeHitCount, (int)probeHits.size());
+		printf("vertex stream: %.1f MB uploaded, %llu stalls (%s)\n",
+			(double)monkeyVAO.getStream().getWrittenBytes() / (1024.0 * 1024.0),
+			(unsigned long long)monkeyVAO.getStream().getStallCount(),
+			monkeyVAO.getStream().isPersistent() ? "persistent ring" : "orphaning");
+		printf("pick pass: %s depth, gpu %.3f ms\n", sharedDepth ? "shared (GL_EQUAL)" : "own", pickTimer.getMean());
+		uint64_t full = 0, shaded = 0, proxy = 0;
+		for (const auto& lod : meshLods) {
+			full += lod.getFullTriangles();
+			shaded += lod.getShadedTriangles();
+			proxy += lod.getProxyTriangles();
+		}
+		if (full > 0)
+			printf("lod: shaded pass %.1f%%, id pass %.1f%% of %llu full triangles\n",
+				100.0 * shaded / full, 100.0 * (usesProxy() ? proxy : shaded) / full, (unsigned long long)full);
+		uint64_t drawn = meshletCuller.getDrawnTriangles();
+		uint64_t frustum_culled = meshletCuller.getFrustumCulledTriangles();
+		uint64_t cone_culled = meshletCuller.getConeCulledTriangles();
+		uint64_t tested = drawn + frustum_culled + cone_culled;
+		if (tested > 0)
+			printf("meshlets: %d clusters, %llu lod 0 triangles, %.1f%% frustum culled, %.1f%% cone culled, gpu %.3f ms\n",
+				meshletCuller.getTotalMeshletCount(), (unsigned long long)tested,
+				100.0 * frustum_culled / tested, 100.0 * cone_culled / tested, meshletCuller.getGpuTime());
+		printf("scene bvh: %d instances, refit %.3f ms, %d rebuilds\n",
+			sceneBVH.size(), sceneBVH.getLastRefitTime(), sceneBVH.getRebuildCount());
+		printf("coverage: %u visible, %u under 16 pixels, gpu %.3f ms per pass\n",
+			coverage.countVisible(), coverage.countBelow(16), coverage.getGpuTime());
+		MemoryTracker::Stats frame_heap = MemoryTracker::getStats(MS_FRAME);
+		printf("frame heap: %llu allocations in %llu frames (%.3f per frame), frame arena peak %.1f KB\n",
+			(unsigned long long)frame_heap.allocations, (unsigned long long)frameIndex,
+			frameIndex ? (double)frame_heap.allocations / frameIndex : 0.0, frameArena.getPeak() / 1024.0);
+	}
+
 	Scene() = default;
 	~Scene() = default;
 
 private:
 	void makeColorMap() {
 		colorFBO.bind();
-		glClearColor(0, 0, 0, 0);
 		glEnable(GL_DEPTH_TEST);
-		glClearDepth(1.f);
 		glDepthFunc(GL_LESS);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		// 정수 텍스처는 glClear로 지울 수 없습니다.
+		const GLfloat clear_color[4] = { 0, 0, 0, 0 };
+		const GLuint clear_element[4] = { 0, 0, 0, 0 };
+		const GLfloat clear_depth = 1.f;
+		glClearBufferfv(GL_COLOR, 0, clear_color);
+		glClearBufferuiv(GL_COLOR, 1, clear_element);
+		glClearBufferfv(GL_DEPTH, 0, &clear_depth);
 
 		colorShader.use();
-		glm::mat4 pmat = glm::perspective(45.f, g_aspect, 0.1f, 100.f);
-		glm::mat4 vmat = glm::lookAt(glm::vec3(0, 0, 10), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
 		glUniformMatrix4fv(0, 1, GL_FALSE, &pmat[0][0]);
 		glUniformMatrix4fv(1, 1, GL_FALSE, &vmat[0][0]);
 
-		renderScene(true);
+		renderScene(usesProxy(), true, LOD_LEVEL_LOCATION);
 
 		colorShader.unuse();
 		colorFBO.unbind();
@@ -102,92 +522,358 @@ private:
 		pickFBO.bind();
 		glClearColor(0, 0, 0, 0);
 		glEnable(GL_DEPTH_TEST);
-		glClearDepth(1.f);
-		glDepthFunc(GL_LESS);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		if (sharedDepth) {
+			// 색상 이미지와 같은 깊이인 픽셀만 그립니다.
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+		else {
+			glClearDepth(1.f);
+			glDepthFunc(GL_LESS);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
+		pickTimer.poll();
+		pickTimer.begin();
 
 		pickShader.use();
-		glm::mat4 pmat = glm::perspective(45.f, g_aspect, 0.1f, 100.f);
-		glm::mat4 vmat = glm::lookAt(glm::vec3(0, 0, 10), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
 		glUniformMatrix4fv(0, 1, GL_FALSE, &pmat[0][0]);
 		glUniformMatrix4fv(1, 1, GL_FALSE, &vmat[0][0]);
 
 		// pick color
 		glUniform3f(3, 1.f, 0.f, 0.f);
-		glUniform2f(4, (float)(g_x)/(float)g_width , (float)(g_height - g_y)/(float)(g_height));
+		glUniform1ui(4, hoverId);
+
+		// selection bits
+		selectionBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 1);
+		// 모든 텍스처가 한 배열에 있습니다. (인스턴스마다 레이어와 uv 변환)
+		textureAtlas.bind(0);
 
-		// color texture
-		colorFBO.bindColorTexture();
+		renderScene();
+		TextureAtlas::unbind(0);
 
-		renderScene(false);
+		pickTimer.end();
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
 
 		pickShader.unuse();
 		pickFBO.unbind();
 	}
 
-	void renderScene(bool hadID) {
-		glm::mat4 mmat;
-		float color_id = 0.f;
-		float color_step = 0.1f;
+	/*
+		probe grid over the id buffer, rebuilt when the id buffer size changed.
+	*/
+	void updateProbes() {
+		glm::ivec2 size(colorFBO.getWidth(), colorFBO.getHeight());
+		if (size == probeSize)
+			return;
+
+		probeSize = size;
+		probes.clear();
+		for (int j = 0; j < PROBE_GRID; j++)
+			for (int i = 0; i < PROBE_GRID; i++)
+				probes.push_back(glm::ivec2(
+					(2 * i + 1) * size.x / (2 * PROBE_GRID),
+					(2 * j + 1) * size.y / (2 * PROBE_GRID)));
+	}
+
+	/*
+		id passes draw the pick proxy lod, except while the vertices are
+		deformed (lod levels are built from the undeformed mesh).
+	*/
+	bool usesProxy() const {
+		return g_pickProxy && !g_deform;
+	}
 
-		monkeyVAO.bind();
+	/*
+		the pick pass can share the id pass depth only if both draw the same
+		triangles, with the proxy it needs its own depth.
+	*/
+	void updatePickDepth() {
+		bool proxy = usesProxy();
+		if (proxy == proxyActive)
+			return;
 
-		printAllErrors("1");
-		mmat = glm::mat4(1.f); 
-		mmat *= glm::translate(glm::vec3(0, -1, 0));
-		glUniformMatrix4fv(2, 1, GL_FALSE, &mmat[0][0]); // model matrix
-		if(hadID) glUniform1f(15, color_id += color_step); // color id
-		monkeyVAO.render();
+		proxyActive = proxy;
+		// 같은 텍스처 이름이 다시 나올 수 있으니 캐시된 핸들을 먼저 버립니다.
+		baseQR.forget(pickFBO.getColorTex());
+		pickFBO.destroy();
+		pickFBO.create(2048, 2048);
+		sharedDepth = !proxy && pickFBO.shareDepth(colorFBO);
+
+		// id pass and lod order are redone.
+		geometryVersion++;
+	}
 
-		printAllErrors("2");
-		mmat = glm::mat4(1.f);
-		mmat *= glm::translate(glm::vec3(3, 0, 0));
-		glUniformMatrix4fv(2, 1, GL_FALSE, &mmat[0][0]); // model matrix
-		if (hadID) glUniform1f(15, color_id += color_step); // color id
-		monkeyVAO.render();
+	/*
+		sorts the instances of each mesh by lod level when the camera or the scene changed.
+	*/
+	void updateLod(const glm::mat4& view_proj, uint64_t version) {
+		if (lodVersion == version && memcmp(&lodViewProj[0][0], &view_proj[0][0], sizeof(glm::mat4)) == 0)
+			return;
+		lodVersion = version;
+		lodViewProj = view_proj;
 
-		mmat = glm::mat4(1.f);
-		mmat *= glm::translate(glm::vec3(-4, -2, 0));
-		mmat *= glm::scale(glm::vec3(3, 3, 3));
-		glUniformMatrix4fv(2, 1, GL_FALSE, &mmat[0][0]); // model matrix
-		if (hadID) glUniform1f(15, color_id += color_step); // color id
-		monkeyVAO.render();
+		// 변형 중에는 원본만 그립니다.
+		float pixel_scale = g_deform ? 0.f : pmat[1][1] * 0.5f * (float)pickFBO.getHeight();
+		lodOrder.resize(transforms.size());
+		const auto& meshes = sceneFile.getMeshes();
+		for (size_t i = 0; i < meshes.size(); i++)
+			meshLods[i].classify(transforms, meshes[i].first, meshes[i].count, vmat, pixel_scale, lodOrder.data());
 
-		mmat = glm::mat4(1.f);
-		mmat *= glm::translate(glm::vec3(0, 2, 0));
-		mmat *= glm::scale(glm::vec3(3, 3, 3));
-		glUniformMatrix4fv(2, 1, GL_FALSE, &mmat[0][0]); // model matrix
-		if (hadID) glUniform1f(15, color_id += color_step); // color id
-		monkeyVAO.render();
+		size_t size = sizeof(GLuint) * lodOrder.size();
+		if (size == 0)
+			return;
+
+		if (lodOrderBuffer.getSize() != size) {
+			if (lodOrderBuffer.isCreated())
+				lodOrderBuffer.destroy();
+			lodOrderBuffer.create(size, lodOrder.data());
+			for (auto& lod : meshLods)
+				lod.forEachLevel([this](VAO& vao) { vao.setInstanceBuffer(lodOrderBuffer.getBuffer()); });
+		}
+		else {
+			lodOrderBuffer.update(0, size, lodOrder.data());
+		}
 
-		monkeyVAO.unbind();
+		// 레벨 0 인스턴스의 메시렛 컬링 (색상, 피킹 패스가 같은 목록을 그립니다)
+		glm::vec3 camera = glm::vec3(glm::inverse(vmat)[3]);
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (meshlets[i] < 0)
+				continue;
+			// 변형된 정점은 메시렛 경계를 벗어납니다.
+			if (monkeyDeformed && meshVAOs[i] == &monkeyVAO) {
+				meshletCuller.invalidate(meshlets[i]);
+				continue;
+			}
+			meshletCuller.cull(meshlets[i], meshes[i].first + meshLods[i].getLevelOffset(0),
+				meshLods[i].getLevelInstances(0), view_proj, camera, instanceBuffer, lodOrderBuffer);
+		}
+	}
+
+	/*
+		changes when transforms or vertices change.
+	*/
+	uint64_t sceneVersion() const {
+		return transforms.getVersion() + geometryVersion;
+	}
+
+	/*
+		waves the vertices along y, the normals become the face normals
+		of the waved triangles.
+	*/
+	void deform(float time) {
+		monkeyDeformed = true;
+		deformed.resize(basePositions.size() * 3);
+		for (size_t i = 0; i < basePositions.size(); i++) {
+			const glm::vec3& p = basePositions[i];
+			deformed[3 * i + 0] = p.x;
+			deformed[3 * i + 1] = p.y + 0.1f * std::sin(4.f * p.x + 3.f * time);
+			deformed[3 * i + 2] = p.z;
+		}
+
+		// 정점은 삼각형마다 따로 있으니 면 법선을 세 정점에 씁니다.
+		deformedNormals.resize(deformed.size());
+		for (size_t i = 0; i + 9 <= deformed.size(); i += 9) {
+			glm::vec3 p0(deformed[i], deformed[i + 1], deformed[i + 2]);
+			glm::vec3 p1(deformed[i + 3], deformed[i + 4], deformed[i + 5]);
+			glm::vec3 p2(deformed[i + 6], deformed[i + 7], deformed[i + 8]);
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(n);
+			n = length > 0.f ? n / length : glm::vec3(0.f, 1.f, 0.f);
+			for (int k = 0; k < 9; k++)
+				deformedNormals[i + k] = n[k % 3];
+		}
+
+		// 법선이 없는 레이아웃이면 위치만 올립니다.
+		int count = (int)basePositions.size();
+		if (!monkeyVAO.updateVertices(0, count, deformed.data(), deformedNormals.data()))
+			monkeyVAO.updateVertices(0, count, deformed.data());
+	}
+
+	/*
+		return: view of the logQR tile under the cursor, -1 if it is not a view.
+	*/
+	int hoverView() const {
+		int row, col;
+		float s, t;
+		if (!g_showViews || !logQR.hitTile((float)g_x / (float)g_width, (float)g_y / (float)g_height, row, col, s, t))
+			return -1;
+
+		int view = row * 3 + col - 1;
+		return (view >= 0 && view < multiView.getViewCount()) ? view : -1;
+	}
+
+	/*
+		packs the mesh textures into the atlas and gives each instance
+		the layer and uv transform of its mesh texture.
+	*/
+	bool loadTextures() {
+		const auto& meshes = sceneFile.getMeshes();
+		std::vector<int> textures;
+		for (const auto& mesh : meshes) {
+			textures.push_back(mesh.texture.empty() ? -1 : textureAtlas.add(mesh.texture.c_str()));
+			if (!mesh.texture.empty() && textures.back() < 0)
+				return false;
+		}
+		if (textureAtlas.getTextureCount() == 0)
+			return true;
+
+		if (!textureAtlas.build()) return false;
+		printf("textures: %d in %d layers\n", textureAtlas.getTextureCount(), textureAtlas.getLayerCount());
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (textures[i] < 0)
+				continue;
+			const TextureAtlas::Region& region = textureAtlas.getRegion(textures[i]);
+			for (int index = meshes[i].first; index < meshes[i].first + meshes[i].count; index++)
+				transforms.setTexture(index, region.layer, region.scale, region.offset);
+		}
+
+		return true;
+	}
+
+	/*
+		return: mesh loaded from path, shared with ball and monkey.
+	*/
+	VAO* loadMesh(const std::string& path) {
+		if (path == "resources/objects/monkey.obj")
+			return &monkeyVAO;
+		if (path == "resources/objects/ball.obj")
+			return &ballVAO;
+
+		const auto& meshes = sceneFile.getMeshes();
+		for (size_t i = 0; i < meshVAOs.size(); i++)
+			if (meshes[i].path == path)
+				return meshVAOs[i];
+
+		// 큰 모델은 정점 버퍼로 바로 스트리밍합니다.
+		VAO vao;
+		if (!vao.loadStreaming(path.c_str()))
+			return nullptr;
+		// the meshes must not move, see the reserve in create().
+		assert(meshRegistry.size() < meshRegistry.capacity());
+		return meshRegistry.get(meshRegistry.add(std::move(vao)));
+	}
+
+	const VAO& instanceVAO(int index) const {
+		int mesh = sceneFile.findMesh(index);
+		return mesh < 0 ? monkeyVAO : *meshVAOs[mesh];
+	}
+
+	/*
+		return: lod level of the mesh of index, drawn by the id pass.
+		level: PickResult::level, the id pass writes it with the triangle.
+	*/
+	VAO& idPassVAO(int index, int level) {
+		int mesh = sceneFile.findMesh(index);
+		if (mesh < 0)
+			return monkeyVAO;
+		return meshLods[mesh].getLevel(std::min(level, meshLods[mesh].getLevelCount() - 1));
+	}
+
+	/*
+		proxy:
+		true draws every instance with the pick proxy lod (id only passes),
+		false picks the lod from the screen size.
+		culled:
+		level 0 draws only the meshlets left by the camera culling,
+		false for other cameras.
+		level_location:
+		uniform set to the lod level of each draw (id passes), -1 for none.
+	*/
+	void renderScene(bool proxy = false, bool culled = true, GLint level_location = -1) {
+		instanceBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, 0);
+
+		// 메쉬마다 자신의 인스턴스 범위를 그립니다. (부품들은 한번의 멀티 드로우)
+		const auto& meshes = sceneFile.getMeshes();
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (meshes[i].count == 0)
+				continue;
+			if (proxy) {
+				meshLods[i].renderProxy(meshes[i].first, level_location);
+			}
+			else if (culled && meshletCuller.isCulled(meshlets[i])) {
+				// 레벨 0은 남은 메시렛만, 나머지 레벨은 그대로
+				if (level_location >= 0)
+					glUniform1ui(level_location, 0);
+				meshVAOs[i]->bind();
+				meshletCuller.render(meshlets[i]);
+				meshLods[i].render(meshes[i].first, 1, level_location);
+			}
+			else {
+				meshLods[i].render(meshes[i].first, 0, level_location);
+			}
+		}
+		VAO::unbind();
 	}
 };
 
-int main()
+/*
+	Test_Color_Picking [scene file] [binary output] [--capture file [frames]] [--replay file]
+	scene file: text or binary scene, default resources/scenes/default.scene.
+	binary output: writes the loaded scene as binary (text -> binary conversion).
+	--capture: records the input of the rendered frames (all, or the first frames).
+	--replay: renders the frames of a capture in a hidden window as fast as
+	possible and prints the frame times, then exits.
+*/
+int main(int argc, char **argv)
 {
 #ifdef _DEBUG
 	_CrtDumpMemoryLeaks();
 	_CrtSetDbgFlag(0x21);
 #endif
 
+	const char *files[2] = { "resources/scenes/default.scene", nullptr };
+	const char *capture_file = nullptr;
+	const char *replay_file = nullptr;
+	unsigned long long capture_frames = 0;
+	for (int i = 1, file = 0; i < argc; i++) {
+		if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			capture_file = argv[++i];
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				capture_frames = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replay_file = argv[++i];
+		}
+		else if (file < 2) {
+			files[file++] = argv[i];
+		}
+	}
+
+	InputCapture replay;
+	if (replay_file) {
+		if (!replay.load(replay_file))
+			return -1;
+		g_width = replay.getWidth();
+		g_height = replay.getHeight();
+		g_aspect = (float)g_width / (float)g_height;
+	}
+
 	/* 초기화, 에러 핸들링 등록, 이벤트 콜백 등록, OpenGL 초기화 */
 	/* -------------------------------------------------------------------------------------- */
 	glfwInit();
 	glfwSetErrorCallback([](int err, const char* desc) { puts(desc); });
-	initContext(/*use dafault = */ true);
+	initContext(/*use dafault = */ false, 4, 3);
+	// 재생은 보이지 않는 창에서
+	if (replay_file)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 	GLFWwindow *window = glfwCreateWindow(g_width, g_height, "Order Independent Transparency Rendering!", nullptr, nullptr);
 	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
 	glfwSetMouseButtonCallback(window, mousebuttonCallback);
 	glfwSetCursorPosCallback(window, cursorPosCallback);
+	glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+	glfwSetKeyCallback(window, keyCallback);
 	glfwMakeContextCurrent(window);
+	glewExperimental = GL_TRUE; // core profile
 	glewInit();
 
 	/* 객체 생성 및 초기화 */
 	/* -------------------------------------------------------------------------------------- */
 	auto scene = new Scene();
 
-	if (scene->create()) {
+	if (scene->create(files[0], files[1])) {
 		puts("객체 생성 성공!");
 	}
 	else {
@@ -202,21 +888,67 @@ int main()
 
 	/* 메인 루프 */
 	/* -------------------------------------------------------------------------------------- */
+	// 프레임 속도는 FramePacer가 맞춥니다.
+	glfwSwapInterval(0);
+	FramePacer pacer(replay_file ? 0.0 : g_targetFps);
+
+	if (capture_file && !g_capture.beginRecord(capture_file, g_width, g_height, capture_frames))
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+	// 기록된 프레임을 같은 입력으로 다시 그립니다. (gpu 완료까지 잰 프레임 시간)
+	if (replay_file) {
+		while (replay.replayFrame(g_time, [window](const InputCapture::Event& event) {
+			switch (event.type) {
+			case InputCapture::ET_CURSOR: cursorPosCallback(window, event.x, event.y); break;
+			case InputCapture::ET_BUTTON: mousebuttonCallback(window, event.a, event.b, event.c); break;
+			case InputCapture::ET_KEY: keyCallback(window, event.a, 0, event.b, event.c); break;
+			case InputCapture::ET_SIZE:
+				glfwSetWindowSize(window, event.a, event.b);
+				framebufferSizeCallback(window, event.a, event.b);
+				break;
+			}
+		})) {
+			pacer.countWake();
+			scene->render();
+			glfwSwapBuffers(window);
+			glFinish();
+			pacer.endFrame();
+		}
+		printf("replay: %llu frames of %s\n", (unsigned long long)replay.getFrameCount(), replay_file);
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+	}
+
 	while (!glfwWindowShouldClose(window))
 	{
-		if (!g_pause) {
+		pacer.countWake();
+
+		if (!g_pause && (g_dirty || scene->needsRedraw())) {
+			// 다음 프레임 시각까지 대기하고 그 사이의 입력을 모읍니다.
+			pacer.waitForFrame();
+			glfwPollEvents();
+			g_dirty = false;
+			g_time = glfwGetTime();
+			g_capture.recordFrame(g_time);
+
 			// 렌더링
 			scene->render();
-			// 버퍼 스왑, 이벤트 폴
+			// 버퍼 스왑
 			glfwSwapBuffers(window);
+			pacer.endFrame();
+		}
+		else {
+			// 바뀐 것이 없으면 입력이 올 때까지 잠듭니다.
+			glfwWaitEventsTimeout(0.5);
 		}
-
-		glfwPollEvents();
 	}
 
 	/* 루프 종료 검사 */
 	/* -------------------------------------------------------------------------------------- */
 	printAllErrors("루프 종료 검사");
+	g_capture.endRecord();
+	scene->printStats();
+	pacer.printStats();
+	MemoryTracker::printStats();
 
 	/* 객체 제거 */
 	/* -------------------------------------------------------------------------------------- */
@@ -260,9 +992,11 @@ void initContext(bool useDefault, int major, int minor, bool useCompatibility)
 
 void framebufferSizeCallback(GLFWwindow*, int w, int h)
 {
+	g_capture.recordSize(w, h);
 	g_width = w;
 	g_height = h;
 	g_aspect = (float)g_width / (float)g_height;
+	g_dirty = true;
 	//printf("%d, %d\n", w, h);
 
 	if (g_pause) {
@@ -273,23 +1007,83 @@ void framebufferSizeCallback(GLFWwindow*, int w, int h)
 
 void mousebuttonCallback(GLFWwindow*, int button, int action, int mods)
 {
+	g_capture.recordButton(button, action, mods);
+	g_dirty = true;
+
+	if (button == GLFW_MOUSE_BUTTON_LEFT && (mods & (GLFW_MOD_SHIFT | GLFW_MOD_CONTROL))) {
+		if (action == GLFW_PRESS) {
+			g_regionMode = (mods & GLFW_MOD_SHIFT) ? RM_RECTANGLE : RM_LASSO;
+			g_regionAll = (mods & GLFW_MOD_ALT) != 0;
+			g_regionDone = false;
+			g_regionPoints.assign(1, glm::vec2((float)g_x, (float)g_y));
+		}
+		else if (action == GLFW_RELEASE && g_regionMode != RM_NONE) {
+			g_regionDone = true;
+		}
+		return;
+	}
+
 	if (action == GLFW_PRESS) {
 		if (button == GLFW_MOUSE_BUTTON_LEFT) {
 			g_pause = !g_pause;
 			puts(g_pause ? "pause !" : "start !");
 		}
 		else if (button == GLFW_MOUSE_BUTTON_RIGHT) {
+			g_toggleSelect = true;
 		}
 		else {
-			g_pause = !g_pause;
-			puts(g_pause ? "pause !" : "start !");
+			g_showViews = !g_showViews;
+			puts(g_showViews ? "views on !" : "views off !");
 		}
 	}
 }
 
 void cursorPosCallback(GLFWwindow*, double x, double y)
 {
+	g_capture.recordCursor(x, y);
 	g_x = (int)x;
 	g_y = (int)y;
+	g_dirty = true;
+
+	// 드래그 중인 영역
+	if (g_regionMode == RM_RECTANGLE && !g_regionDone) {
+		g_regionPoints.resize(1);
+		g_regionPoints.push_back(glm::vec2((float)x, (float)y));
+	}
+	else if (g_regionMode == RM_LASSO && !g_regionDone) {
+		glm::vec2 last = g_regionPoints.back();
+		if (std::abs((float)x - last.x) + std::abs((float)y - last.y) >= 2.f)
+			g_regionPoints.push_back(glm::vec2((float)x, (float)y));
+	}
 	//printf("%d, %d\n", g_x, g_y);
+}
+
+void windowRefreshCallback(GLFWwindow*)
+{
+	g_dirty = true;
+}
+
+void keyCallback(GLFWwindow*, int key, int scancode, int action, int mods)
+{
+	g_capture.recordKey(key, action, mods);
+	if (action != GLFW_PRESS)
+		return;
+
+	g_dirty = true;
+
+	// D: 정점 변형 애니메이션
+	if (key == GLFW_KEY_D) {
+		g_deform = !g_deform;
+		puts(g_deform ? "deform on !" : "deform off !");
+	}
+	// P: id 패스에 피킹용 프록시 LOD 사용
+	if (key == GLFW_KEY_P) {
+		g_pickProxy = !g_pickProxy;
+		puts(g_pickProxy ? "pick proxy on !" : "pick proxy off !");
+	}
+	// B: 100 x 100 점 격자를 매 프레임 한번에 피킹 (측정용)
+	if (key == GLFW_KEY_B) {
+		g_probeGrid = !g_probeGrid;
+		puts(g_probeGrid ? "probe grid on !" : "probe grid off !");
+	}
 }
\ No newline at end of file
@@ -2,13 +2,22 @@
 
 in VOUT {
 	vec3 normal;
+	vec3 barycentric;
+	flat uint id;
+	flat uint triangle;
 }v;
 
-layout(location = 15) uniform float color_id;
+// lod level of the drawn vertex buffer (see MeshLod::render)
+layout(location = 2) uniform uint lod_level;
 
 layout(location = 0) out vec4 frag_color;
+// x: triangle | lod level << 29, y: barycentric of corner 1 and 2 (unorm 16 x 2)
+layout(location = 1) out uvec2 frag_element;
 
 void main()
 {
-	frag_color = vec4(color_id, 0.f, 0.f, 0.f);
+	// r: id, gba: world normal facing the camera
+	vec3 n = normalize(v.normal);
+	frag_color = vec4(float(v.id), gl_FrontFacing ? n : -n);
+	frag_element = uvec2(v.triangle | (lod_level << 29u), packUnorm2x16(v.barycentric.yz));
 }
\ No newline at end of file
@@ -3,18 +3,44 @@
 layout(location = 0) in vec3 vertex;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
+layout(location = 3) in uint instance;
+
+struct Instance {
+	mat4 model;
+	vec4 normal[3];
+	uint id;
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+	Instance instances[];
+};
+
+// same position as pick.vert, the pick pass depth tests with GL_EQUAL.
+invariant gl_Position;
 
 layout(location = 0) uniform mat4 pmat;
 layout(location = 1) uniform mat4 vmat;
-layout(location = 2) uniform mat4 mmat;
 
 out VOUT {
 	vec3 normal;
+	vec3 barycentric;
+	flat uint id;
+	flat uint triangle;
 }v;
 
+// vertices are not shared, so corner of the triangle is gl_VertexID % 3.
+// gl_VertexID counts from the start of the buffer, so the triangle is
+// unique across the draws of a multi draw (gl_PrimitiveID restarts per draw).
+const vec3 corners[3] = vec3[](vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1));
+
 void main()
 {
-	gl_Position = pmat * vmat * mmat * vec4(vertex, 1.f);
+	Instance inst = instances[instance];
+
+	gl_Position = pmat * vmat * inst.model * vec4(vertex, 1.f);
 
-	v.normal = mat3(transpose(inverse(mmat))) * normal;
+	v.normal = mat3(inst.normal[0].xyz, inst.normal[1].xyz, inst.normal[2].xyz) * normal;
+	v.barycentric = corners[gl_VertexID % 3];
+	v.id = inst.id;
+	v.triangle = uint(gl_VertexID) / 3u;
 }
\ No newline at end of file
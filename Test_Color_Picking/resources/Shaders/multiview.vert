@@ -0,0 +1,38 @@
+#version 430 core
+
+layout(location = 0) in vec3 vertex;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+layout(location = 3) in uint instance;
+
+struct Instance {
+	mat4 model;
+	vec4 normal[3];
+	uint id;
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+	Instance instances[];
+};
+
+// world position, the geometry shader projects it for each view.
+out VOUT {
+	vec3 normal;
+	vec3 barycentric;
+	flat uint id;
+	flat uint triangle;
+}v;
+
+const vec3 corners[3] = vec3[](vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1));
+
+void main()
+{
+	Instance inst = instances[instance];
+
+	gl_Position = inst.model * vec4(vertex, 1.f);
+
+	v.normal = mat3(inst.normal[0].xyz, inst.normal[1].xyz, inst.normal[2].xyz) * normal;
+	v.barycentric = corners[gl_VertexID % 3];
+	v.id = inst.id;
+	v.triangle = uint(gl_VertexID) / 3u;
+}
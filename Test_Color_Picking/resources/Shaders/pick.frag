@@ -1,13 +1,25 @@
 #version 430 core
 
+// depth is final after the id pass, each pixel is shaded once.
+layout(early_fragment_tests) in;
+
 in VOUT {
 	vec3 normal;
+	vec2 texCoord;
+	flat uint id;
+	flat uint layer;
+	flat vec4 uvTransform;
 }v;
 
-layout(binding = 0) uniform sampler2D color_map;
+layout(std430, binding = 1) readonly buffer Selection {
+	uint selection[];
+};
 
 layout(location = 3) uniform vec3 pick_color;
-layout(location = 4) uniform vec2 mouse_pos;
+layout(location = 4) uniform uint hover_id;
+
+// every texture of the scene (see TextureAtlas)
+layout(binding = 0) uniform sampler2DArray textures;
 
 layout(location = 0) out vec4 frag_color;
 
@@ -15,10 +27,17 @@ void main()
 {
 	frag_color = vec4(v.normal, 1.f);
 
-	float mouse_pos_color = texture(color_map, mouse_pos).r;
-	float frag_pos_color = texelFetch(color_map, ivec2(gl_FragCoord.st), 0).r;
-	
-	if(abs(mouse_pos_color - frag_pos_color) < 0.001f)
-		//frag_color = vec4(0.5f*(frag_color.rgb + pick_color), 1);
+	if (v.layer != 0u) {
+		// packed regions do not repeat, whole layers do.
+		vec2 uv = all(equal(v.uvTransform.xy, vec2(1.f))) ? v.texCoord : clamp(v.texCoord, 0.f, 1.f);
+		frag_color = texture(textures, vec3(uv * v.uvTransform.xy + v.uvTransform.zw, float(v.layer - 1u)));
+	}
+
+	uint word = v.id >> 5;
+	bool selected = word < uint(selection.length()) && (selection[word] & (1u << (v.id & 31u))) != 0u;
+
+	if (selected)
+		frag_color = vec4(0.5f*(frag_color.rgb + pick_color), 1);
+	if (v.id == hover_id)
 		frag_color = vec4(1.f) - frag_color;
 }
\ No newline at end of file
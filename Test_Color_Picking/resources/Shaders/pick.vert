@@ -3,18 +3,44 @@
 layout(location = 0) in vec3 vertex;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoord;
+layout(location = 3) in uint instance;
+
+struct Instance {
+	mat4 model;
+	vec4 normal[3];
+	uint id;
+	uint layer;		// texture array layer + 1, 0 is untextured
+	uint uvScale;	// unorm16 x 2
+	uint uvOffset;
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+	Instance instances[];
+};
+
+// same position as color.vert, the pick pass depth tests with GL_EQUAL.
+invariant gl_Position;
 
 layout(location = 0) uniform mat4 pmat;
 layout(location = 1) uniform mat4 vmat;
-layout(location = 2) uniform mat4 mmat;
 
 out VOUT {
 	vec3 normal;
+	vec2 texCoord;
+	flat uint id;
+	flat uint layer;
+	flat vec4 uvTransform;
 }v;
 
 void main()
 {
-	gl_Position = pmat * vmat * mmat * vec4(vertex, 1.f);
+	Instance inst = instances[instance];
+
+	gl_Position = pmat * vmat * inst.model * vec4(vertex, 1.f);
 
 	v.normal = normal;
+	v.texCoord = texCoord;
+	v.id = inst.id;
+	v.layer = inst.layer;
+	v.uvTransform = vec4(unpackUnorm2x16(inst.uvScale), unpackUnorm2x16(inst.uvOffset));
 }
\ No newline at end of file
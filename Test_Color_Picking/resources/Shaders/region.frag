@@ -0,0 +1,57 @@
+#version 430 core
+
+in VOUT {
+	vec3 normal;
+	vec3 barycentric;
+	flat uint id;
+	flat uint triangle;
+}v;
+
+layout(std430, binding = 2) readonly buffer Polygon {
+	vec2 polygon[];
+};
+
+layout(std430, binding = 3) buffer Bits {
+	uint bits[];
+};
+
+layout(std430, binding = 4) buffer List {
+	uint count;
+	uint ids[];
+};
+
+// [rect.xy, rect.zw)
+layout(location = 5) uniform ivec4 rect;
+// 0: rectangle
+layout(location = 6) uniform int polygon_size;
+layout(location = 7) uniform uint id_count;
+
+bool inside(vec2 p)
+{
+	bool result = false;
+
+	// even-odd rule
+	for (int i = 0, j = polygon_size - 1; i < polygon_size; j = i++) {
+		vec2 a = polygon[i];
+		vec2 b = polygon[j];
+		if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x)
+			result = !result;
+	}
+
+	return polygon_size == 0 || result;
+}
+
+void main()
+{
+	// rect is applied by the scissor test.
+	if (!inside(gl_FragCoord.xy))
+		discard;
+
+	uint id = v.id;
+	if (id == 0u || id >= id_count)
+		discard;
+
+	uint bit = 1u << (id & 31u);
+	if ((atomicOr(bits[id >> 5], bit) & bit) == 0u)
+		ids[atomicAdd(count, 1u)] = id;
+}